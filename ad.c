@@ -30,6 +30,17 @@ int typeSize(Type *t){
 	return t->n*typeBaseSize(t);
 	}
 
+int typeAlign(Type *t){
+	if(t->n>=0||t->tb==TB_STRUCT)return 8;
+	return typeBaseSize(t);
+	}
+
+int frameSlots(Type *t){
+	if(t->n<0&&t->tb!=TB_STRUCT)return 1;
+	int n=(typeSize(t)+(int)sizeof(Val)-1)/(int)sizeof(Val);
+	return n?n:1;
+	}
+
 // free from memory a list of symbols
 void freeSymbols(Symbol *list){
 	for(Symbol *next;list;list=next){
@@ -72,15 +83,19 @@ int symbolsLen(Symbol *list){
 	return n;
 	}
 
+int localsSlots(Symbol *list){
+	int n=0;
+	for(;list;list=list->next)n+=frameSlots(&list->type);
+	return n;
+	}
+
 void freeSymbol(Symbol *s){
 	switch(s->kind){
-		case SK_VAR:
-			if(!s->owner)free(s->varMem);
-			break;
 		case SK_FN:
 			freeSymbols(s->fn.params);
 			freeSymbols(s->fn.locals);
 			break;
+		case SK_VAR:		// the globals are in the data segment, which is freed by the VM
 		case SK_PARAM:
 			break;
 		case SK_STRUCT:
@@ -126,7 +141,7 @@ void showSymbol(Symbol *s){
 				if(s->owner){
 					printf(";\t// size=%d, idx=%d\n",typeSize(&s->type),s->varIdx);
 					}else{
-					printf(";\t// size=%d, mem=%p\n",typeSize(&s->type),s->varMem);
+					printf(";\t// size=%d, offset=%d\n",typeSize(&s->type),s->dataOffset);
 					}
 				break;
 			case SK_PARAM:{
@@ -24,6 +24,14 @@ typedef struct{		// the type of a symbol
 // returns the size of type t in bytes
 int typeSize(Type *t);
 
+// returns the alignment of a variable of type t in the data segment: the size of a scalar, 8 for the arrays and structs
+int typeAlign(Type *t);
+
+// returns the number of frame slots (Val) of a local variable of type t
+// a scalar has a slot, which the optimizer and the register VM use as a register
+// the arrays and the structs are stored inline in the frame, in consecutive slots which hold their bytes
+int frameSlots(Type *t);
+
 typedef enum{		// symbol's kind
 	SK_VAR,SK_PARAM,SK_FN,SK_STRUCT
 	}SymKind;
@@ -40,11 +48,11 @@ struct Symbol{
 	Symbol *owner;
 	Symbol *next;		// the link to the next symbol in list
 	union{		// specific data fo each kind of symbol
-		// the index in fn.locals for local vars
+		// the index of the first frame slot of local vars (FP[varIdx+1], see frameSlots)
 		// the index in struct for struct members
 		int varIdx;
-		// the variable memory for global vars (dynamically allocated)
-		void *varMem;
+		// the offset of a global var in the data segment (see dataAlloc in vm.h)
+		int dataOffset;
 		// the index in fn.params for parameters
 		int paramIdx;
 		// the members of a struct
@@ -54,6 +62,10 @@ struct Symbol{
 			Symbol *locals;		// all local vars of a function, including the ones from its inner domains
 			void(*extFnPtr)();		// !=NULL for extern functions
 			Instr *instr;		// used if extFnPtr==NULL
+			bool pure;		// the function has no side effects and it doesn't write the memory
+			// only declared by a prototype, its code is defined in another module (see link.h)
+			// until it is linked, instr is a single ENTER, which is the target of the calls
+			bool imported;
 			}fn;
 		};
 	};
@@ -65,6 +77,8 @@ Symbol *dupSymbol(Symbol *symbol);
 // adds the symbol the the end of the list
 // list - the address of the list where to add the symbol
 Symbol *addSymbolToList(Symbol **list,Symbol *s);
+// the number of frame slots of the local variables from list
+int localsSlots(Symbol *list);
 // the number of the symbols in list
 int symbolsLen(Symbol *list);
 // frees the memory of a symbol
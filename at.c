@@ -62,7 +62,8 @@ bool arithTypeTo(Type *t1,Type *t2,Type *dst){
 				case TB_INT:
 				case TB_DOUBLE:
 				case TB_CHAR:
-					dst->tb=t2->tb;return true;
+					// the chars are promoted to int
+					dst->tb=t2->tb==TB_DOUBLE?TB_DOUBLE:TB_INT;return true;
 				default:return false;
 				}
 		default:return false;
@@ -75,3 +76,15 @@ Symbol *findSymbolInList(Symbol *list,const char *name){
 		}
 	return NULL;
 	}
+
+bool sameType(Type *t1,Type *t2){
+	if(t1->tb!=t2->tb||t1->n!=t2->n)return false;
+	return t1->tb!=TB_STRUCT||!strcmp(t1->s->name,t2->s->name);
+	}
+
+bool sameParams(Symbol *params1,Symbol *params2){
+	for(;params1&&params2;params1=params1->next,params2=params2->next){
+		if(!sameType(&params1->type,&params2->type))return false;
+		}
+	return !params1&&!params2;
+	}
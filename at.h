@@ -9,6 +9,10 @@ typedef struct{
 	Type type;		// the returned type
 	bool lval;			// true if left-value
 	bool ct;				// true if constant
+	// true if the value is known at compile time
+	// in this case its code is a single PUSH instruction, which is the last one generated
+	bool known;
+	Val val;			// the value computed at compile time, if known
 	}Ret;
 
 // returns true if r->type can be converted
@@ -28,3 +32,10 @@ bool arithTypeTo(Type *t1,Type *t2,Type *dst);
 // searches a name in a list of symbols
 // if it finds it, returns the correspondent symbol, else NULL
 Symbol *findSymbolInList(Symbol *list,const char *name);
+
+// returns true if the types are the same
+// the structs are compared by name, so the types from different modules can be compared (see link.h)
+bool sameType(Type *t1,Type *t2);
+
+// returns true if the parameters from the two lists have the same types, in the same order
+bool sameParams(Symbol *params1,Symbol *params2);
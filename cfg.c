@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+#include "opt.h"
+#include "profile.h"
+#include "cfg.h"
+
+static bool isReturn(CfgBlock *b){
+	return b->last->op==OP_RET||b->last->op==OP_RET_VOID||b->last->op==OP_TAILCALL;
+	}
+
+// the innermost loop which contains the block b: [*h,*e] are the ids of its header and of the block with the back jump
+// returns false if b is not in a loop
+static bool innerLoop(Cfg *g,CfgBlock *b,int *h,int *e){
+	bool found=false;
+	for(int k=b->id;k<g->nBlocks;k++){
+		CfgBlock *x=&g->blocks[k];
+		CfgBlock *back=x->taken&&x->taken->id<=x->id?x->taken:NULL;
+		if(!back||back->id>b->id)continue;
+		if(!found||back->id>*h){
+			*h=back->id;
+			*e=k;
+			found=true;
+			}
+		}
+	return found;
+	}
+
+// the probability that the conditional jump which ends b jumps, estimated with static heuristics
+static double staticProb(Cfg *g,CfgBlock *b){
+	if(b->taken->id<=b->id)return 0.88;
+	int h=0,e=0;
+	if(innerLoop(g,b,&h,&e)){
+		bool takenOut=b->taken->id<h||b->taken->id>e,fallOut=b->fall->id<h||b->fall->id>e;
+		if(takenOut&&!fallOut)return 0.12;
+		if(fallOut&&!takenOut)return 0.88;
+		}
+	bool takenRet=isReturn(b->taken),fallRet=isReturn(b->fall);
+	if(takenRet&&!fallRet)return 0.28;
+	if(fallRet&&!takenRet)return 0.72;
+	return 0.5;
+	}
+
+Cfg *cfgBuild(Symbol *fn){
+	Instr *code=fn->fn.instr;
+	int n=0;
+	for(Instr *i=code;i;i=i->next)n++;
+	Instr **instrs=(Instr**)safeAlloc(n*sizeof(Instr*));
+	InstrIdx *idx=(InstrIdx*)safeAlloc(n*sizeof(InstrIdx));
+	n=0;
+	for(Instr *i=code;i;i=i->next){
+		idx[n]=(InstrIdx){i,n};
+		instrs[n++]=i;
+		}
+	qsort(idx,n,sizeof(InstrIdx),cmpInstrIdx);
+	// the leaders, which start the blocks
+	bool *leader=(bool*)safeAlloc(n*sizeof(bool));
+	memset(leader,0,n*sizeof(bool));
+	leader[0]=true;
+	for(int k=0;k<n;k++){
+		Instr *i=instrs[k];
+		if(isJump(i))leader[findIdx(idx,n,i->arg.instr)]=true;
+		if((isJump(i)||endsFlow(i))&&k+1<n)leader[k+1]=true;
+		}
+	Cfg *g=(Cfg*)safeAlloc(sizeof(Cfg));
+	g->fn=fn;
+	g->nBlocks=0;
+	for(int k=0;k<n;k++)g->nBlocks+=leader[k];
+	g->blocks=(CfgBlock*)safeAlloc(g->nBlocks*sizeof(CfgBlock));
+	int *blockOf=(int*)safeAlloc(n*sizeof(int));
+	int nb=-1;
+	for(int k=0;k<n;k++){
+		if(leader[k]){
+			CfgBlock *b=&g->blocks[++nb];
+			memset(b,0,sizeof(CfgBlock));
+			b->id=nb;
+			b->first=instrs[k];
+			}
+		g->blocks[nb].last=instrs[k];
+		blockOf[k]=nb;
+		}
+	for(int k=0;k<g->nBlocks;k++){
+		CfgBlock *b=&g->blocks[k];
+		if(isJump(b->last))b->taken=&g->blocks[blockOf[findIdx(idx,n,b->last->arg.instr)]];
+		if(!endsFlow(b->last)&&k+1<g->nBlocks)b->fall=&g->blocks[k+1];
+		}
+	// the probabilities of the conditional jumps and the blocks which were not executed in the profiled run
+	ProfileData *entry=code->prof;
+	for(int k=0;k<g->nBlocks;k++){
+		CfgBlock *b=&g->blocks[k];
+		if(!b->taken||!b->fall)continue;
+		ProfileData *p=b->last->prof;
+		b->prob=p&&p->count?(double)p->taken/p->count:staticProb(g,b);
+		}
+	// the back edges are ignored, so the frequencies can be compared only between the blocks of the same loop
+	g->blocks[0].freq=1;
+	for(int k=0;k<g->nBlocks;k++){
+		CfgBlock *b=&g->blocks[k];
+		double pTaken=b->fall?b->prob:1;
+		if(b->taken&&b->taken->id>k)b->taken->freq+=b->freq*pTaken;
+		if(b->fall)b->fall->freq+=b->freq*(1-pTaken);
+		}
+	if(entry&&entry->count){
+		// a block is cold if it cannot be reached from the entry by executed edges
+		// only the edges of the conditional jumps with counts can be known as not executed
+		for(int k=1;k<g->nBlocks;k++)g->blocks[k].cold=true;
+		for(bool again=true;again;){
+			again=false;
+			for(int k=0;k<g->nBlocks;k++){
+				CfgBlock *b=&g->blocks[k];
+				if(b->cold)continue;
+				ProfileData *p=b->taken&&b->fall?b->last->prof:NULL;
+				CfgBlock *succ[2]={!p||p->taken?b->taken:NULL,!p||p->taken<p->count?b->fall:NULL};
+				for(int j=0;j<2;j++){
+					if(succ[j]&&succ[j]->cold){
+						succ[j]->cold=false;
+						again=true;
+						}
+					}
+				}
+			}
+		}
+	free(blockOf);
+	free(leader);
+	free(idx);
+	free(instrs);
+	return g;
+	}
+
+void cfgFree(Cfg *g){
+	free(g->blocks);
+	free(g);
+	}
+
+// the next block of a trace: the likely successor of b, or the other one if it was already placed
+static CfgBlock *traceNext(Cfg *g,CfgBlock *b,CfgBlock *end){
+	CfgBlock *likely=b->fall,*other=b->taken;
+	if(b->taken&&b->fall&&b->prob>0.5){
+		likely=b->taken;
+		other=b->fall;
+		}
+	if(!likely)likely=b->taken;
+	CfgBlock *r=likely&&!likely->placed?likely:other&&!other->placed?other:NULL;
+	// a trace does not continue from a hot block into a cold one and the last block remains the last one
+	if(!r||r==end||(r->cold&&!b->cold))return NULL;
+	// a JMP takes a join block (ex: after an if/else) from the block which falls into it only if it is executed more often
+	CfgBlock *prev=r->id>0?&g->blocks[r->id-1]:NULL;
+	if(!b->fall&&prev&&prev!=b&&prev->fall==r&&!prev->placed&&!prev->cold&&prev->freq>=b->freq)return NULL;
+	return r;
+	}
+
+bool cfgLayout(Cfg *g){
+	int nb=g->nBlocks;
+	CfgBlock **order=(CfgBlock**)safeAlloc(nb*sizeof(CfgBlock*));
+	int n=0;
+	// the last block must remain the last one if the execution can continue after it
+	CfgBlock *end=&g->blocks[nb-1];
+	if(endsFlow(end->last))end=NULL;
+	for(int pass=0;pass<2;pass++){
+		for(int k=0;k<nb;k++){
+			CfgBlock *b=&g->blocks[k];
+			if(b->placed||b==end||b->cold!=(pass==1))continue;
+			for(;b;b=traceNext(g,b,end)){
+				b->placed=true;
+				order[n++]=b;
+				}
+			}
+		}
+	if(end)order[n++]=end;
+	bool changed=false;
+	for(int k=0;k<nb;k++){
+		if(order[k]!=&g->blocks[k]){
+			changed=true;
+			optStats.blocksMoved++;
+			}
+		}
+	if(!changed){
+		free(order);
+		return false;
+		}
+	// relinks the code in the new order
+	for(int k=0;k<nb;k++){
+		CfgBlock *b=order[k];
+		CfgBlock *next=k+1<nb?order[k+1]:NULL;
+		Instr *last=b->last;
+		if(b->taken&&b->fall){
+			if(next!=b->fall){
+				if(next==b->taken){
+					last->op=negatedJump(last->op);
+					last->arg.instr=b->fall->first;
+					if(last->prof)last->prof=profileNew(last->prof->count,last->prof->count-last->prof->taken,0);
+					optStats.branchesFlipped++;
+					}else{
+					last=insertInstr(last,OP_JMP);
+					last->arg.instr=b->fall->first;
+					}
+				}
+			}else if(b->fall){
+			if(next!=b->fall){
+				last=insertInstr(last,OP_JMP);
+				last->arg.instr=b->fall->first;
+				}
+			}else if(last->op==OP_JMP&&next==b->taken){
+			last->op=OP_NOP;		// removed by delNops, which retargets the jumps to it
+			}
+		last->next=next?next->first:NULL;
+		}
+	free(order);
+	return true;
+	}
@@ -0,0 +1,48 @@
+#pragma once
+
+// control flow graph of the bytecode of a function and the code layout based on it
+// the code is split into basic blocks, which start at the jump targets and after the jumps and the instructions
+// which end the flow (RET, TAILCALL, HALT); the layout reorders the blocks so the likely successor of each block
+// follows it, using the profile (see profile.h) if it exists or static heuristics
+
+#include <stdbool.h>
+#include "ad.h"
+
+typedef struct CfgBlock CfgBlock;
+
+struct CfgBlock{		// a basic block
+	int id;		// its index in the original code order
+	Instr *first,*last;		// the first and the last instruction of the block
+	CfgBlock *taken;		// the target of the jump which ends the block, or NULL
+	CfgBlock *fall;		// the block executed after the last instruction if it does not jump, or NULL if it ends the flow
+	double prob;		// for a block which ends with a conditional jump, the probability that it jumps
+	double freq;		// the estimated number of executions for an execution of the function, counting each loop once
+	bool cold;		// true if the profile shows that the block was not executed, but its function was
+	bool placed;		// used by the layout
+	};
+
+typedef struct{		// the control flow graph of a function
+	Symbol *fn;
+	CfgBlock *blocks;		// in the code order, blocks[0] starts with ENTER
+	int nBlocks;
+	}Cfg;
+
+// builds the control flow graph of the function fn and estimates the probabilities of its conditional jumps:
+// from the profile, if the jump has counts, else with static heuristics (Ball and Larus):
+//		- a backward jump (a loop which continues) is taken with 88%
+//		- a jump which leaves the innermost loop of the block is taken with 12%
+//		- a successor which ends with a return is executed with 28%
+//		- else 50%, and the layout keeps the next block as the fall through one
+// the frequencies of the blocks are propagated from the entry on the forward edges
+Cfg *cfgBuild(Symbol *fn);
+
+// frees the graph (but not the instructions)
+void cfgFree(Cfg *g);
+
+// reorders the blocks in traces: a trace starts with the entry block or with the first block not placed yet
+// and continues with the likely successor of each block (or with the other one if the likely one was already placed)
+// the cold blocks are placed at the end
+// then the code is relinked in the new order: the conditional jumps whose target follows them are negated,
+// JMP is added where the next block is not the fall through one and the JMPs to the next block become NOPs
+// returns true if the code was changed
+bool cfgLayout(Cfg *g);
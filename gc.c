@@ -1,8 +1,16 @@
+#include <stddef.h>
+#include <limits.h>
+#include <stdlib.h>
 #include "gc.h"
+#include "lexer.h"
+#include "opt.h"
+
+bool boundsCheck=false;
 
 void insertConvIfNeeded(Instr *before,Type *srcType,Type *dstType){
 	switch(srcType->tb){
 		case TB_INT:
+		case TB_CHAR:
 			switch(dstType->tb){
 				case TB_DOUBLE:
 					insertInstr(before,OP_CONV_I_F);
@@ -12,6 +20,7 @@ void insertConvIfNeeded(Instr *before,Type *srcType,Type *dstType){
 		case TB_DOUBLE:
 			switch(dstType->tb){
 				case TB_INT:
+				case TB_CHAR:
 					insertInstr(before,OP_CONV_F_I);
 					break;
 				}
@@ -20,7 +29,8 @@ void insertConvIfNeeded(Instr *before,Type *srcType,Type *dstType){
 	}
 
 void addRVal(Instr **code,bool lval,Type *type){
-	if(!lval)return;
+	// the value of an array is its address
+	if(!lval||type->n>=0)return;
 	switch(type->tb){
 		case TB_INT:
 			addInstr(code,OP_LOAD_I);
@@ -28,5 +38,341 @@ void addRVal(Instr **code,bool lval,Type *type){
 		case TB_DOUBLE:
 			addInstr(code,OP_LOAD_F);
 			break;
+		case TB_CHAR:
+			addInstr(code,OP_LOAD_C);
+			break;
+		}
+	}
+
+void addIndex(Instr **code,Type *arrayType,Ret *idx){
+	Type elem=*arrayType;
+	elem.n=-1;
+	int size=typeSize(&elem);
+	bool check=boundsCheck&&arrayType->n>0;
+	if(idx->known&&(!check||(idx->val.i>=0&&idx->val.i<arrayType->n))&&
+			(long long)idx->val.i*size==idx->val.i*size){
+		// a constant index in bounds: its PUSH_I becomes the offset of the element
+		Instr *push=lastInstr(*code);
+		push->op=OP_OFFSET;
+		push->arg.i=idx->val.i*size;
+		return;
+		}
+	Instr *i=addInstrWithInt(code,check?OP_INDEX_CHK:OP_INDEX,size);
+	i->arg2=check?arrayType->n:0;
+	}
+
+// the VM pops the double values as float (popd), so all the double operations work with float operands
+static double vmd(double f){
+	return (float)f;
+	}
+
+// sets in r and in its PUSH instruction the value v of type tb
+static void setKnown(Instr *push,Ret *r,TypeBase tb,Val v){
+	r->type=(Type){tb,NULL,-1};
+	r->lval=false;
+	r->ct=true;
+	r->known=true;
+	r->val=v;
+	push->op=tb==TB_DOUBLE?OP_PUSH_D:OP_PUSH_I;
+	push->arg=v;
+	}
+
+void convIfNeeded(Instr *before,Ret *r,Type *dstType){
+	if(!r->known||dstType->n>=0){
+		insertConvIfNeeded(before,&r->type,dstType);
+		return;
+		}
+	Val v=r->val;
+	// the char values are kept as int on stack
+	if(r->type.tb==TB_DOUBLE&&dstType->tb!=TB_DOUBLE){
+		double f=vmd(v.f);
+		if(f<=(double)INT_MIN-1||f>=(double)INT_MAX+1){		// not representable, let the VM convert it
+			r->known=false;
+			insertConvIfNeeded(before,&r->type,dstType);
+			return;
+			}
+		v.i=(int)f;		// OP_CONV_F_I
+		}else if(r->type.tb!=TB_DOUBLE&&dstType->tb==TB_DOUBLE){
+		v.f=(double)v.i;		// OP_CONV_I_F
+		}
+	setKnown(before,r,dstType->tb,v);
+	}
+
+bool foldUnary(Instr *push,Ret *r,int op){
+	if(!r->known)return false;
+	Val v=r->val;
+	TypeBase tb=r->type.tb;
+	switch(op){
+		case SUB:
+			if(tb==TB_DOUBLE)v.f=-v.f;
+			else v.i=(int)(0u-(unsigned)v.i);
+			break;
+		case NOT:
+			v.i=tb==TB_DOUBLE?vmd(v.f)==0:v.i==0;
+			tb=TB_INT;
+			break;
+		default:return false;
+		}
+	setKnown(push,r,tb,v);
+	return true;
+	}
+
+bool foldBinary(Instr *leftPush,Ret *left,Ret *right,int op,Type *dst){
+	if(!left->known||!right->known)return false;
+	Val a=left->val,b=right->val,v;
+	TypeBase tb=dst->tb;
+	if(tb==TB_DOUBLE){
+		double x=vmd(a.f),y=vmd(b.f);
+		switch(op){
+			case ADD:v.f=x+y;break;
+			case SUB:v.f=x-y;break;
+			case MUL:v.f=x*y;break;
+			case DIV:v.f=x/y;break;
+			case LESS:v.i=x<y;tb=TB_INT;break;
+			case LESSEQ:v.i=x<=y;tb=TB_INT;break;
+			case GREATER:v.i=x>y;tb=TB_INT;break;
+			case GREATEREQ:v.i=x>=y;tb=TB_INT;break;
+			case EQUAL:v.i=x==y;tb=TB_INT;break;
+			case NOTEQ:v.i=x!=y;tb=TB_INT;break;
+			case AND:v.i=x!=0&&y!=0;tb=TB_INT;break;
+			case OR:v.i=x!=0||y!=0;tb=TB_INT;break;
+			default:return false;
+			}
+		}else{
+		int x=a.i,y=b.i;
+		switch(op){
+			// the int operations wrap around, as they do in the VM on all the usual targets
+			case ADD:v.i=(int)((unsigned)x+(unsigned)y);break;
+			case SUB:v.i=(int)((unsigned)x-(unsigned)y);break;
+			case MUL:v.i=(int)((unsigned)x*(unsigned)y);break;
+			case DIV:
+				// leave the runtime error/trap to the VM
+				if(y==0||(x==INT_MIN&&y==-1))return false;
+				v.i=x/y;		// C truncates towards 0, like OP_DIV_I
+				break;
+			case LESS:v.i=x<y;tb=TB_INT;break;
+			case LESSEQ:v.i=x<=y;tb=TB_INT;break;
+			case GREATER:v.i=x>y;tb=TB_INT;break;
+			case GREATEREQ:v.i=x>=y;tb=TB_INT;break;
+			case EQUAL:v.i=x==y;tb=TB_INT;break;
+			case NOTEQ:v.i=x!=y;tb=TB_INT;break;
+			case AND:v.i=x&&y;tb=TB_INT;break;
+			case OR:v.i=x||y;tb=TB_INT;break;
+			default:return false;
+			}
+		}
+	delInstrAfter(leftPush);
+	setKnown(leftPush,left,tb,v);
+	return true;
+	}
+
+// returns the compare and branch instruction which jumps when the comparison cmp is false
+// returns OP_JF if cmp is not a comparison
+static Opcode negatedBranch(Opcode cmp){
+	switch(cmp){
+		case OP_LESS_I:return OP_JGE_I;
+		case OP_LESSEQ_I:return OP_JGT_I;
+		case OP_GREATER_I:return OP_JLE_I;
+		case OP_GREATEREQ_I:return OP_JLT_I;
+		case OP_EQUAL_I:return OP_JNE_I;
+		case OP_NOTEQ_I:return OP_JEQ_I;
+		case OP_LESS_D:
+		case OP_LESS_F:return OP_JGE_D;
+		case OP_LESSEQ_F:return OP_JGT_D;
+		case OP_GREATER_F:return OP_JLE_D;
+		case OP_GREATEREQ_F:return OP_JLT_D;
+		case OP_EQUAL_F:return OP_JNE_D;
+		case OP_NOTEQ_F:return OP_JEQ_D;
+		default:return OP_JF;
+		}
+	}
+
+// returns the compare and branch instruction which jumps when the comparison cmp is true
+// returns OP_JF if cmp is not a comparison
+static Opcode directBranch(Opcode cmp){
+	switch(cmp){
+		case OP_LESS_I:return OP_JLT_I;
+		case OP_LESSEQ_I:return OP_JLE_I;
+		case OP_GREATER_I:return OP_JGT_I;
+		case OP_GREATEREQ_I:return OP_JGE_I;
+		case OP_EQUAL_I:return OP_JEQ_I;
+		case OP_NOTEQ_I:return OP_JNE_I;
+		case OP_LESS_D:
+		case OP_LESS_F:return OP_JLT_D;
+		case OP_LESSEQ_F:return OP_JLE_D;
+		case OP_GREATER_F:return OP_JGT_D;
+		case OP_GREATEREQ_F:return OP_JGE_D;
+		case OP_EQUAL_F:return OP_JEQ_D;
+		case OP_NOTEQ_F:return OP_JNE_D;
+		default:return OP_JF;
+		}
+	}
+
+// the int comparison which gives the opposite result
+// returns OP_NOP for the double comparisons, because with NaN both a<b and a>=b are false
+static Opcode negatedCompare(Opcode cmp){
+	switch(cmp){
+		case OP_LESS_I:return OP_GREATEREQ_I;
+		case OP_LESSEQ_I:return OP_GREATER_I;
+		case OP_GREATER_I:return OP_LESSEQ_I;
+		case OP_GREATEREQ_I:return OP_LESS_I;
+		case OP_EQUAL_I:return OP_NOTEQ_I;
+		case OP_NOTEQ_I:return OP_EQUAL_I;
+		default:return OP_NOP;
+		}
+	}
+
+// returns true if a is the start of the value of a short-circuit condition, which ends the code:
+// a: PUSH_I 1; JMP e; PUSH_I 0; e: NOP
+// (the values 1 and 0 are swapped by !)
+static bool isCondValue(Instr *a){
+	if(!a||a->op!=OP_PUSH_I||(a->arg.i!=0&&a->arg.i!=1))return false;
+	Instr *jmp=a->next;
+	if(!jmp||jmp->op!=OP_JMP)return false;
+	Instr *b=jmp->next;
+	if(!b||b->op!=OP_PUSH_I||b->arg.i!=!a->arg.i)return false;
+	Instr *e=b->next;
+	return e&&e->op==OP_NOP&&!e->next&&jmp->arg.instr==e;
+	}
+
+// returns the last 4 instructions from code in last[0..3]; the missing ones are NULL
+static void lastInstrs(Instr *code,Instr *last[4]){
+	last[0]=last[1]=last[2]=last[3]=NULL;
+	for(Instr *i=code;i;i=i->next){
+		last[0]=last[1];
+		last[1]=last[2];
+		last[2]=last[3];
+		last[3]=i;
+		}
+	}
+
+// the value of the short-circuit condition which starts with a is replaced by the jumps which it was made of
+// returns the list of jumps which are taken if the condition is onTrue
+static Instr *condValueJumps(Instr *code,Instr *a,bool onTrue){
+	Instr *jmp=a->next,*b=jmp->next;
+	bool aTaken=(a->arg.i!=0)==onTrue;
+	Instr *taken=aTaken?a:b,*jumps=NULL;
+	for(Instr *i=code;i;i=i->next){
+		if(isJump(i)&&i->arg.instr==taken){
+			i->arg.instr=jumps;
+			jumps=i;
+			}
+		}
+	if(aTaken){
+		// the code before a continues with the taken value, so it jumps and b becomes the target of the other jumps
+		a->op=OP_JMP;
+		a->arg.instr=jumps;
+		jumps=a;
+		a->next=b;
+		free(jmp);
+		b->op=OP_NOP;
+		delInstrAfter(b);
+		}else{
+		// the code before a continues with the value which is not taken
+		a->op=OP_NOP;
+		delInstrAfter(a);
+		}
+	return jumps;
+	}
+
+// adds at the end of code the jumps which are taken if the condition computed by code is onTrue
+static Instr *condJumps(Instr **code,bool onTrue){
+	Instr *last[4];
+	lastInstrs(*code,last);
+	if(isCondValue(last[0]))return condValueJumps(*code,last[0],onTrue);
+	Instr *prev=last[2],*cmp=last[3];
+	Opcode br=onTrue?directBranch(cmp->op):negatedBranch(cmp->op);
+	if(br==OP_JF){
+		Instr *jump=addInstr(code,onTrue?OP_JT:OP_JF);
+		jump->arg.instr=NULL;
+		return jump;
+		}
+	Opcode brImm=immediateBranch(br);
+	// a PUSH_I before the comparison is always its whole right operand
+	if(brImm!=OP_JF&&prev&&prev->op==OP_PUSH_I){
+		prev->op=brImm;
+		prev->arg2=prev->arg.i;
+		prev->arg.instr=NULL;
+		delInstrAfter(prev);
+		return prev;
+		}
+	cmp->op=br;
+	cmp->arg.instr=NULL;
+	return cmp;
+	}
+
+Instr *addCondJumps(Instr **code,Ret *r,bool onTrue){
+	addRVal(code,r->lval,&r->type);
+	if(r->type.tb==TB_DOUBLE){
+		addInstrWithDouble(code,OP_PUSH_D,0.0);
+		addInstr(code,OP_NOTEQ_F);
+		}
+	return condJumps(code,onTrue);
+	}
+
+Instr *insertCondJump(Instr *push,Ret *r,bool onTrue){
+	bool v=r->type.tb==TB_DOUBLE?vmd(r->val.f)!=0:r->val.i!=0;
+	setKnown(push,r,TB_INT,(Val){.i=v});
+	Instr *jump=insertInstr(push,onTrue?OP_JT:OP_JF);
+	jump->arg.instr=NULL;
+	return jump;
+	}
+
+Instr *joinJumps(Instr *jumps,Instr *other){
+	if(!jumps)return other;
+	Instr *last=jumps;
+	while(last->arg.instr)last=last->arg.instr;
+	last->arg.instr=other;
+	return jumps;
+	}
+
+void patchJumps(Instr *jumps,Instr *target){
+	while(jumps){
+		Instr *next=jumps->arg.instr;
+		jumps->arg.instr=target;
+		jumps=next;
+		}
+	}
+
+void addCondValue(Instr **code,Instr *trueJumps,Instr *falseJumps){
+	Instr *t=addInstrWithInt(code,OP_PUSH_I,1);
+	Instr *jmp=addInstr(code,OP_JMP);
+	Instr *f=addInstrWithInt(code,OP_PUSH_I,0);
+	jmp->arg.instr=addInstr(code,OP_NOP);
+	patchJumps(trueJumps,t);
+	patchJumps(falseJumps,f);
+	}
+
+void addNeg(Instr **code,Ret *r){
+	addRVal(code,r->lval,&r->type);
+	if(r->type.tb==TB_DOUBLE){
+		addInstrWithDouble(code,OP_PUSH_D,-1.0);
+		addInstr(code,OP_MUL_F);
+		*r=(Ret){.type={TB_DOUBLE,NULL,-1},.ct=true};
+		}else{
+		// -x wraps like 0-x: the peephole optimizer makes it MULC.i -1
+		addInstrWithInt(code,OP_PUSH_I,-1);
+		addInstr(code,OP_MUL_I);
+		*r=(Ret){.type={TB_INT,NULL,-1},.ct=true};
+		}
+	}
+
+void addNot(Instr **code,Ret *r){
+	addRVal(code,r->lval,&r->type);
+	Instr *last[4];
+	lastInstrs(*code,last);
+	Opcode cmp=negatedCompare(last[3]->op);
+	if(isCondValue(last[0])){
+		last[0]->arg.i=!last[0]->arg.i;
+		last[2]->arg.i=!last[2]->arg.i;
+		}else if(cmp!=OP_NOP){
+		last[3]->op=cmp;
+		}else if(r->type.tb==TB_DOUBLE){
+		addInstrWithDouble(code,OP_PUSH_D,0.0);
+		addInstr(code,OP_EQUAL_F);
+		}else{
+		addInstrWithInt(code,OP_PUSH_I,0);
+		addInstr(code,OP_EQUAL_I);
 		}
+	*r=(Ret){.type={TB_INT,NULL,-1},.lval=false,.ct=true};
 	}
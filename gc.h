@@ -10,4 +10,60 @@
 void insertConvIfNeeded(Instr *before,Type *srcType,Type *dstType);
 
 // if lval is true, generates an rval from the current value from stack
+// an array remains its address
 void addRVal(Instr **code,bool lval,Type *type);
+
+// if true, the indexes of the arrays with a known dimension are checked at runtime (atomc -bounds-check)
+extern bool boundsCheck;
+
+// adds at the end of code the address of an element of an array of type arrayType
+// the address of the array and the index idx (an int rval) must be on stack
+// generates INDEX or, if boundsCheck is set, INDEX_CHK; a constant index in bounds becomes an OFFSET
+void addIndex(Instr **code,Type *arrayType,Ret *idx);
+
+// like insertConvIfNeeded, but if r is known at compile time
+// its PUSH instruction (which must be "before") and its value are converted in place
+void convIfNeeded(Instr *before,Ret *r,Type *dstType);
+
+// if r is known at compile time, computes the unary operation op (SUB or NOT)
+// in its PUSH instruction (which must be "push") and returns true
+bool foldUnary(Instr *push,Ret *r,int op);
+
+// if both operands are known at compile time and already converted to dst,
+// computes the binary operation op (a token code: ADD, MUL, LESS, AND, ...),
+// replaces their two PUSH instructions with a single one (leftPush) and sets the result in left
+// the computation follows exactly the VM semantics (int wrapping, doubles rounded to float on pop)
+// returns false if the operation cannot be computed at compile time (ex: division by 0)
+bool foldBinary(Instr *leftPush,Ret *left,Ret *right,int op,Type *dst);
+
+// the conditions are compiled into lists of jumps with targets which are set later
+// the jumps from a list are linked by their arg.instr, with NULL at the end
+
+// adds at the end of code the jumps which are taken if the condition r, computed by code, is onTrue
+// a double condition is compared with 0.0
+// if the condition ends with a comparison, it is fused with the jump into a single
+// compare and branch instruction (JGE_I for <, ...), with an immediate operand if it is compared with a constant
+// if the condition is the value of a short-circuit condition (&&, ||), this value is replaced by the jumps it was made of
+// returns the list of the jumps
+Instr *addCondJumps(Instr **code,Ret *r,bool onTrue);
+
+// like addCondJumps, for a condition known at compile time, which must be the instruction "push"
+// its value becomes 0 or 1 and it is followed by a JT or JF
+Instr *insertCondJump(Instr *push,Ret *r,bool onTrue);
+
+// returns the list of jumps "jumps" followed by the list "other"
+Instr *joinJumps(Instr *jumps,Instr *other);
+
+// sets the target of all the jumps from list
+void patchJumps(Instr *jumps,Instr *target);
+
+// adds at the end of code the int value of a short-circuit condition:
+// 1 if the code continues or trueJumps are taken, 0 if falseJumps are taken
+void addCondValue(Instr **code,Instr *trueJumps,Instr *falseJumps);
+
+// adds at the end of code the arithmetic negation (unary -) of r, which is not known at compile time
+void addNeg(Instr **code,Ret *r);
+
+// adds at the end of code the negation (!) of r, which is not known at compile time
+// the value of a short-circuit condition or an int comparison is negated in place
+void addNot(Instr **code,Ret *r);
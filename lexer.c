@@ -38,6 +38,8 @@ char *extract(const char *begin,const char *end){
 Token *tokenize(const char *pch){
 	const char *start;
 	Token *tk;
+	tokens=lastTk=NULL;
+	line=1;
 	for(;;){
 		switch(*pch){
 			case ' ':case '\t':pch++;break;
@@ -35,5 +35,7 @@ typedef struct Token{
 	struct Token *next;		// next token in a simple linked list
 	}Token;
 
+// returns the tokens of the given text, in a new list
+// the tokens of the previous texts are not freed, because the symbols point to their texts
 Token *tokenize(const char *pch);
 void showTokens(const Token *tokens);
@@ -0,0 +1,530 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+#include "lexer.h"
+#include "parser.h"
+#include "at.h"
+#include "opt.h"
+#include "link.h"
+
+#define OBJECT_VERSION 1
+
+Instr **linkCalls;
+Symbol **linkCallers;
+int nLinkCalls;
+static int capLinkCalls;
+
+Module *moduleCompile(const char *fileName){
+	Domain *d=symTable;
+	Symbol *last=d->symbols;		// the last extern function
+	while(last&&last->next)last=last->next;
+	char *inbuf=loadFile(fileName);
+	puts(inbuf);
+	Token *tokens=tokenize(inbuf);
+	showTokens(tokens);
+	parse(tokens);
+	free(inbuf);
+	Module *m=(Module*)safeAlloc(sizeof(Module));
+	m->fileName=fileName;
+	if(last){
+		m->symbols=last->next;
+		last->next=NULL;
+		}else{
+		m->symbols=d->symbols;
+		d->symbols=NULL;
+		}
+	m->constSize=constSize;
+	m->consts=(char*)safeAlloc(constSize?constSize:1);
+	if(constSize)memcpy(m->consts,constString(0),constSize);
+	constFree();
+	dataSize=0;
+	return m;
+	}
+
+bool isObjectFile(const char *fileName){
+	size_t n=strlen(fileName);
+	return n>3&&!strcmp(fileName+n-3,".ao");
+	}
+
+static void writeType(FILE *fis,Type *t){
+	switch(t->tb){
+		case TB_INT:fputs("int",fis);break;
+		case TB_DOUBLE:fputs("double",fis);break;
+		case TB_CHAR:fputs("char",fis);break;
+		case TB_VOID:fputs("void",fis);break;
+		default:fprintf(fis,"struct:%s",t->s->name);		// TB_STRUCT
+		}
+	if(t->n==0)fputs("[]",fis);
+	else if(t->n>0)fprintf(fis,"[%d]",t->n);
+	}
+
+// the function of the module which starts with the given instruction
+static Symbol *moduleFn(Module *m,Instr *enter){
+	for(Symbol *s=m->symbols;s;s=s->next){
+		if(s->kind==SK_FN&&s->fn.instr==enter)return s;
+		}
+	err("the module %s calls a function which is not in it",m->fileName);
+	}
+
+static void writeFn(FILE *fis,Module *m,Symbol *fn){
+	int n=0;
+	if(!fn->fn.imported){
+		for(Instr *i=fn->fn.instr;i;i=i->next)n++;
+		}
+	fprintf(fis,"fn %s ",fn->name);
+	writeType(fis,&fn->type);
+	fprintf(fis," %d %d %d\n",symbolsLen(fn->fn.params),symbolsLen(fn->fn.locals),n);
+	for(Symbol *p=fn->fn.params;p;p=p->next){
+		fprintf(fis,"param %s ",p->name);
+		writeType(fis,&p->type);
+		fputc('\n',fis);
+		}
+	for(Symbol *l=fn->fn.locals;l;l=l->next){
+		fprintf(fis,"local %s ",l->name);
+		writeType(fis,&l->type);
+		fputc('\n',fis);
+		}
+	if(!n)return;
+	Instr **v=(Instr**)safeAlloc(n*sizeof(Instr*));
+	n=0;
+	for(Instr *i=fn->fn.instr;i;i=i->next)v[n++]=i;
+	for(int k=0;k<n;k++){
+		Instr *i=v[k];
+		fprintf(fis,"i %d ",i->op);
+		if(isJump(i)){
+			int t;
+			for(t=0;t<n&&v[t]!=i->arg.instr;t++){}
+			fprintf(fis,"%d",t);
+			}else if(i->op==OP_CALL||i->op==OP_TAILCALL){
+			fputs(moduleFn(m,i->arg.instr)->name,fis);
+			}else if(i->op==OP_CALL_EXT){
+			fputs(findFn(i)->name,fis);
+			}else if(i->op==OP_PUSH_D){
+			fprintf(fis,"%a",i->arg.f);
+			}else{
+			fprintf(fis,"%d",i->arg.i);
+			}
+		fprintf(fis," %d\n",i->arg2);
+		}
+	free(v);
+	}
+
+void moduleWrite(Module *m,const char *fileName){
+	FILE *fis=fopen(fileName,"w");
+	if(!fis)err("cannot write the object file %s",fileName);
+	fprintf(fis,"atomc-object %d %d\n",OBJECT_VERSION,OP_COUNT);
+	for(Symbol *s=m->symbols;s;s=s->next){
+		switch(s->kind){
+			case SK_STRUCT:
+				fprintf(fis,"struct %s %d\n",s->name,symbolsLen(s->structMembers));
+				for(Symbol *mb=s->structMembers;mb;mb=mb->next){
+					fprintf(fis,"member %s ",mb->name);
+					writeType(fis,&mb->type);
+					fputc('\n',fis);
+					}
+				break;
+			case SK_VAR:
+				fprintf(fis,"var %s ",s->name);
+				writeType(fis,&s->type);
+				fprintf(fis," %d\n",s->dataOffset);
+				break;
+			case SK_FN:
+				writeFn(fis,m,s);
+				break;
+			default:break;
+			}
+		}
+	for(int k=0;k<m->constSize;){
+		fputs("const ",fis);
+		do{
+			fprintf(fis,"%02x",(unsigned char)m->consts[k]);
+			}while(m->consts[k++]);
+		fputc('\n',fis);
+		}
+	fclose(fis);
+	}
+
+// the object file which is read and its current line
+static FILE *objFis;
+static const char *objName;
+static char *objLine;
+static int objCap;
+
+static noreturn void objErr(){
+	err("invalid object file %s: %s",objName,objLine?objLine:"");
+	}
+
+// reads the next line, without its newline
+// returns false at the end of the file
+static bool readLine(){
+	size_t n=0;
+	int c;
+	while((c=fgetc(objFis))!=EOF&&c!='\n'){
+		objLine=(char*)growArray(objLine,&objCap,(int)n+2,256,1);
+		objLine[n++]=(char)c;
+		}
+	if(c==EOF&&!n)return false;
+	if(n&&objLine[n-1]=='\r')n--;
+	objLine[n]='\0';
+	return true;
+	}
+
+static char *dupName(const char *name){
+	char *s=(char*)safeAlloc(strlen(name)+1);
+	strcpy(s,name);
+	return s;
+	}
+
+static Type readType(Module *m,const char *text){
+	Type t={TB_INT,NULL,-1};
+	const char *dim=strchr(text,'[');
+	size_t len=dim?(size_t)(dim-text):strlen(text);
+	if(len==3&&!strncmp(text,"int",3))t.tb=TB_INT;
+	else if(len==6&&!strncmp(text,"double",6))t.tb=TB_DOUBLE;
+	else if(len==4&&!strncmp(text,"char",4))t.tb=TB_CHAR;
+	else if(len==4&&!strncmp(text,"void",4))t.tb=TB_VOID;
+	else if(len>7&&!strncmp(text,"struct:",7)){
+		t.tb=TB_STRUCT;
+		for(t.s=m->symbols;t.s;t.s=t.s->next){
+			if(t.s->kind==SK_STRUCT&&strlen(t.s->name)==len-7&&!strncmp(t.s->name,text+7,len-7))break;
+			}
+		if(!t.s)objErr();
+		}else objErr();
+	if(dim){
+		if(!strcmp(dim,"[]"))t.n=0;
+		else if(sscanf(dim,"[%d]",&t.n)!=1||t.n<1)objErr();
+		}
+	return t;
+	}
+
+static void readFn(Module *m){
+	char name[256],type[256];
+	int nParams,nLocals,nInstr;
+	if(sscanf(objLine,"fn %255s %255s %d %d %d",name,type,&nParams,&nLocals,&nInstr)!=5)objErr();
+	if(nParams<0||nLocals<0||nInstr<0)objErr();
+	Symbol *fn=newSymbol(dupName(name),SK_FN);
+	fn->type=readType(m,type);
+	// it is added before its code, which can call it
+	addSymbolToList(&m->symbols,fn);
+	for(int k=0;k<nParams;k++){
+		if(!readLine()||sscanf(objLine,"param %255s %255s",name,type)!=2)objErr();
+		Symbol *p=newSymbol(dupName(name),SK_PARAM);
+		p->type=readType(m,type);
+		p->owner=fn;
+		p->paramIdx=k;
+		addSymbolToList(&fn->fn.params,p);
+		}
+	for(int k=0;k<nLocals;k++){
+		if(!readLine()||sscanf(objLine,"local %255s %255s",name,type)!=2)objErr();
+		Symbol *l=newSymbol(dupName(name),SK_VAR);
+		l->type=readType(m,type);
+		l->owner=fn;
+		l->varIdx=localsSlots(fn->fn.locals);
+		addSymbolToList(&fn->fn.locals,l);
+		}
+	if(!nInstr){
+		fn->fn.imported=true;
+		Instr *enter=addInstr(&fn->fn.instr,OP_ENTER);
+		enter->arg.i=0;
+		enter->arg2=nParams;
+		return;
+		}
+	Instr **v=(Instr**)safeAlloc(nInstr*sizeof(Instr*));
+	for(int k=0;k<nInstr;k++){
+		int op,arg2;
+		char arg[256];
+		if(!readLine()||sscanf(objLine,"i %d %255s %d",&op,arg,&arg2)!=3||op<0||op>=OP_COUNT)objErr();
+		Instr *i=k?insertInstr(v[k-1],op):addInstr(&fn->fn.instr,op);
+		v[k]=i;
+		i->arg2=arg2;
+		if(op==OP_CALL||op==OP_TAILCALL){
+			Symbol *callee=findSymbolInList(m->symbols,arg);
+			if(!callee||callee->kind!=SK_FN)objErr();
+			i->arg.instr=callee==fn?NULL:callee->fn.instr;		// the recursive calls are set after ENTER exists
+			}else if(op==OP_CALL_EXT){
+			Symbol *callee=findSymbolInDomain(symTable,arg);
+			if(!callee||callee->kind!=SK_FN||!callee->fn.extFnPtr)objErr();
+			i->arg.extFnPtr=callee->fn.extFnPtr;
+			}else if(op==OP_PUSH_D){
+			i->arg.f=strtod(arg,NULL);
+			}else{
+			i->arg.i=atoi(arg);
+			}
+		}
+	if(v[0]->op!=OP_ENTER)objErr();
+	for(int k=0;k<nInstr;k++){
+		Instr *i=v[k];
+		if(isJump(i)){
+			if(i->arg.i<0||i->arg.i>=nInstr)objErr();
+			i->arg.instr=v[i->arg.i];
+			}else if((i->op==OP_CALL||i->op==OP_TAILCALL)&&!i->arg.instr){
+			i->arg.instr=fn->fn.instr;
+			}
+		}
+	free(v);
+	}
+
+Module *moduleRead(const char *fileName){
+	objFis=fopen(fileName,"r");
+	if(!objFis)err("cannot open the object file %s",fileName);
+	objName=fileName;
+	int version,nOps;
+	if(!readLine()||sscanf(objLine,"atomc-object %d %d",&version,&nOps)!=2||version!=OBJECT_VERSION||nOps!=OP_COUNT){
+		err("%s is not an object file of this version of atomc",fileName);
+		}
+	Module *m=(Module*)safeAlloc(sizeof(Module));
+	m->fileName=fileName;
+	m->symbols=NULL;
+	m->consts=NULL;
+	m->constSize=0;
+	int capConsts=0;
+	char kind[16],name[256],type[256];
+	while(readLine()){
+		if(sscanf(objLine,"%15s",kind)!=1)continue;
+		if(!strcmp(kind,"struct")){
+			int n;
+			if(sscanf(objLine,"struct %255s %d",name,&n)!=2||n<0)objErr();
+			Symbol *s=newSymbol(dupName(name),SK_STRUCT);
+			s->type=(Type){TB_STRUCT,s,-1};
+			addSymbolToList(&m->symbols,s);
+			for(int k=0;k<n;k++){
+				if(!readLine()||sscanf(objLine,"member %255s %255s",name,type)!=2)objErr();
+				Symbol *mb=newSymbol(dupName(name),SK_VAR);
+				mb->type=readType(m,type);
+				mb->owner=s;
+				mb->varIdx=typeSize(&s->type);
+				addSymbolToList(&s->structMembers,mb);
+				}
+			}else if(!strcmp(kind,"var")){
+			int offset;
+			if(sscanf(objLine,"var %255s %255s %d",name,type,&offset)!=3||offset<0)objErr();
+			Symbol *s=newSymbol(dupName(name),SK_VAR);
+			s->type=readType(m,type);
+			s->dataOffset=offset;
+			addSymbolToList(&m->symbols,s);
+			}else if(!strcmp(kind,"const")){
+			const char *hex=objLine+5;
+			while(*hex==' ')hex++;
+			size_t n=strlen(hex);
+			if(!n||n%2)objErr();
+			m->consts=(char*)growArray(m->consts,&capConsts,m->constSize+(int)n/2,256,1);
+			for(size_t k=0;k<n;k+=2){
+				unsigned b;
+				if(sscanf(hex+k,"%2x",&b)!=1)objErr();
+				m->consts[m->constSize++]=(char)b;
+				}
+			if(m->consts[m->constSize-1])objErr();
+			}else if(!strcmp(kind,"fn")){
+			readFn(m);
+			}else objErr();
+		}
+	fclose(objFis);
+	return m;
+	}
+
+typedef struct{		// a global variable of a module
+	int offset;		// its offset in the data segment of the module
+	Symbol *var;		// the linked variable
+	}LinkVar;
+
+typedef struct{		// the ENTER of a prototype, which is the target of the calls of an imported function
+	Instr *enter;
+	Symbol *fn;		// the linked function
+	}LinkStub;
+
+static LinkStub *stubs;
+static int nStubs,capStubs;
+
+static void addStub(Instr *enter,Symbol *fn){
+	stubs=(LinkStub*)growArray(stubs,&capStubs,nStubs+1,16,sizeof(LinkStub));
+	stubs[nStubs++]=(LinkStub){enter,fn};
+	}
+
+static void addLinkCall(Symbol *caller,Instr *call){
+	int cap=capLinkCalls;		// linkCallers grows with linkCalls
+	linkCalls=(Instr**)growArray(linkCalls,&capLinkCalls,nLinkCalls+1,16,sizeof(Instr*));
+	linkCallers=(Symbol**)growArray(linkCallers,&cap,nLinkCalls+1,16,sizeof(Symbol*));
+	linkCalls[nLinkCalls]=call;
+	linkCallers[nLinkCalls++]=caller;
+	}
+
+// the structs with the same name must have the same members, with the same types
+static bool sameMembers(Symbol *s1,Symbol *s2){
+	Symbol *m1=s1->structMembers,*m2=s2->structMembers;
+	for(;m1&&m2;m1=m1->next,m2=m2->next){
+		if(strcmp(m1->name,m2->name)||!sameType(&m1->type,&m2->type))return false;
+		}
+	return !m1&&!m2;
+	}
+
+// a struct type is changed to the linked struct with the same name
+static void linkType(Type *t){
+	if(t->tb==TB_STRUCT)t->s=findSymbolInDomain(symTable,t->s->name);
+	}
+
+static void linkTypes(Symbol *s){
+	switch(s->kind){
+		case SK_STRUCT:		// its own type is not changed
+			for(Symbol *mb=s->structMembers;mb;mb=mb->next)linkType(&mb->type);
+			break;
+		case SK_FN:
+			linkType(&s->type);
+			for(Symbol *p=s->fn.params;p;p=p->next)linkType(&p->type);
+			for(Symbol *l=s->fn.locals;l;l=l->next)linkType(&l->type);
+			break;
+		default:
+			linkType(&s->type);
+		}
+	}
+
+static int cmpLinkVars(const void *a,const void *b){
+	return ((const LinkVar*)a)->offset-((const LinkVar*)b)->offset;
+	}
+
+// the variable whose range from the data segment of the module contains offset, from vars sorted by offsets
+// an offset after the end of a variable (ex: a constant index out of bounds) belongs to it
+static LinkVar *linkVarAt(LinkVar *vars,int nVars,int offset){
+	int lo=0,hi=nVars-1;
+	while(lo<hi){
+		int mid=(lo+hi+1)/2;
+		if(vars[mid].offset<=offset)lo=mid;
+		else hi=mid-1;
+		}
+	return &vars[lo];
+	}
+
+// moves ADDR and CADDR from the code of fn, which are offsets in the module m, in the data segment and in the constant pool
+// of the program; the string literals are interned, so the identical literals from all the modules are stored once
+static void relocate(Symbol *fn,Module *m,LinkVar *vars,int nVars){
+	for(Instr *i=fn->fn.instr;i;i=i->next){
+		if(i->op==OP_ADDR){
+			if(!nVars)err("invalid code in %s: a global variable is used, but the module has none",m->fileName);
+			LinkVar *v=linkVarAt(vars,nVars,i->arg.i);
+			i->arg.i+=v->var->dataOffset-v->offset;
+			}else if(i->op==OP_CADDR){
+			int offset=i->arg.i;
+			if(offset<0||offset>=m->constSize)err("invalid code in %s: a string literal is not in the constant pool",m->fileName);
+			int start=offset;
+			while(start>0&&m->consts[start-1])start--;
+			i->arg.i=constIntern(m->consts+start)+offset-start;
+			}
+		}
+	}
+
+// replaces the symbol old from the global domain with s
+static void replaceSymbol(Symbol *old,Symbol *s){
+	for(Symbol **ps=&symTable->symbols;*ps;ps=&(*ps)->next){
+		if(*ps==old){
+			s->next=old->next;
+			*ps=s;
+			return;
+			}
+		}
+	}
+
+void linkModules(Module **modules,int nModules){
+	Domain *d=symTable;
+	Symbol *dropped=NULL;		// the symbols which were merged with the ones from the previous modules
+	for(int k=0;k<nModules;k++){
+		Module *m=modules[k];
+		int n=0;
+		for(Symbol *s=m->symbols;s;s=s->next)n++;
+		LinkVar *vars=(LinkVar*)safeAlloc((n?n:1)*sizeof(LinkVar));
+		Symbol **fns=(Symbol**)safeAlloc((n?n:1)*sizeof(Symbol*));		// the functions defined in m
+		int nVars=0,nFns=0;
+		for(Symbol *s=m->symbols,*next;s;s=next){
+			next=s->next;
+			s->next=NULL;
+			linkTypes(s);
+			Symbol *old=findSymbolInDomain(d,s->name);
+			if(!old){
+				if(s->kind==SK_VAR){
+					vars[nVars++]=(LinkVar){s->dataOffset,s};
+					s->dataOffset=dataAlloc(typeSize(&s->type),typeAlign(&s->type));
+					}else if(s->kind==SK_FN){
+					if(s->fn.imported)addStub(s->fn.instr,s);
+					else fns[nFns++]=s;
+					}
+				addSymbolToDomain(d,s);
+				continue;
+				}
+			switch(s->kind){
+				case SK_STRUCT:
+					if(old->kind!=SK_STRUCT||!sameMembers(old,s)){
+						err("struct %s from %s is different from the one from the other modules",s->name,m->fileName);
+						}
+					break;
+				case SK_VAR:
+					if(old->kind!=SK_VAR||!sameType(&old->type,&s->type)){
+						err("the global variable %s from %s has a different type in the other modules",s->name,m->fileName);
+						}
+					vars[nVars++]=(LinkVar){s->dataOffset,old};
+					break;
+				case SK_FN:
+					if(old->kind!=SK_FN||old->fn.extFnPtr)err("%s from %s is already defined",s->name,m->fileName);
+					if(!sameType(&old->type,&s->type)||!sameParams(old->fn.params,s->fn.params)){
+						err("the function %s from %s has a different signature in the other modules",s->name,m->fileName);
+						}
+					if(s->fn.imported){
+						addStub(s->fn.instr,old);
+						break;
+						}
+					if(!old->fn.imported)err("the function %s from %s is also defined in another module",s->name,m->fileName);
+					// the prototype from a previous module is replaced by the definition
+					for(int j=0;j<nStubs;j++){
+						if(stubs[j].fn==old)stubs[j].fn=s;
+						}
+					replaceSymbol(old,s);
+					fns[nFns++]=s;
+					s=old;
+					break;
+				default:break;
+				}
+			s->next=dropped;
+			dropped=s;
+			}
+		qsort(vars,nVars,sizeof(LinkVar),cmpLinkVars);
+		for(int j=0;j<nFns;j++)relocate(fns[j],m,vars,nVars);
+		free(vars);
+		free(fns);
+		free(m->consts);
+		free(m);
+		}
+	// the calls of the prototypes are resolved to the definitions
+	for(Symbol *s=d->symbols;s;s=s->next){
+		if(s->kind!=SK_FN||s->fn.extFnPtr||s->fn.imported)continue;
+		for(Instr *i=s->fn.instr;i;i=i->next){
+			if(i->op!=OP_CALL&&i->op!=OP_TAILCALL)continue;
+			int j;
+			for(j=0;j<nStubs&&stubs[j].enter!=i->arg.instr;j++){}
+			if(j==nStubs)continue;
+			Symbol *fn=stubs[j].fn;
+			if(fn->fn.imported)err("undefined function %s, called from %s",fn->name,s->name);
+			i->arg.instr=fn->fn.instr;
+			addLinkCall(s,i);
+			optStats.importedCalls++;
+			}
+		}
+	// the prototypes which are not defined and are not called are removed
+	for(Symbol **ps=&d->symbols;*ps;){
+		Symbol *s=*ps;
+		if(s->kind==SK_FN&&s->fn.imported){
+			*ps=s->next;
+			s->next=dropped;
+			dropped=s;
+			}else{
+			ps=&s->next;
+			}
+		}
+	for(int j=0;j<nStubs;j++)free(stubs[j].enter);
+	free(stubs);
+	stubs=NULL;
+	nStubs=capStubs=0;
+	for(Symbol *next;dropped;dropped=next){
+		next=dropped->next;
+		freeSymbol(dropped);
+		}
+	optStats.modules=nModules;
+	}
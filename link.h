@@ -0,0 +1,60 @@
+#pragma once
+
+// separate compilation and linking of the modules
+// a module is a source file which is compiled and optimized without the other modules
+// it imports a function defined in another module with a prototype, a function header without body:
+//		int fact(int n);
+// and it exports all its functions and global variables
+// the global variables with the same name from different modules are a single variable (like the common symbols of C),
+// so they must have the same type; the structs with the same name must have the same members
+// with atomc -c file.c, the module is written in a relocatable bytecode object (file.ao), in which ADDR and CADDR
+// have offsets in the data segment and in the constant pool of the module and the calls have the callee's name
+// atomc a.c b.ao ... links the modules: the global variables are allocated in the data segment of the program,
+// the string literals are interned in its constant pool and the calls of the imported functions are resolved
+// to their definitions; then the whole program is optimized (see linkOptimize in opt.h)
+//
+// the object file is a text file, with a record per line:
+//		atomc-object version nOpcodes - the header; the opcodes are written as numbers, so nOpcodes must be OP_COUNT
+//		struct name nMembers - a struct, followed by nMembers records "member name type"
+//		var name type offset - a global variable, at the given offset in the data segment of the module
+//		const hex - a string literal with its terminator, in hex; the literals are in the order of their offsets
+//		fn name type nParams nLocals nInstr - a function, followed by its parameters ("param name type"),
+//			its local variables ("local name type") and its instructions; nInstr is 0 for a prototype
+//		i op arg arg2 - an instruction; arg is the callee's name for CALL, TAILCALL and CALL_EXT,
+//			the index of the target instruction for the jumps, a hex float for PUSH_D and an int for the others
+// the types are written like "int", "double[10]", "char[]" or "struct:Point"
+
+#include <stdbool.h>
+#include "ad.h"
+
+typedef struct{		// a compiled module
+	const char *fileName;		// the source or the object file
+	Symbol *symbols;		// the structs, the global variables and the functions, in the order of their definitions
+	char *consts;		// the constant pool of the module
+	int constSize;
+	}Module;
+
+// the calls of the imported functions resolved by linkModules: linkCalls[k] is a call from linkCallers[k]
+extern Instr **linkCalls;
+extern Symbol **linkCallers;
+extern int nLinkCalls;
+
+// compiles the source file into a module
+// the global domain must contain only the extern functions: the symbols of the module are moved from it
+// into the module, and the data segment and the constant pool are emptied for the next module
+Module *moduleCompile(const char *fileName);
+
+// writes the module in an object file
+void moduleWrite(Module *m,const char *fileName);
+
+// reads a module from an object file
+// on error, prints a message and exit the program
+Module *moduleRead(const char *fileName);
+
+// returns true if the file name has the extension of the object files (.ao)
+bool isObjectFile(const char *fileName);
+
+// links the modules into the global domain and frees them
+// on error (a function which is not defined or is defined in more modules, a symbol with different types),
+// prints a message and exit the program
+void linkModules(Module **modules,int nModules);
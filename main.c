@@ -1,36 +1,154 @@
 #include<stdio.h>
 #include<stdlib.h>
 #include<string.h>
+#include<time.h>
 #include"lexer.h"
 #include"utils.h"
 #include"parser.h"
 #include"ad.h"
 #include"vm.h"
+#include"opt.h"
+#include"ssa.h"
+#include"gc.h"
+#include"profile.h"
+#include"memo.h"
+#include"link.h"
+#include"regvm.h"
 
-int main()
+// the name of the object file of a source file: file.c -> file.ao
+static char *objectName(const char *fileName){
+    const char *ext=strrchr(fileName,'.');
+    size_t n=ext&&!strchr(ext,'/')?(size_t)(ext-fileName):strlen(fileName);
+    char *name=(char*)safeAlloc(n+4);
+    memcpy(name,fileName,n);
+    strcpy(name+n,".ao");
+    return name;
+}
+
+// usage: atomc [-O0|-O1|-O2] [-inline=n] [-specialize=n] [-unroll=n] [-vectorize=0] [-soa] [-ssa] [-dump-ssa] [-bounds-check] [-profile-gen=file] [-profile-use=file] [-memo[=n]] [-vm=stack|reg] [-stats] [-c] [-o=file] [file.c|file.ao]...
+//		the source files (file.c) and the object files (file.ao) are modules, which are linked in a program (see link.h)
+//		-O0, -O1, -O2 - the optimization level (default -O2)
+//		-inline=n - the maximum number of instructions of an inlined function (default 16, 0 disables the inlining)
+//		-specialize=n - the maximum number of copies of a function specialized for constant arguments (default 4, 0 disables them)
+//		-unroll=n - the unroll factor of the counted loops (default 4, 0 disables the unrolling)
+//		-vectorize=0 - disables the vectorization of the loops
+//		-soa - stores the global struct arrays as an array for each field, if they are accessed only through their fields
+//		-ssa - optimizes the functions also in SSA form
+//		-dump-ssa - like -ssa, and shows the SSA form of the functions after each pass
+//		-bounds-check - checks at runtime the indexes of the arrays with a known dimension
+//		-profile-gen=file - compiles without optimizations, counts the executed instructions and writes them in the profile file
+//		-profile-use=file - uses the counts from the profile file to guide the optimizations
+//		-memo[=n] - memoizes the results of the pure functions, in tables with n entries (default 256)
+//		-vm=reg - runs the program on the register VM (see regvm.h), instead of the stack VM (-vm=stack, default)
+//		-stats - shows the VM execution statistics
+//		-c - only compiles each source file into an object file (file.c -> file.ao)
+//		-o=file - with -c, the name of the object file of a single source file
+int main(int argc,char *argv[])
 {
-    char *inbuf=loadFile("tests/testgc.c");
-    puts(inbuf);
-    Token *tokens=tokenize(inbuf);
-    
-    showTokens(tokens);
+    const char **fileNames=(const char**)safeAlloc(argc*sizeof(const char*));
+    int nFiles=0;
+    const char *profileFile=NULL;
+    const char *outFile=NULL;
+    bool compileOnly=false;
+    for(int i=1;i<argc;i++){
+        if(!strncmp(argv[i],"-O",2))optLevel=atoi(argv[i]+2);
+        else if(!strncmp(argv[i],"-inline=",8))inlineBudget=atoi(argv[i]+8);
+        else if(!strncmp(argv[i],"-specialize=",12))specializeLimit=atoi(argv[i]+12);
+        else if(!strncmp(argv[i],"-unroll=",8))unrollFactor=atoi(argv[i]+8);
+        else if(!strncmp(argv[i],"-vectorize=",11))vectorizeEnabled=atoi(argv[i]+11)!=0;
+        else if(!strcmp(argv[i],"-soa"))soaEnabled=true;
+        else if(!strcmp(argv[i],"-ssa"))ssaEnabled=true;
+        else if(!strcmp(argv[i],"-dump-ssa"))ssaEnabled=ssaDumpEnabled=true;
+        else if(!strcmp(argv[i],"-bounds-check"))boundsCheck=true;
+        else if(!strncmp(argv[i],"-profile-gen=",13)){
+            profileGen=true;
+            profileFile=argv[i]+13;
+        }
+        else if(!strncmp(argv[i],"-profile-use=",13))profileRead(argv[i]+13);
+        else if(!strcmp(argv[i],"-memo"))memoEnabled=true;
+        else if(!strncmp(argv[i],"-memo=",6)){
+            memoEnabled=true;
+            memoSize=atoi(argv[i]+6);
+            if(memoSize<1)err("invalid memo table size: %s",argv[i]+6);
+        }
+        else if(!strcmp(argv[i],"-vm=stack"))regVm=false;
+        else if(!strcmp(argv[i],"-vm=reg"))regVm=true;
+        else if(!strcmp(argv[i],"-stats"))vmStats=true;
+        else if(!strcmp(argv[i],"-c"))compileOnly=true;
+        else if(!strncmp(argv[i],"-o=",3))outFile=argv[i]+3;
+        else fileNames[nFiles++]=argv[i];
+    }
+    if(!nFiles)fileNames[nFiles++]="tests/testgc.c";
+    if(outFile&&(!compileOnly||nFiles>1))err("-o can be used only with -c and a single source file");
+    // the profile is keyed by the indexes of the instructions in the unoptimized code
+    // and it must count all the executions of the functions, on the stack VM
+    if(profileGen){
+        optLevel=0;
+        memoEnabled=false;
+        regVm=false;
+    }
     pushDomain();
     vmInit();
-    parse(tokens);
-    showDomain(symTable,"global");
-    Instr *test =genTestProgramDouble();
-    //run(test);
-
+    // each module is compiled alone, with its own data segment and constant pool
+    Module **modules=(Module**)safeAlloc(nFiles*sizeof(Module*));
+    for(int i=0;i<nFiles;i++){
+        modules[i]=isObjectFile(fileNames[i])?moduleRead(fileNames[i]):moduleCompile(fileNames[i]);
+    }
+    if(compileOnly){
+        for(int i=0;i<nFiles;i++){
+            if(isObjectFile(fileNames[i]))continue;
+            char *name=outFile?NULL:objectName(fileNames[i]);
+            moduleWrite(modules[i],outFile?outFile:name);
+            printf("// %s -> %s\n",fileNames[i],outFile?outFile:name);
+            free(name);
+        }
+        return 0;
+    }
+    linkModules(modules,nFiles);
+    free(modules);
+    free(fileNames);
     Symbol *symMain=findSymbolInDomain(symTable,"main");
 
     if(!symMain)err("missing main function");
+    if(optLevel>=2){
+        linkOptimize();
+        specializeCalls();
+        treeShake(symMain);
+        layoutData();
+    }
+    if(soaEnabled)soaLayout();
+    if(memoEnabled)memoizeCalls();
+    if(optLevel>=1)flattenCode(symMain);
+    showDomain(symTable,"global");
+    showOptStats();
+    Instr *test =genTestProgramDouble();
+    //run(test);
 
-    Instr *entryCode=NULL;
-    addInstr(&entryCode,OP_CALL)->arg.instr=symMain->fn.instr;
-    addInstr(&entryCode,OP_HALT);
-    run(entryCode);
+    dataInit();
+    constInit();
+    // the wall time of the execution, with the execution trace
+    struct timespec start,end;
+    if(regVm){
+        RInstr *entry=regLower(symMain);
+        timespec_get(&start,TIME_UTC);
+        runReg(entry);
+        timespec_get(&end,TIME_UTC);
+        if(vmStats)showRegVmStats(10);
+    }else{
+        Instr *entryCode=NULL;
+        addInstr(&entryCode,OP_CALL)->arg.instr=symMain->fn.instr;
+        addInstr(&entryCode,OP_HALT);
+        timespec_get(&start,TIME_UTC);
+        run(entryCode);
+        timespec_get(&end,TIME_UTC);
+        if(vmStats)showVmStats(10);
+    }
+    if(vmStats)printf("// execution time: %.3f ms\n",(end.tv_sec-start.tv_sec)*1e3+(end.tv_nsec-start.tv_nsec)/1e6);
+    if(memoEnabled)showMemoStats();
+    if(profileGen)profileWrite(profileFile,symTable);
     dropDomain();
-    free(inbuf);
+    dataFree();
+    constFree();
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "utils.h"
+#include "memo.h"
+
+bool memoEnabled=false;
+int memoSize=256;
+MemoTable **memoTables;
+int nMemoTables;
+static int capMemoTables;
+
+typedef struct{		// a call which was not found in its table and did not return yet
+	MemoTable *t;
+	Val key[MEMO_MAX_PARAMS];
+	void *retAddr;
+	}MemoCall;
+
+// the started calls, in the order of their frames
+static MemoCall *calls;
+static int nCalls,capCalls;
+
+bool memoizable(Symbol *fn){
+	if(!fn->fn.pure||fn->fn.extFnPtr)return false;
+	if(fn->type.tb==TB_VOID||fn->type.tb==TB_STRUCT||fn->type.n>=0)return false;
+	return symbolsLen(fn->fn.params)<=MEMO_MAX_PARAMS;
+	}
+
+int memoTableOf(Symbol *fn){
+	for(int k=0;k<nMemoTables;k++){
+		if(memoTables[k]->fn==fn)return k;
+		}
+	if(!nMemoTables){
+		int n=1;
+		while(n<memoSize)n*=2;
+		memoSize=n;
+		}
+	MemoTable *t=(MemoTable*)safeAlloc(sizeof(MemoTable));
+	memset(t,0,sizeof(MemoTable));
+	t->fn=fn;
+	for(Symbol *p=fn->fn.params;p;p=p->next)t->isDouble[t->nParams++]=p->type.tb==TB_DOUBLE;
+	t->entries=(MemoEntry*)safeAlloc(memoSize*sizeof(MemoEntry));
+	memset(t->entries,0,memoSize*sizeof(MemoEntry));
+	t->ret.op=OP_MEMO_RET;
+	memoTables=(MemoTable**)growArray(memoTables,&capMemoTables,nMemoTables+1,8,sizeof(MemoTable*));
+	memoTables[nMemoTables]=t;
+	return nMemoTables++;
+	}
+
+// the key of a call: the arguments with the bytes which are not used by their type set to 0,
+// so the keys can be compared with memcmp
+static void memoKey(MemoTable *t,Val *args,Val *key){
+	memset(key,0,MEMO_MAX_PARAMS*sizeof(Val));
+	for(int k=0;k<t->nParams;k++){
+		if(t->isDouble[k])key[k].f=args[k].f;
+		else key[k].i=args[k].i;
+		}
+	}
+
+// FNV-1a
+static MemoEntry *memoEntry(MemoTable *t,Val *key){
+	uint32_t h=2166136261u;
+	const unsigned char *p=(const unsigned char*)key;
+	for(size_t k=0;k<t->nParams*sizeof(Val);k++){
+		h^=p[k];
+		h*=16777619u;
+		}
+	return &t->entries[h&(memoSize-1)];
+	}
+
+bool memoLookup(MemoTable *t,Val *args,Val *result){
+	Val key[MEMO_MAX_PARAMS];
+	memoKey(t,args,key);
+	MemoEntry *e=memoEntry(t,key);
+	if(e->used&&!memcmp(e->args,key,sizeof(key))){
+		t->hits++;
+		*result=e->result;
+		return true;
+		}
+	t->misses++;
+	return false;
+	}
+
+void memoPush(MemoTable *t,Val *args,void *retAddr){
+	calls=(MemoCall*)growArray(calls,&capCalls,nCalls+1,64,sizeof(MemoCall));
+	MemoCall *c=&calls[nCalls++];
+	c->t=t;
+	memoKey(t,args,c->key);
+	c->retAddr=retAddr;
+	}
+
+void *memoPop(Val result){
+	MemoCall *c=&calls[--nCalls];
+	MemoEntry *e=memoEntry(c->t,c->key);
+	if(e->used&&memcmp(e->args,c->key,sizeof(c->key)))c->t->evictions++;
+	memcpy(e->args,c->key,sizeof(c->key));
+	e->result=result;
+	e->used=true;
+	return c->retAddr;
+	}
+
+void showMemoStats(){
+	printf("\n// memoized functions (%d entries per table):\n",memoSize);
+	for(int k=0;k<nMemoTables;k++){
+		MemoTable *t=memoTables[k];
+		printf("//\t%s: %lld hits, %lld misses, %lld evictions\n",t->fn->name,t->hits,t->misses,t->evictions);
+		}
+	}
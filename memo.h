@@ -0,0 +1,61 @@
+#pragma once
+
+// runtime memoization of the pure functions (atomc -memo)
+// a function is pure if it accesses only its own frame: it has only scalar parameters, it does not take the address
+// of a global variable, it does not call extern functions and it calls only pure functions (see optimizeFn)
+// with -memo, the calls of the pure functions which return a value and have at most MEMO_MAX_PARAMS parameters
+// become CALL_MEMO (see memoizeCalls in opt.h); each such function has a bounded hash table with the results
+// of its previous calls, keyed by the values of the arguments
+// CALL_MEMO looks up the arguments before the frame is entered: on a hit, the arguments are replaced by the saved
+// result; on a miss, the function is called with the MEMO_RET of its table as return address, which saves the result
+// and returns to the caller
+
+#include <stdbool.h>
+#include "ad.h"
+
+#define MEMO_MAX_PARAMS 4
+
+typedef struct{		// a saved call
+	Val args[MEMO_MAX_PARAMS];		// the arguments, with the unused bytes set to 0
+	Val result;
+	bool used;
+	}MemoEntry;
+
+typedef struct{		// the results of the calls of a pure function
+	Symbol *fn;
+	int nParams;
+	bool isDouble[MEMO_MAX_PARAMS];		// the type of each parameter
+	MemoEntry *entries;		// the hash table, with memoSize entries: each key has a single place, where it replaces the old one
+	long long hits,misses,evictions;
+	Instr ret;		// MEMO_RET, the return address of the calls which are not found in the table
+	}MemoTable;
+
+// if true, the calls of the pure functions are memoized (atomc -memo)
+extern bool memoEnabled;
+// the number of entries of each table (atomc -memo=n, default 256), rounded up to a power of 2
+extern int memoSize;
+// all the tables, indexed by the second argument of CALL_MEMO
+extern MemoTable **memoTables;
+extern int nMemoTables;
+
+// returns true if the calls of the function fn can be memoized: it is pure, it returns a scalar value
+// and it has at most MEMO_MAX_PARAMS parameters
+bool memoizable(Symbol *fn);
+
+// returns the index in memoTables of the table of the function fn, which is created if needed
+int memoTableOf(Symbol *fn);
+
+// searches the arguments (the last nParams values from the VM stack) in the table t
+// returns true and sets *result if they are found
+bool memoLookup(MemoTable *t,Val *args,Val *result);
+
+// starts a call which was not found in the table t: the arguments and the return address are kept
+// until the function returns to the MEMO_RET of t
+// the return address is an Instr of the stack VM or an RInstr of the register VM (see regvm.h)
+void memoPush(MemoTable *t,Val *args,void *retAddr);
+
+// ends the last call started by memoPush: saves its result in the table and returns its return address
+void *memoPop(Val result);
+
+// shows for each table the number of hits, misses and evictions
+void showMemoStats();
@@ -0,0 +1,2755 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <math.h>
+
+#include "utils.h"
+#include "opt.h"
+#include "ssa.h"
+#include "profile.h"
+#include "cfg.h"
+#include "memo.h"
+#include "link.h"
+
+OptStats optStats;
+int optLevel=2;
+int inlineBudget=16;
+int unrollFactor=4;
+int unrollBudget=64;
+int specializeLimit=4;
+int specializeBudget=128;
+bool soaEnabled=false;
+bool vectorizeEnabled=true;
+
+bool isJump(Instr *i){
+	switch(i->op){
+		case OP_JMP:
+		case OP_JF:
+		case OP_JT:
+		case OP_JLT_I:case OP_JLE_I:case OP_JGT_I:case OP_JGE_I:case OP_JEQ_I:case OP_JNE_I:
+		case OP_JLT_D:case OP_JLE_D:case OP_JGT_D:case OP_JGE_D:case OP_JEQ_D:case OP_JNE_D:
+		case OP_JLTC_I:case OP_JLEC_I:case OP_JGTC_I:case OP_JGEC_I:case OP_JEQC_I:case OP_JNEC_I:
+			return true;
+		default:return false;
+		}
+	}
+
+Opcode immediateBranch(Opcode br){
+	switch(br){
+		case OP_JLT_I:return OP_JLTC_I;
+		case OP_JLE_I:return OP_JLEC_I;
+		case OP_JGT_I:return OP_JGTC_I;
+		case OP_JGE_I:return OP_JGEC_I;
+		case OP_JEQ_I:return OP_JEQC_I;
+		case OP_JNE_I:return OP_JNEC_I;
+		default:return OP_JF;
+		}
+	}
+
+Opcode negatedJump(Opcode br){
+	switch(br){
+		case OP_JF:return OP_JT;
+		case OP_JT:return OP_JF;
+		case OP_JLT_I:return OP_JGE_I;
+		case OP_JGE_I:return OP_JLT_I;
+		case OP_JLE_I:return OP_JGT_I;
+		case OP_JGT_I:return OP_JLE_I;
+		case OP_JEQ_I:return OP_JNE_I;
+		case OP_JNE_I:return OP_JEQ_I;
+		case OP_JLT_D:return OP_JGE_D;
+		case OP_JGE_D:return OP_JLT_D;
+		case OP_JLE_D:return OP_JGT_D;
+		case OP_JGT_D:return OP_JLE_D;
+		case OP_JEQ_D:return OP_JNE_D;
+		case OP_JNE_D:return OP_JEQ_D;
+		case OP_JLTC_I:return OP_JGEC_I;
+		case OP_JGEC_I:return OP_JLTC_I;
+		case OP_JLEC_I:return OP_JGTC_I;
+		case OP_JGTC_I:return OP_JLEC_I;
+		case OP_JEQC_I:return OP_JNEC_I;
+		case OP_JNEC_I:return OP_JEQC_I;
+		default:return OP_NOP;
+		}
+	}
+
+// the global domain, which contains all the functions
+static Domain *globalDomain(){
+	Domain *d=symTable;
+	while(d->parent)d=d->parent;
+	return d;
+	}
+
+// the functions are always global symbols
+Symbol *findFn(Instr *i){
+	for(Symbol *s=globalDomain()->symbols;s;s=s->next){
+		if(s->kind!=SK_FN)continue;
+		if((i->op==OP_CALL||i->op==OP_TAILCALL||i->op==OP_CALL_MEMO)&&s->fn.instr==i->arg.instr)return s;
+		if(i->op==OP_CALL_EXT&&s->fn.extFnPtr==i->arg.extFnPtr)return s;
+		}
+	return NULL;
+	}
+
+bool stackEffect(Instr *i,int *pops,int *pushes){
+	switch(i->op){
+		case OP_NOP:
+		case OP_JMP:
+		case OP_INCFP_I:
+			*pops=0;*pushes=0;return true;
+		case OP_PUSH_I:
+		case OP_PUSH_D:
+		case OP_FPLOAD:
+		case OP_FPADDR_I:
+		case OP_FPADDR_F:
+		case OP_FPADDR:
+		case OP_ADDR:
+		case OP_CADDR:
+		case OP_ADDFP_I:
+			*pops=0;*pushes=1;return true;
+		case OP_ADDC_I:
+		case OP_MULC_I:
+		case OP_SHL_I:
+		case OP_SHR_I:
+		case OP_DIVM_I:
+		case OP_CONV_I_F:
+		case OP_CONV_F_I:
+		case OP_LOAD_I:
+		case OP_LOAD_F:
+		case OP_LOAD_C:
+		case OP_OFFSET:
+			*pops=1;*pushes=1;return true;
+		case OP_JF:
+		case OP_JT:
+		case OP_JLTC_I:case OP_JLEC_I:case OP_JGTC_I:case OP_JGEC_I:case OP_JEQC_I:case OP_JNEC_I:
+		case OP_FPSTORE:
+		case OP_DROP:
+			*pops=1;*pushes=0;return true;
+		case OP_JLT_I:case OP_JLE_I:case OP_JGT_I:case OP_JGE_I:case OP_JEQ_I:case OP_JNE_I:
+		case OP_JLT_D:case OP_JLE_D:case OP_JGT_D:case OP_JGE_D:case OP_JEQ_D:case OP_JNE_D:
+			*pops=2;*pushes=0;return true;
+		case OP_ADD_I:
+		case OP_ADD_D:
+		case OP_SUB_I:
+		case OP_SUB_F:
+		case OP_MUL_I:
+		case OP_MUL_F:
+		case OP_DIV_I:
+		case OP_DIV_F:
+		case OP_LESS_I:
+		case OP_LESS_D:
+		case OP_LESS_F:
+		case OP_LESSEQ_I:case OP_LESSEQ_F:
+		case OP_GREATER_I:case OP_GREATER_F:
+		case OP_GREATEREQ_I:case OP_GREATEREQ_F:
+		case OP_EQUAL_I:case OP_EQUAL_F:
+		case OP_NOTEQ_I:case OP_NOTEQ_F:
+		case OP_STORE_I:
+		case OP_STORE_F:
+		case OP_STORE_C:
+		case OP_INDEX:
+		case OP_INDEX_CHK:
+			*pops=2;*pushes=1;return true;
+		case OP_VSUM_I:
+			*pops=3;*pushes=1;return true;
+		case OP_VADD_F:
+			*pops=4;*pushes=0;return true;
+		case OP_VMULADD_F:
+			*pops=5;*pushes=0;return true;
+		case OP_CALL:
+		case OP_CALL_EXT:{
+			Symbol *fn=findFn(i);
+			if(!fn)return false;
+			*pops=symbolsLen(fn->fn.params);
+			*pushes=fn->type.tb!=TB_VOID;
+			return true;
+			}
+		default:return false;
+		}
+	}
+
+// the jump targets from the current function
+static Instr **targets;
+static int nTargets,capTargets;
+
+static void collectTargets(Instr *code){
+	nTargets=0;
+	for(Instr *i=code;i;i=i->next){
+		if(!isJump(i))continue;
+		targets=(Instr**)growArray(targets,&capTargets,nTargets+1,16,sizeof(Instr*));
+		targets[nTargets++]=i->arg.instr;
+		}
+	}
+
+static bool isTarget(Instr *i){
+	for(int k=0;k<nTargets;k++){
+		if(targets[k]==i)return true;
+		}
+	return false;
+	}
+
+static int countInstr(Instr *code){
+	int n=0;
+	for(;code;code=code->next)n++;
+	return n;
+	}
+
+// the instructions of the current function, in order
+Instr **codeInstrs;
+int nCode;
+static int capCode;
+// hash table which maps the instructions from codeInstrs to their index
+static Instr **hashKeys;
+static int *hashIdx;
+static int capHash;
+
+static unsigned hashInstr(Instr *i){
+	return (unsigned)((uintptr_t)i>>4)*2654435761u;
+	}
+
+void indexCode(Instr *code){
+	nCode=0;
+	for(Instr *i=code;i;i=i->next){
+		codeInstrs=(Instr**)growArray(codeInstrs,&capCode,nCode+1,64,sizeof(Instr*));
+		codeInstrs[nCode++]=i;
+		}
+	int cap=capHash;		// hashIdx grows with hashKeys
+	hashKeys=(Instr**)growArray(hashKeys,&capHash,nCode*2,128,sizeof(Instr*));
+	hashIdx=(int*)growArray(hashIdx,&cap,nCode*2,128,sizeof(int));
+	memset(hashKeys,0,capHash*sizeof(Instr*));
+	for(int k=0;k<nCode;k++){
+		unsigned h=hashInstr(codeInstrs[k])&(capHash-1);
+		while(hashKeys[h])h=(h+1)&(capHash-1);
+		hashKeys[h]=codeInstrs[k];
+		hashIdx[h]=k;
+		}
+	}
+
+int instrIdx(Instr *i){
+	for(unsigned h=hashInstr(i)&(capHash-1);hashKeys[h];h=(h+1)&(capHash-1)){
+		if(hashKeys[h]==i)return hashIdx[h];
+		}
+	return -1;
+	}
+
+int cmpInstrIdx(const void *a,const void *b){
+	uintptr_t x=(uintptr_t)((const InstrIdx*)a)->instr,y=(uintptr_t)((const InstrIdx*)b)->instr;
+	return x<y?-1:x>y;
+	}
+
+int findIdx(InstrIdx *v,int n,Instr *i){
+	InstrIdx key={i,0};
+	InstrIdx *r=(InstrIdx*)bsearch(&key,v,n,sizeof(InstrIdx),cmpInstrIdx);
+	return r?r->idx:-1;
+	}
+
+bool endsFlow(Instr *i){
+	switch(i->op){
+		case OP_JMP:
+		case OP_RET:
+		case OP_RET_VOID:
+		case OP_TAILCALL:
+		case OP_HALT:
+			return true;
+		default:return false;
+		}
+	}
+
+// retargets the jumps to NOPs at the first following instruction and removes the NOPs
+// a NOP which is the last instruction is kept, because there is no instruction to retarget to
+static void delNops(Instr *code){
+	for(Instr *i=code;i;i=i->next){
+		if(!isJump(i))continue;
+		Instr *t=i->arg.instr;
+		while(t->op==OP_NOP&&t->next)t=t->next;
+		i->arg.instr=t;
+		}
+	for(Instr *i=code;i->next;){
+		Instr *next=i->next;
+		if(next->op==OP_NOP&&next->next){
+			i->next=next->next;
+			free(next);
+			optStats.nops++;
+			}else{
+			i=next;
+			}
+		}
+	}
+
+static bool isPush(Instr *i){
+	switch(i->op){
+		case OP_PUSH_I:
+		case OP_PUSH_D:
+		case OP_FPLOAD:
+		case OP_FPADDR_I:
+		case OP_FPADDR_F:
+		case OP_FPADDR:
+		case OP_ADDR:
+		case OP_CADDR:
+			return true;
+		default:return false;
+		}
+	}
+
+// FPADDR+...+STORE+DROP -> ...+FPSTORE
+// the address pushed by FPADDR must be consumed by the STORE, so the instructions between them
+// must compute exactly one value, without jumps and without touching the address
+static bool fuseStore(Instr *addr){
+	Opcode store=addr->op==OP_FPADDR_I?OP_STORE_I:OP_STORE_F;
+	int depth=0;
+	for(Instr *i=addr->next;i;i=i->next){
+		if(isTarget(i))return false;
+		if(i->op==store&&depth==1){
+			Instr *drop=i->next;
+			if(!drop||drop->op!=OP_DROP||isTarget(drop))return false;
+			i->op=OP_FPSTORE;
+			i->arg.i=addr->arg.i;
+			addr->op=OP_NOP;
+			drop->op=OP_NOP;
+			return true;
+			}
+		int pops,pushes;
+		if(isJump(i)||!stackEffect(i,&pops,&pushes)||pops>depth)return false;
+		depth+=pushes-pops;
+		}
+	return false;
+	}
+
+// returns 1 if the conditional jump br, which has on stack the int constant v, is always taken,
+// 0 if it is never taken or -1 if it does not take a single int value
+static int constJump(Instr *br,int v){
+	switch(br->op){
+		case OP_JF:return v==0;
+		case OP_JT:return v!=0;
+		case OP_JLTC_I:return v<br->arg2;
+		case OP_JLEC_I:return v<=br->arg2;
+		case OP_JGTC_I:return v>br->arg2;
+		case OP_JGEC_I:return v>=br->arg2;
+		case OP_JEQC_I:return v==br->arg2;
+		case OP_JNEC_I:return v!=br->arg2;
+		default:return -1;
+		}
+	}
+
+// returns the result of the int comparison cmp (LESS_I, ... or the compare and branch JLT_I, ...) of x and y,
+// or -1 if cmp is not an int comparison
+static int compareInt(Opcode cmp,int x,int y){
+	switch(cmp){
+		case OP_LESS_I:case OP_JLT_I:return x<y;
+		case OP_LESSEQ_I:case OP_JLE_I:return x<=y;
+		case OP_GREATER_I:case OP_JGT_I:return x>y;
+		case OP_GREATEREQ_I:case OP_JGE_I:return x>=y;
+		case OP_EQUAL_I:case OP_JEQ_I:return x==y;
+		case OP_NOTEQ_I:case OP_JNE_I:return x!=y;
+		default:return -1;
+		}
+	}
+
+// folds the int constant pushed by push with the instructions after it:
+//		PUSH_I x; ADDC_I y -> PUSH_I x+y (also MULC_I, SHL_I, SHR_I), PUSH_I x; CONV_I_F -> PUSH_D x
+//		PUSH_I x; PUSH_I y; ADD_I -> PUSH_I x+y (also SUB_I, MUL_I, DIV_I and the comparisons)
+//		PUSH_I x; PUSH_I y; JLT_I -> JMP if x<y, else nothing (also the other int compare and branch jumps)
+// the results wrap around like in the VM and a division by 0 is left to the VM
+// returns true if something was folded
+static bool foldConsts(Instr *push){
+	Instr *next=push->next,*op=next;
+	int x=push->arg.i,y=next->arg.i,r;
+	if(next->op==OP_PUSH_I){
+		op=next->next;
+		if(!op||isTarget(op))return false;
+		int cmp=compareInt(op->op,x,y);
+		if(isJump(op)){
+			if(cmp<0)return false;
+			op->op=cmp?OP_JMP:OP_NOP;
+			push->op=OP_NOP;
+			next->op=OP_NOP;
+			return true;
+			}
+		switch(op->op){
+			case OP_ADD_I:r=(int)((unsigned)x+(unsigned)y);break;
+			case OP_SUB_I:r=(int)((unsigned)x-(unsigned)y);break;
+			case OP_MUL_I:r=(int)((unsigned)x*(unsigned)y);break;
+			case OP_DIV_I:
+				if(y==0||(x==INT_MIN&&y==-1))return false;
+				r=x/y;
+				break;
+			default:
+				if(cmp<0)return false;
+				r=cmp;
+			}
+		next->op=OP_NOP;
+		}else{
+		switch(next->op){
+			case OP_ADDC_I:r=(int)((unsigned)x+(unsigned)y);break;
+			case OP_MULC_I:r=(int)((unsigned)x*(unsigned)y);break;
+			case OP_SHL_I:r=(int)((unsigned)x<<y);break;
+			case OP_SHR_I:r=(x<0?x+((1<<y)-1):x)>>y;break;
+			case OP_CONV_I_F:
+				push->op=OP_PUSH_D;
+				push->arg.f=(double)x;
+				next->op=OP_NOP;
+				return true;
+			default:return false;
+			}
+		}
+	push->arg.i=r;
+	op->op=OP_NOP;
+	return true;
+	}
+
+// a single pass of the patterns over the code
+// the removed instructions become NOPs, so the jumps to them remain valid until delNops
+// returns true if something was changed
+static bool peepholePass(Instr *code){
+	bool changed=false;
+	for(Instr *i=code;i;i=i->next){
+		Instr *next=i->next;
+		if(isJump(i)){
+			Instr *t=i->arg.instr;
+			for(int n=0;t->op==OP_JMP&&t!=i&&n<100;n++)t=t->arg.instr;
+			if(t!=i->arg.instr){
+				i->arg.instr=t;
+				optStats.jumps++;
+				changed=true;
+				}
+			if(t==next&&(i->op==OP_JMP||i->op==OP_JF||i->op==OP_JT)){
+				// a conditional jump to the next instruction only consumes the condition
+				i->op=i->op==OP_JMP?OP_NOP:OP_DROP;
+				optStats.jumps++;
+				changed=true;
+				}
+			continue;
+			}
+		if(!next||isTarget(next))continue;
+		if((i->op==OP_FPADDR_I&&next->op==OP_LOAD_I)||(i->op==OP_FPADDR_F&&next->op==OP_LOAD_F)){
+			i->op=OP_FPLOAD;
+			next->op=OP_NOP;
+			optStats.loads++;
+			changed=true;
+			}else if(i->op==OP_PUSH_I&&constJump(next,i->arg.i)>=0){
+			// a condition known at compile time: the jump is always taken (JMP) or it is removed
+			next->op=constJump(next,i->arg.i)?OP_JMP:OP_NOP;
+			i->op=OP_NOP;
+			optStats.jumps++;
+			changed=true;
+			}else if(i->op==OP_PUSH_I&&foldConsts(i)){
+			optStats.consts++;
+			changed=true;
+			}else if(isPush(i)&&next->op==OP_DROP){
+			i->op=OP_NOP;
+			next->op=OP_NOP;
+			optStats.pushDrops++;
+			changed=true;
+			}else if(i->op==OP_FPADDR_I||i->op==OP_FPADDR_F){
+			if(fuseStore(i)){
+				optStats.stores++;
+				changed=true;
+				}
+			}else if(next->op==OP_OFFSET&&(i->op==OP_ADDR||i->op==OP_CADDR||i->op==OP_OFFSET)){
+			// ADDR p; OFFSET k -> ADDR p+k (also for CADDR), OFFSET a; OFFSET b -> OFFSET a+b
+			i->arg.i+=next->arg.i;
+			next->op=OP_NOP;
+			optStats.addrs++;
+			changed=true;
+			}else if(i->op==OP_PUSH_I&&next->op==OP_INDEX&&(long long)i->arg.i*next->arg.i==i->arg.i*next->arg.i){
+			// PUSH_I ct; INDEX size -> OFFSET ct*size
+			i->op=OP_OFFSET;
+			i->arg.i*=next->arg.i;
+			next->op=OP_NOP;
+			optStats.addrs++;
+			changed=true;
+			}else if(i->op==OP_OFFSET&&i->arg.i==0){
+			i->op=OP_NOP;
+			optStats.addrs++;
+			changed=true;
+			}
+		}
+	return changed;
+	}
+
+void peephole(Symbol *fn){
+	Instr *code=fn->fn.instr;		// it starts with ENTER, which is never removed
+	do{
+		delNops(code);
+		collectTargets(code);
+		}while(peepholePass(code));
+	}
+
+void dce(Symbol *fn){
+	Instr *code=fn->fn.instr;
+	indexCode(code);
+	bool *live=(bool*)safeAlloc(nCode*sizeof(bool));
+	int *work=(int*)safeAlloc(nCode*sizeof(int));
+	memset(live,0,nCode*sizeof(bool));
+	int nWork=0;
+	live[0]=true;
+	work[nWork++]=0;
+	while(nWork){
+		int k=work[--nWork];
+		Instr *i=codeInstrs[k];
+		if(isJump(i)){
+			int t=instrIdx(i->arg.instr);
+			if(t>=0&&!live[t]){
+				live[t]=true;
+				work[nWork++]=t;
+				}
+			}
+		if(!endsFlow(i)&&k+1<nCode&&!live[k+1]){
+			live[k+1]=true;
+			work[nWork++]=k+1;
+			}
+		}
+	// the jumps from the live instructions go only to live instructions, so they remain valid
+	Instr *last=code;
+	for(int k=1;k<nCode;k++){
+		if(live[k]){
+			last->next=codeInstrs[k];
+			last=codeInstrs[k];
+			}else{
+			free(codeInstrs[k]);
+			optStats.dead++;
+			}
+		}
+	last->next=NULL;
+	free(live);
+	free(work);
+	}
+
+// returns true if the code starting with i has the given opcodes
+// and only its first instruction can be a jump target
+static bool matchSeq(Instr *i,const Opcode *ops,int n){
+	for(int k=0;k<n;k++,i=i->next){
+		if(!i||i->op!=ops[k])return false;
+		if(k&&isTarget(i))return false;
+		}
+	return true;
+	}
+
+void superinstr(Symbol *fn){
+	static const Opcode incSeq[]={OP_FPLOAD,OP_PUSH_I,OP_ADD_I,OP_FPSTORE};
+	static const Opcode addSeq[]={OP_FPLOAD,OP_FPLOAD,OP_ADD_I};
+	static const Opcode addcSeq[]={OP_PUSH_I,OP_ADD_I};
+	Instr *code=fn->fn.instr;
+	collectTargets(code);
+	// the replaced instructions become NOPs, so the jump targets remain valid
+	for(Instr *i=code;i;i=i->next){
+		if(matchSeq(i,incSeq,4)&&i->next->next->next->arg.i==i->arg.i){
+			i->op=OP_INCFP_I;
+			i->arg2=i->next->arg.i;
+			i->next->op=OP_NOP;
+			i->next->next->op=OP_NOP;
+			i->next->next->next->op=OP_NOP;
+			optStats.supers++;
+			}else if(matchSeq(i,addSeq,3)){
+			i->op=OP_ADDFP_I;
+			i->arg2=i->next->arg.i;
+			i->next->op=OP_NOP;
+			i->next->next->op=OP_NOP;
+			optStats.supers++;
+			}else if(matchSeq(i,addcSeq,2)){
+			i->op=OP_ADDC_I;
+			i->next->op=OP_NOP;
+			optStats.supers++;
+			}
+		}
+	delNops(code);
+	}
+
+// returns the new index of an FP relative index from the inlined function
+// its parameters and local variables are placed in the caller frame starting with base
+static int inlinedIdx(int idx,int nParams,int base){
+	if(idx<0)return base+idx+nParams+1;		// a parameter: idx=paramIdx-nParams-1
+	return base+nParams+idx-1;		// a local variable: idx=varIdx+1
+	}
+
+// returns true if the function can be inlined in the function fn, if it has at most budget instructions
+static bool canInline(Symbol *callee,Symbol *fn,int budget){
+	if(callee==fn||callee->fn.extFnPtr||callee->fn.imported)return false;
+	int n=0;
+	for(Instr *i=callee->fn.instr->next;i;i=i->next){
+		if((i->op==OP_CALL||i->op==OP_TAILCALL)&&i->arg.instr==callee->fn.instr)return false;		// recursive
+		if(++n>budget)return false;
+		}
+	return true;
+	}
+
+// replaces the instruction call with the code of callee and returns the instruction after the inlined code
+static Instr *inlineCall(Instr *call,Symbol *callee,int base){
+	int nParams=symbolsLen(callee->fn.params);
+	Instr *after=insertInstr(call,OP_NOP);		// RET jumps here
+	// the arguments from stack are moved in the new local variables, starting with the last one
+	Instr *last=call;
+	for(int k=nParams-1;k>=0;k--){
+		last=insertInstr(last,OP_FPSTORE);
+		last->arg.i=base+k;
+		}
+	indexCode(callee->fn.instr);
+	Instr **copies=(Instr**)safeAlloc(nCode*sizeof(Instr*));
+	copies[0]=NULL;		// ENTER is not copied
+	for(int k=1;k<nCode;k++){
+		Instr *src=codeInstrs[k];
+		last=insertInstr(last,src->op);
+		last->arg=src->arg;
+		last->arg2=src->arg2;
+		last->prof=src->prof;
+		copies[k]=last;
+		if(src->op==OP_TAILCALL){		// the inlined code cannot reuse the frame of fn
+			last->op=OP_CALL;
+			last->arg2=0;
+			last=insertInstr(last,OP_JMP);
+			last->arg.instr=after;
+			}
+		}
+	for(int k=1;k<nCode;k++){
+		Instr *i=copies[k];
+		switch(i->op){
+			case OP_RET:
+			case OP_RET_VOID:
+				i->op=OP_JMP;
+				i->arg.instr=after;
+				break;
+			case OP_FPLOAD:
+			case OP_FPSTORE:
+			case OP_FPADDR_I:
+			case OP_FPADDR_F:
+			case OP_FPADDR:
+			case OP_INCFP_I:
+				i->arg.i=inlinedIdx(i->arg.i,nParams,base);
+				break;
+			case OP_ADDFP_I:
+				i->arg.i=inlinedIdx(i->arg.i,nParams,base);
+				i->arg2=inlinedIdx(i->arg2,nParams,base);
+				break;
+			default:
+				if(isJump(i))i->arg.instr=copies[instrIdx(i->arg.instr)];
+			}
+		}
+	free(copies);
+	call->op=OP_NOP;
+	return after;
+	}
+
+// inlines the calls from fn, as inlineCalls
+// if only is not NULL, only the calls from only[0..nOnly) are inlined
+static void inlineCallsIn(Symbol *fn,Instr **only,int nOnly){
+	Instr *enter=fn->fn.instr;
+	int base=enter->arg.i+1;		// the first local variable after the ones of fn
+	int nNew=0;		// the number of new local variables
+	for(Instr *i=enter;i;i=i->next){
+		if(i->op!=OP_CALL)continue;
+		if(only){
+			int k;
+			for(k=0;k<nOnly&&only[k]!=i;k++){}
+			if(k==nOnly)continue;
+			}
+		Symbol *callee=findFn(i);
+		if(!callee)continue;
+		// with a profile, the calls which were not executed are not inlined and the hot ones have a larger budget
+		if(profileCold(i)){
+			optStats.profColdCalls++;
+			continue;
+			}
+		bool hot=profileHot(i);
+		if(!canInline(callee,fn,hot?inlineBudget*4:inlineBudget))continue;
+		if(hot&&!canInline(callee,fn,inlineBudget))optStats.profInlined++;
+		int n=symbolsLen(callee->fn.params)+callee->fn.instr->arg.i;
+		if(nNew<n)nNew=n;
+		i=inlineCall(i,callee,base);
+		optStats.inlined++;
+		}
+	enter->arg.i+=nNew;
+	}
+
+void inlineCalls(Symbol *fn){
+	inlineCallsIn(fn,NULL,0);
+	}
+
+void tailCalls(Symbol *fn){
+	// the called function could get the address of a local array or struct, which TAILCALL would overwrite
+	for(Instr *i=fn->fn.instr;i;i=i->next){
+		if(i->op==OP_FPADDR)return;
+		}
+	for(Instr *i=fn->fn.instr;i;i=i->next){
+		Instr *ret=i->next;
+		if(i->op!=OP_CALL||!ret)continue;
+		bool isVoid=findFn(i)->type.tb==TB_VOID;
+		if(ret->op!=(isVoid?OP_RET_VOID:OP_RET))continue;
+		i->op=OP_TAILCALL;
+		i->arg2=ret->arg.i;
+		optStats.tailCalls++;
+		}
+	// removes the RETs after TAILCALL, if they are not jump targets
+	dce(fn);
+	}
+
+// a value from the simulated stack of a loop, for licm
+typedef struct{
+	int start,end;		// the instructions which compute it, as indexes in codeInstrs
+	bool inv;		// loop invariant
+	}LoopVal;
+
+// the loop from licm: the frame slots written in it and if it writes the memory
+static bool *slotWritten,*slotAddressed;		// indexed by the FP index+slotBase
+static int slotBase;
+static bool memWritten;
+
+// returns true if the frame slot with the given FP index has the same value in all the loop iterations
+static bool slotInvariant(int idx){
+	idx+=slotBase;
+	return !slotWritten[idx]&&!(slotAddressed[idx]&&memWritten);
+	}
+
+// returns true if the instruction computes a loop invariant value from its loop invariant operands
+// top is the value from the top of the stack (the last operand)
+static bool invariantOp(Instr *i,LoopVal *top){
+	switch(i->op){
+		case OP_PUSH_I:case OP_PUSH_D:
+		case OP_ADDR:case OP_CADDR:case OP_FPADDR_I:case OP_FPADDR_F:case OP_FPADDR:
+		case OP_ADD_I:case OP_ADD_D:case OP_SUB_I:case OP_SUB_F:
+		case OP_MUL_I:case OP_MUL_F:case OP_DIV_F:case OP_ADDC_I:
+		case OP_MULC_I:case OP_SHL_I:case OP_SHR_I:case OP_DIVM_I:
+		case OP_CONV_I_F:case OP_CONV_F_I:
+		case OP_LESS_I:case OP_LESS_D:case OP_LESS_F:
+		case OP_LESSEQ_I:case OP_LESSEQ_F:case OP_GREATER_I:case OP_GREATER_F:
+		case OP_GREATEREQ_I:case OP_GREATEREQ_F:case OP_EQUAL_I:case OP_EQUAL_F:
+		case OP_NOTEQ_I:case OP_NOTEQ_F:
+			return true;
+		case OP_DIV_I:{		// only if it cannot trap or overflow: a constant divisor, other than 0 and -1
+			Instr *d=codeInstrs[top->end];
+			return top->start==top->end&&d->op==OP_PUSH_I&&d->arg.i!=0&&d->arg.i!=-1;
+			}
+		case OP_FPLOAD:return slotInvariant(i->arg.i);
+		case OP_ADDFP_I:return slotInvariant(i->arg.i)&&slotInvariant(i->arg2);
+		case OP_LOAD_I:case OP_LOAD_F:case OP_LOAD_C:return !memWritten;
+		// INDEX_CHK is not moved, because it can trap
+		case OP_INDEX:case OP_OFFSET:return true;
+		default:return false;
+		}
+	}
+
+// returns true if the instruction can change the memory (not only the frame slots of the current function)
+static bool writesMem(Instr *i){
+	switch(i->op){
+		case OP_STORE_I:
+		case OP_STORE_F:
+		case OP_STORE_C:
+		case OP_VADD_F:
+		case OP_VMULADD_F:
+			return true;
+		case OP_CALL:
+		case OP_TAILCALL:
+		case OP_CALL_EXT:{
+			Symbol *fn=findFn(i);
+			return !fn||!fn->fn.pure;
+			}
+		default:return false;
+		}
+	}
+
+// moves the loop invariant expressions of the loop codeInstrs[h..e] in a pre-header
+static void licmLoop(Symbol *fn,int h,int e){
+	Instr *enter=fn->fn.instr;
+	// the loop must be entered only through its first instruction
+	for(int k=0;k<nCode;k++){
+		Instr *i=codeInstrs[k];
+		if(!isJump(i)||(k>=h&&k<=e))continue;
+		int t=instrIdx(i->arg.instr);
+		if(t>h&&t<=e)return;
+		}
+	int nSlots=enter->arg2+1+enter->arg.i+1;
+	slotBase=enter->arg2+1;
+	slotWritten=(bool*)safeAlloc(nSlots*sizeof(bool));
+	slotAddressed=(bool*)safeAlloc(nSlots*sizeof(bool));
+	memset(slotWritten,0,nSlots*sizeof(bool));
+	memset(slotAddressed,0,nSlots*sizeof(bool));
+	memWritten=false;
+	for(int k=0;k<nCode;k++){
+		Instr *i=codeInstrs[k];
+		if(i->op==OP_FPADDR_I||i->op==OP_FPADDR_F)slotAddressed[i->arg.i+slotBase]=true;
+		if(k<h||k>e)continue;
+		if(i->op==OP_FPSTORE||i->op==OP_INCFP_I)slotWritten[i->arg.i+slotBase]=true;
+		if(writesMem(i))memWritten=true;
+		}
+	// simulates the stack in the loop and finds the maximal invariant expressions
+	// which are used by instructions which are not invariant
+	LoopVal *stack=(LoopVal*)safeAlloc((e-h+1)*sizeof(LoopVal));
+	LoopVal *found=(LoopVal*)safeAlloc((e-h+1)*sizeof(LoopVal));
+	int nStack=0,nFound=0;
+	for(int k=h;k<=e;k++){
+		Instr *i=codeInstrs[k];
+		// the values are not followed through jumps
+		if(k==h||isTarget(i)||isJump(codeInstrs[k-1]))nStack=0;
+		int pops,pushes;
+		if(!stackEffect(i,&pops,&pushes)){
+			pops=nStack;
+			pushes=0;
+			}
+		bool inv=pops<=nStack&&pushes==1;
+		for(int j=nStack-pops;inv&&j<nStack;j++){		// invariant and contiguous operands
+			int next=j+1<nStack?stack[j+1].start:k;
+			if(!stack[j].inv||stack[j].end+1!=next)inv=false;
+			}
+		if(inv)inv=invariantOp(i,nStack?&stack[nStack-1]:NULL);
+		if(pops>nStack)pops=nStack;
+		nStack-=pops;
+		if(!inv){
+			for(int j=nStack;j<nStack+pops;j++){
+				if(stack[j].inv&&stack[j].end>stack[j].start)found[nFound++]=stack[j];
+				}
+			}
+		if(pushes){
+			stack[nStack].start=inv&&pops?stack[nStack].start:k;
+			stack[nStack].end=k;
+			stack[nStack].inv=inv;
+			nStack++;
+			}
+		}
+	if(nFound){
+		// the jumps from outside the loop to its beginning will go to the pre-header
+		Instr **entries=(Instr**)safeAlloc(nCode*sizeof(Instr*));
+		int nEntries=0;
+		for(int k=0;k<nCode;k++){
+			Instr *i=codeInstrs[k];
+			if(isJump(i)&&(k<h||k>e)&&i->arg.instr==codeInstrs[h])entries[nEntries++]=i;
+			}
+		Instr *pre=codeInstrs[h-1];
+		for(int j=0;j<nFound;j++){
+			Instr *first=codeInstrs[found[j].start],*last=codeInstrs[found[j].end];
+			int tmp=enter->arg.i+1;		// a new local variable
+			enter->arg.i++;
+			Instr *copy=insertInstr(pre,first->op);
+			copy->arg=first->arg;
+			copy->arg2=first->arg2;
+			pre=copy;
+			if(last!=first){		// moves the rest of the expression
+				Instr *rest=first->next;
+				first->next=last->next;
+				last->next=pre->next;
+				pre->next=rest;
+				pre=last;
+				}
+			pre=insertInstr(pre,OP_FPSTORE);
+			pre->arg.i=tmp;
+			// first remains in the loop, because it can be a jump target
+			first->op=OP_FPLOAD;
+			first->arg.i=tmp;
+			first->arg2=0;
+			optStats.hoisted++;
+			}
+		for(int j=0;j<nEntries;j++)entries[j]->arg.instr=codeInstrs[h-1]->next;
+		free(entries);
+		}
+	free(stack);
+	free(found);
+	free(slotWritten);
+	free(slotAddressed);
+	}
+
+// an expression computed in the extended basic block processed by cse
+typedef struct{
+	Opcode op;
+	Val arg;
+	int arg2;
+	int operands[2];		// the value numbers of the operands
+	int versions[2];		// the versions of the frame slots and of the memory which it reads
+	int end;		// the last instruction of its first computation, as index in codeInstrs
+	int tmp;		// the frame slot where its first computation is saved, or 0
+	bool valid;		// false if its first computation was removed
+	}Expr;
+
+// a value from the simulated stack, for cse
+typedef struct{
+	int vn;		// value number: the index of its expression in exprs, or -1 if it is not known
+	int start,end;		// the instructions which compute it, as indexes in codeInstrs
+	bool again;		// the expression was already computed
+	bool contiguous;		// all its instructions are in start..end
+	}CseVal;
+
+static Expr *exprs;
+static int nExprs;
+static int *slotVersion,*slotHolds;		// indexed by the FP index+slotBase; slotHolds is the value number of the slot content
+static int nSlots;		// the slots added by cse are not tracked
+static int memVersion,versionTick;
+
+// returns true if the instruction computes a value only from its operands, frame slots or memory
+static bool cseOp(Instr *i){
+	switch(i->op){
+		case OP_PUSH_I:case OP_PUSH_D:
+		case OP_ADDR:case OP_CADDR:case OP_FPADDR_I:case OP_FPADDR_F:case OP_FPADDR:case OP_FPLOAD:case OP_ADDFP_I:
+		case OP_LOAD_I:case OP_LOAD_F:case OP_LOAD_C:
+		case OP_INDEX:case OP_INDEX_CHK:case OP_OFFSET:
+		case OP_ADD_I:case OP_ADD_D:case OP_SUB_I:case OP_SUB_F:
+		case OP_MUL_I:case OP_MUL_F:case OP_DIV_I:case OP_DIV_F:case OP_ADDC_I:
+		case OP_MULC_I:case OP_SHL_I:case OP_SHR_I:case OP_DIVM_I:
+		case OP_CONV_I_F:case OP_CONV_F_I:
+		case OP_LESS_I:case OP_LESS_D:case OP_LESS_F:
+		case OP_LESSEQ_I:case OP_LESSEQ_F:case OP_GREATER_I:case OP_GREATER_F:
+		case OP_GREATEREQ_I:case OP_GREATEREQ_F:case OP_EQUAL_I:case OP_EQUAL_F:
+		case OP_NOTEQ_I:case OP_NOTEQ_F:
+			return true;
+		default:return false;
+		}
+	}
+
+static bool commutative(Opcode op){
+	switch(op){
+		case OP_ADD_I:case OP_ADD_D:case OP_MUL_I:case OP_MUL_F:
+		case OP_EQUAL_I:case OP_EQUAL_F:case OP_NOTEQ_I:case OP_NOTEQ_F:
+			return true;
+		default:return false;
+		}
+	}
+
+// returns true if the arguments of the instructions with the opcode op are the same
+// arg2 is set only for the instructions which use it
+static bool sameArgs(Opcode op,Val a,int a2,Val b,int b2){
+	switch(op){
+		case OP_PUSH_D:return a.f==b.f&&signbit(a.f)==signbit(b.f);
+		case OP_ADDFP_I:case OP_DIVM_I:case OP_INDEX_CHK:return a.i==b.i&&a2==b2;
+		default:return a.i==b.i;
+		}
+	}
+
+// returns the value number of the result of the instruction i, with the given operands
+// the expression is added if it was not computed before; *again is set if it was computed before
+// returns -1 if the value cannot be numbered
+static int valueNumber(Instr *i,CseVal *ops,int nOps,int k,bool *again){
+	Expr e={.op=i->op,.arg=i->arg,.arg2=i->arg2,.operands={-1,-1},.versions={0,0},.end=k,.tmp=0,.valid=true};
+	for(int j=0;j<nOps;j++){
+		if(ops[j].vn<0)return -1;
+		e.operands[j]=ops[j].vn;
+		}
+	if(nOps==2&&commutative(i->op)&&e.operands[0]>e.operands[1]){
+		e.operands[0]=ops[1].vn;
+		e.operands[1]=ops[0].vn;
+		}
+	switch(i->op){
+		case OP_FPLOAD:
+			e.versions[0]=slotVersion[i->arg.i+slotBase];
+			if(slotAddressed[i->arg.i+slotBase])e.versions[1]=memVersion;
+			break;
+		case OP_ADDFP_I:
+			if(slotAddressed[i->arg.i+slotBase]||slotAddressed[i->arg2+slotBase])return -1;
+			e.versions[0]=slotVersion[i->arg.i+slotBase];
+			e.versions[1]=slotVersion[i->arg2+slotBase];
+			break;
+		case OP_LOAD_I:case OP_LOAD_F:case OP_LOAD_C:
+			e.versions[0]=memVersion;
+			break;
+		default:break;
+		}
+	*again=false;
+	for(int x=0;x<nExprs;x++){
+		Expr *f=&exprs[x];
+		if(f->op!=e.op||!sameArgs(e.op,f->arg,f->arg2,e.arg,e.arg2)||
+			f->operands[0]!=e.operands[0]||f->operands[1]!=e.operands[1]||
+			f->versions[0]!=e.versions[0]||f->versions[1]!=e.versions[1])continue;
+		if(f->valid)*again=true;
+		else *f=e;		// its first computation was removed, so this becomes the first one
+		return x;
+		}
+	exprs[nExprs]=e;
+	return nExprs++;
+	}
+
+// replaces the computation v of an expression which was computed before with the load of a frame slot which holds it
+// if there is no such slot, the value of the first computation is saved in a new frame slot
+static void reuseExpr(Symbol *fn,CseVal *v){
+	if(!v->again||!v->contiguous)return;
+	int n=0;
+	for(int k=v->start;k<=v->end;k++){
+		if(codeInstrs[k]->op!=OP_NOP)n++;
+		}
+	if(n<2)return;
+	// the first computations from v cannot be removed if their values were saved for other computations
+	for(int x=0;x<nExprs;x++){
+		if(exprs[x].valid&&exprs[x].tmp&&exprs[x].end>=v->start&&exprs[x].end<=v->end)return;
+		}
+	Expr *e=&exprs[v->vn];
+	int slot=0;
+	for(int x=0;x<nSlots&&!slot;x++){
+		if(slotHolds[x]==v->vn)slot=x-slotBase;
+		}
+	if(!slot&&e->tmp)slot=e->tmp;
+	if(!slot){
+		// saving the first computation costs 2 instructions, so the expression must be longer
+		if(n<3)return;
+		slot=e->tmp=++fn->fn.instr->arg.i;
+		Instr *i=insertInstr(codeInstrs[e->end],OP_FPSTORE);
+		i->arg.i=slot;
+		i=insertInstr(i,OP_FPLOAD);
+		i->arg.i=slot;
+		}
+	for(int x=0;x<nExprs;x++){
+		if(exprs[x].end>=v->start&&exprs[x].end<=v->end)exprs[x].valid=false;
+		}
+	Instr *first=codeInstrs[v->start];
+	for(Instr *i=first->next;i!=codeInstrs[v->end]->next;i=i->next)i->op=OP_NOP;
+	first->op=OP_FPLOAD;
+	first->arg.i=slot;
+	first->arg2=0;
+	optStats.cse++;
+	}
+
+void cse(Symbol *fn){
+	Instr *code=fn->fn.instr;
+	indexCode(code);
+	collectTargets(code);
+	slotBase=code->arg2+1;
+	nSlots=slotBase+code->arg.i+1;
+	slotVersion=(int*)safeAlloc(nSlots*sizeof(int));
+	slotHolds=(int*)safeAlloc(nSlots*sizeof(int));
+	slotAddressed=(bool*)safeAlloc(nSlots*sizeof(bool));
+	memset(slotVersion,0,nSlots*sizeof(int));
+	memset(slotAddressed,0,nSlots*sizeof(bool));
+	for(int k=0;k<nCode;k++){
+		Instr *i=codeInstrs[k];
+		if(i->op==OP_FPADDR_I||i->op==OP_FPADDR_F)slotAddressed[i->arg.i+slotBase]=true;
+		}
+	exprs=(Expr*)safeAlloc(nCode*sizeof(Expr));
+	CseVal *stack=(CseVal*)safeAlloc(nCode*sizeof(CseVal));
+	int nStack=0;
+	memVersion=versionTick=0;
+	for(int k=1;k<nCode;k++){
+		Instr *i=codeInstrs[k];
+		// an extended basic block continues after a conditional jump, with the blocks which are entered only from it
+		if(k==1||isTarget(i)||endsFlow(codeInstrs[k-1])){
+			nExprs=0;
+			nStack=0;
+			for(int x=0;x<nSlots;x++)slotHolds[x]=-1;
+			}
+		int pops,pushes;
+		if(!stackEffect(i,&pops,&pushes)){
+			nStack=0;
+			continue;
+			}
+		bool known=pops<=nStack;
+		if(!known)pops=nStack;
+		CseVal *ops=&stack[nStack-pops];
+		bool contiguous=known;
+		for(int j=0;contiguous&&j<pops;j++){
+			int next=j+1<pops?ops[j+1].start:k;
+			if(!ops[j].contiguous||ops[j].end+1!=next)contiguous=false;
+			}
+		CseVal r={.vn=-1,.start=contiguous&&pops?ops[0].start:k,.end=k,.again=false,.contiguous=contiguous};
+		if(known&&pushes==1&&pops<=2&&cseOp(i))r.vn=valueNumber(i,ops,pops,k,&r.again);
+		// the operands are replaced only if the result is not computed again, else the result is replaced
+		if(!r.again){
+			for(int j=0;j<pops;j++)reuseExpr(fn,&ops[j]);
+			}
+		// the instructions which write the frame slots or the memory
+		if(i->op==OP_FPSTORE||i->op==OP_INCFP_I){
+			int x=i->arg.i+slotBase;
+			slotVersion[x]=++versionTick;
+			slotHolds[x]=i->op==OP_FPSTORE&&pops?ops[pops-1].vn:-1;
+			if(slotAddressed[x])memVersion=++versionTick;
+			}
+		if(writesMem(i)){
+			memVersion=++versionTick;
+			for(int x=0;x<nSlots;x++){
+				if(slotAddressed[x])slotHolds[x]=-1;
+				}
+			}
+		nStack-=pops;
+		if(pushes)stack[nStack++]=r;
+		}
+	free(stack);
+	free(exprs);
+	free(slotVersion);
+	free(slotHolds);
+	free(slotAddressed);
+	delNops(code);
+	}
+
+void licm(Symbol *fn){
+	Instr *code=fn->fn.instr;
+	// the inner loops end before the outer ones, so their invariants can be moved further
+	for(Instr *i=code;i;i=i->next){
+		if(!isJump(i))continue;
+		indexCode(code);
+		int h=instrIdx(i->arg.instr),e=instrIdx(i);
+		if(h>0&&h<e){
+			collectTargets(code);
+			licmLoop(fn,h,e);
+			}
+		}
+	}
+
+// a counted loop: while(iv<bound){...; iv=iv+step;} or with <=, >, >=
+typedef struct{
+	int h,e;		// the header and the back jump, as indexes in codeInstrs
+	int body;		// the first instruction of the body
+	int iv;		// the FP index of the induction variable
+	int step;
+	Opcode exitOp;		// the compare and branch instruction which exits the loop (JGE_I, JGT_I, JLE_I or JLT_I)
+	bool constBound;
+	int bound;		// the constant bound or the FP index of the variable which contains it
+	}CountedLoop;
+
+// returns true if the frame slot with the given FP index is written in codeInstrs[from..to]
+static bool slotWrittenIn(int idx,int from,int to){
+	for(int k=from;k<=to;k++){
+		Instr *i=codeInstrs[k];
+		if((i->op==OP_FPSTORE||i->op==OP_INCFP_I)&&i->arg.i==idx)return true;
+		}
+	return false;
+	}
+
+// returns true if the address of the frame slot with the given FP index is taken
+static bool slotAddressTaken(int idx){
+	for(int k=0;k<nCode;k++){
+		Instr *i=codeInstrs[k];
+		if((i->op==OP_FPADDR_I||i->op==OP_FPADDR_F)&&i->arg.i==idx)return true;
+		}
+	return false;
+	}
+
+// the compare and branch instruction which compares with a register, for its immediate form
+static Opcode registerBranch(Opcode br){
+	switch(br){
+		case OP_JLTC_I:return OP_JLT_I;
+		case OP_JLEC_I:return OP_JLE_I;
+		case OP_JGTC_I:return OP_JGT_I;
+		case OP_JGEC_I:return OP_JGE_I;
+		case OP_JEQC_I:return OP_JEQ_I;
+		case OP_JNEC_I:return OP_JNE_I;
+		default:return OP_JF;
+		}
+	}
+
+// returns true if the loop codeInstrs[h..e] ends with the increment of an induction variable:
+// FPLOAD iv; PUSH_I ct; ADD_I or SUB_I; FPSTORE iv; JMP h
+// and iv is not written in other places in the loop and its address is not taken
+static bool loopIncrement(int h,int e,int *iv,int *step){
+	if(codeInstrs[e]->op!=OP_JMP||e-4<=h)return false;
+	Instr **inc=&codeInstrs[e-4];
+	if(inc[0]->op!=OP_FPLOAD||inc[1]->op!=OP_PUSH_I||inc[3]->op!=OP_FPSTORE||inc[3]->arg.i!=inc[0]->arg.i)return false;
+	*iv=inc[0]->arg.i;
+	if(inc[2]->op==OP_ADD_I)*step=inc[1]->arg.i;
+	else if(inc[2]->op==OP_SUB_I&&inc[1]->arg.i!=INT_MIN)*step=-inc[1]->arg.i;
+	else return false;
+	return *step!=0&&!slotWrittenIn(*iv,h,e-2)&&!slotAddressTaken(*iv);
+	}
+
+// returns true if codeInstrs[h..e] is a counted loop and fills L
+static bool countedLoop(int h,int e,CountedLoop *L){
+	Instr *hd=codeInstrs[h];
+	if(codeInstrs[e]->op!=OP_JMP||e+1>=nCode||hd->op!=OP_FPLOAD)return false;
+	L->h=h;
+	L->e=e;
+	L->iv=hd->arg.i;
+	Instr *br=codeInstrs[h+1];
+	if(br->op==OP_FPLOAD){
+		L->constBound=false;
+		L->bound=br->arg.i;
+		br=codeInstrs[h+2];
+		L->exitOp=br->op;
+		L->body=h+3;
+		}else{
+		L->constBound=true;
+		L->bound=br->arg2;
+		L->exitOp=registerBranch(br->op);
+		L->body=h+2;
+		}
+	bool up=L->exitOp==OP_JGE_I||L->exitOp==OP_JGT_I;
+	bool down=L->exitOp==OP_JLE_I||L->exitOp==OP_JLT_I;
+	if((!up&&!down)||br->arg.instr!=codeInstrs[e+1])return false;
+	// the increment at the end of the body, the bound is not written in the loop
+	int iv;
+	if(e-4<L->body||!loopIncrement(h,e,&iv,&L->step)||iv!=L->iv)return false;
+	if(up?L->step<0:L->step>0)return false;
+	if(!L->constBound){
+		if(L->bound==L->iv||slotWrittenIn(L->bound,h,e))return false;
+		if(slotAddressTaken(L->bound)){
+			for(int k=h;k<=e;k++){
+				if(writesMem(codeInstrs[k]))return false;
+				}
+			}
+		}
+	// the jumps from the body remain in the body and the loop is entered only through its header
+	for(int k=0;k<nCode;k++){
+		Instr *i=codeInstrs[k];
+		if(!isJump(i))continue;
+		int t=instrIdx(i->arg.instr);
+		if(k>=L->body&&k<e){
+			if(t<L->body||t>=e)return false;
+			}else if(t>h&&t<=e)return false;
+		}
+	return true;
+	}
+
+// returns true if the induction variable of the loop has a constant value when the loop starts,
+// set by PUSH_I ct; FPSTORE iv before the loop, without other paths to the loop
+static bool loopInit(CountedLoop *L,int *init){
+	for(int k=0;k<nCode;k++){
+		Instr *i=codeInstrs[k];
+		if(isJump(i)&&k!=L->e&&i->arg.instr==codeInstrs[L->h])return false;
+		}
+	for(int k=L->h-1;k>0;k--){
+		Instr *i=codeInstrs[k];
+		if(isJump(i)||endsFlow(i))return false;
+		if(k+1<L->h&&isTarget(codeInstrs[k+1]))return false;
+		if(i->op==OP_INCFP_I&&i->arg.i==L->iv)return false;
+		if(i->op==OP_FPSTORE&&i->arg.i==L->iv){
+			if(codeInstrs[k-1]->op!=OP_PUSH_I||isTarget(i))return false;
+			*init=codeInstrs[k-1]->arg.i;
+			return true;
+			}
+		}
+	return false;
+	}
+
+// returns true if the number of iterations of a loop with a constant bound is known
+// the loops which overflow the induction variable are not considered
+static bool tripCount(CountedLoop *L,int init,long long *trips){
+	long long n=L->bound,k=init,s=L->step,t;
+	switch(L->exitOp){
+		case OP_JGE_I:t=k<n?(n-k+s-1)/s:0;break;		// k<n
+		case OP_JGT_I:t=k<=n?(n-k)/s+1:0;break;		// k<=n
+		case OP_JLE_I:t=k>n?(k-n-s-1)/-s:0;break;		// k>n
+		default:t=k>=n?(k-n)/-s+1:0;break;		// k>=n
+		}
+	if(k+t*s<INT_MIN||k+t*s>INT_MAX)return false;
+	*trips=t;
+	return true;
+	}
+
+// inserts a copy of codeInstrs[from..to] after the instruction after
+// the jumps in the copy go to the copies of their targets
+// returns the last inserted instruction
+static Instr *copyCode(Instr *after,int from,int to){
+	Instr **copies=(Instr**)safeAlloc((to-from+1)*sizeof(Instr*));
+	for(int k=from;k<=to;k++){
+		Instr *src=codeInstrs[k];
+		after=insertInstr(after,src->op);
+		after->arg=src->arg;
+		after->arg2=src->arg2;
+		after->prof=src->prof;
+		copies[k-from]=after;
+		}
+	for(int k=0;k<=to-from;k++){
+		Instr *i=copies[k];
+		if(isJump(i))i->arg.instr=copies[instrIdx(i->arg.instr)-from];
+		}
+	free(copies);
+	return after;
+	}
+
+// removes the original loop codeInstrs[h..e], which follows the instruction last
+static void delLoop(Instr *last,CountedLoop *L){
+	last->next=codeInstrs[L->e]->next;
+	for(int k=L->h;k<=L->e;k++)free(codeInstrs[k]);
+	}
+
+// replaces the loop with trips copies of its body
+// returns the last instruction which replaces the loop
+static Instr *fullyUnroll(CountedLoop *L,long long trips){
+	Instr *p=codeInstrs[L->h-1];
+	for(long long j=0;j<trips;j++)p=copyCode(p,L->body,L->e-1);
+	delLoop(p,L);
+	optStats.fullyUnrolled++;
+	return p;
+	}
+
+// inserts before the loop a loop with u copies of its body, which runs while at least u iterations remain
+// then the execution continues with rem: the original loop for the remaining iterations, or the loop exit
+// if the original loop is not needed
+// the condition for the u iterations is iv+(u-1)*step<bound, computed as iv<bound-(u-1)*step,
+// which does not overflow; limit is bound-(u-1)*step for a constant bound
+// returns the last instruction of the new loop
+static Instr *unrollLoop(Symbol *fn,CountedLoop *L,int u,int limit,bool needsRem){
+	Instr *enter=fn->fn.instr;
+	Instr *rem=needsRem?codeInstrs[L->h]:codeInstrs[L->e+1];
+	Instr *p=codeInstrs[L->h-1],*first,*test;
+	int delta=(u-1)*L->step;
+	if(L->constBound){
+		first=test=p=insertInstr(p,OP_FPLOAD);
+		p->arg.i=L->iv;
+		p=insertInstr(p,immediateBranch(L->exitOp));
+		p->arg.instr=rem;
+		p->arg2=limit;
+		}else{
+		// the limit is computed once, in a pre-header, and only if it does not overflow
+		int tmp=++enter->arg.i;
+		first=p=insertInstr(p,OP_FPLOAD);
+		p->arg.i=L->bound;
+		p=insertInstr(p,L->step>0?OP_JLTC_I:OP_JGTC_I);
+		p->arg.instr=rem;
+		p->arg2=L->step>0?INT_MIN+delta:INT_MAX+delta;
+		p=insertInstr(p,OP_FPLOAD);
+		p->arg.i=L->bound;
+		p=insertInstr(p,OP_PUSH_I);
+		p->arg.i=delta;
+		p=insertInstr(p,OP_SUB_I);
+		p=insertInstr(p,OP_FPSTORE);
+		p->arg.i=tmp;
+		test=p=insertInstr(p,OP_FPLOAD);
+		p->arg.i=L->iv;
+		p=insertInstr(p,OP_FPLOAD);
+		p->arg.i=tmp;
+		p=insertInstr(p,L->exitOp);
+		p->arg.instr=rem;
+		}
+	for(int j=0;j<u;j++)p=copyCode(p,L->body,L->e-1);
+	p=insertInstr(p,OP_JMP);
+	p->arg.instr=test;
+	ProfileData *pd=codeInstrs[L->e]->prof;
+	if(pd){
+		// the new loop runs the iterations in groups of u, the remainder loop runs less than u iterations for each entry
+		p->prof=profileNew(pd->count/u,0,pd->entries);
+		long long rem=pd->entries*(u-1);
+		codeInstrs[L->e]->prof=profileNew(pd->count<rem?pd->count:rem,0,pd->entries);
+		}
+	// the jumps from outside to the original loop go to the new loop
+	for(int k=0;k<nCode;k++){
+		Instr *i=codeInstrs[k];
+		if(isJump(i)&&(k<L->h||k>L->e)&&i->arg.instr==codeInstrs[L->h])i->arg.instr=first;
+		}
+	if(!needsRem)delLoop(p,L);
+	optStats.unrolled++;
+	return needsRem?codeInstrs[L->e]:p;
+	}
+
+void unrollLoops(Symbol *fn){
+	if(unrollFactor<2)return;
+	Instr *code=fn->fn.instr;
+	// the inner loops end before the outer ones, so they are unrolled first
+	for(Instr *i=code;i;i=i->next){
+		if(i->op!=OP_JMP)continue;
+		indexCode(code);
+		int h=instrIdx(i->arg.instr),e=instrIdx(i);
+		if(h<=0||h>=e)continue;
+		collectTargets(code);
+		CountedLoop L;
+		if(!countedLoop(h,e,&L))continue;
+		int size=e-L.body;		// the body, without the back jump
+		int u=unrollFactor,budget=unrollBudget;
+		// with a profile, the loops which were not executed or which ran less than 2 iterations for each entry
+		// are not unrolled and the hot loops are unrolled twice more, but not more than their average trip count
+		ProfileData *pd=i->prof;
+		if(pd){
+			if(!pd->entries||pd->count<2*pd->entries){
+				optStats.profColdLoops++;
+				continue;
+				}
+			if(profileHot(i)){
+				u*=2;
+				budget*=2;
+				}
+			if(u>pd->count/pd->entries)u=(int)(pd->count/pd->entries);
+			}
+		int init;
+		long long trips=0;
+		bool known=L.constBound&&loopInit(&L,&init)&&tripCount(&L,init,&trips);
+		if(known&&trips*size<=budget){
+			i=fullyUnroll(&L,trips);
+			continue;
+			}
+		while(u>1&&u*size>budget)u--;
+		if(u<2||(known&&trips<u))continue;
+		long long delta=(long long)(u-1)*L.step;
+		if(delta<-INT_MAX||delta>INT_MAX)continue;
+		long long limit=(long long)L.bound-delta;
+		if(L.constBound&&(limit<INT_MIN||limit>INT_MAX))continue;
+		i=unrollLoop(fn,&L,u,(int)limit,!known||trips%u!=0);
+		}
+	}
+
+// returns in [lo,hi] the values of the induction variable of a counted loop in its body
+// they are known only for a constant bound and a constant initial value, if the increment after the last iteration does not overflow
+static bool ivRange(CountedLoop *L,long long *lo,long long *hi){
+	int init;
+	if(!L->constBound||!loopInit(L,&init))return false;
+	switch(L->exitOp){
+		case OP_JGE_I:*lo=init;*hi=(long long)L->bound-1;break;		// iv<bound
+		case OP_JGT_I:*lo=init;*hi=L->bound;break;		// iv<=bound
+		case OP_JLE_I:*lo=(long long)L->bound+1;*hi=init;break;		// iv>bound
+		default:*lo=L->bound;*hi=init;break;		// iv>=bound
+		}
+	return *hi+L->step<=INT_MAX&&*lo+L->step>=INT_MIN;
+	}
+
+// returns true if the index used by codeInstrs[k] is iv+c, computed by FPLOAD iv, optionally followed by PUSH_I c; ADD_I or SUB_I,
+// all of them in codeInstrs[from..k-1]
+static bool ivIndex(int k,int from,int iv,long long *c){
+	Instr **p=&codeInstrs[k];
+	if(k-1>=from&&p[-1]->op==OP_FPLOAD&&p[-1]->arg.i==iv){
+		*c=0;
+		return true;
+		}
+	if(k-3<from||p[-3]->op!=OP_FPLOAD||p[-3]->arg.i!=iv||p[-2]->op!=OP_PUSH_I||isTarget(p[-2])||isTarget(p[-1]))return false;
+	if(p[-1]->op==OP_ADD_I)*c=p[-2]->arg.i;
+	else if(p[-1]->op==OP_SUB_I)*c=-(long long)p[-2]->arg.i;
+	else return false;
+	return true;
+	}
+
+void boundsChecks(Symbol *fn){
+	Instr *code=fn->fn.instr;
+	indexCode(code);
+	collectTargets(code);
+	for(int e=0;e<nCode;e++){
+		Instr *back=codeInstrs[e];
+		if(back->op!=OP_JMP)continue;
+		int h=instrIdx(back->arg.instr);
+		if(h<=0||h>=e)continue;
+		CountedLoop L;
+		long long lo,hi,c;
+		if(!countedLoop(h,e,&L)||!ivRange(&L,&lo,&hi))continue;
+		// the body, before the increment of the induction variable
+		for(int k=L.body;k<e-4;k++){
+			Instr *i=codeInstrs[k];
+			if(i->op!=OP_INDEX_CHK||isTarget(i)||!ivIndex(k,L.body,L.iv,&c))continue;
+			if(lo+c>=0&&hi+c<i->arg2){
+				i->op=OP_INDEX;
+				i->arg2=0;
+				optStats.bounds++;
+				}
+			}
+		}
+	}
+
+// a node of the expression tree of the statement from the body of a loop which can be vectorized
+typedef enum{
+	VN_ELEM,		// the address of the element iv of an array: ADDR or FPLOAD base; FPLOAD iv; INDEX size
+	VN_LOAD,		// LOAD_I or LOAD_F of an element
+	VN_SCALAR,		// a value which is the same in all the iterations: PUSH_D or FPLOAD of a slot not written in the loop
+	VN_SLOT,		// FPLOAD of a slot written in the loop
+	VN_BIN		// ADD_D, MUL_F or ADD_I
+	}VecKind;
+
+typedef struct VecNode{
+	VecKind kind;
+	Instr *i;		// the instruction which computes the node (for VN_ELEM its base)
+	int size;		// VN_ELEM: the element size
+	struct VecNode *a,*b;		// the operands
+	}VecNode;
+
+enum{MAX_VEC_NODES=16};
+static VecNode vecNodes[MAX_VEC_NODES];
+static int nVecNodes;
+
+static VecNode *vecNode(VecKind kind,Instr *i,VecNode *a,VecNode *b){
+	if(nVecNodes==MAX_VEC_NODES)return NULL;
+	VecNode *n=&vecNodes[nVecNodes++];
+	n->kind=kind;
+	n->i=i;
+	n->size=0;
+	n->a=a;
+	n->b=b;
+	return n;
+	}
+
+// returns true if the slot keeps its value in all the iterations of the loop
+static bool vecInvariantSlot(CountedLoop *L,int idx){
+	return !slotWrittenIn(idx,L->h,L->e)&&!slotAddressTaken(idx);
+	}
+
+// parses the body of the loop, without the increment, as a single statement: STORE_F; DROP or FPSTORE s
+// returns the stored value and sets *addr to the address for STORE_F or to NULL and *slot to s for FPSTORE
+static VecNode *vecStatement(CountedLoop *L,VecNode **addr,int *slot){
+	VecNode *stack[MAX_VEC_NODES];
+	int n=0;
+	nVecNodes=0;
+	for(int k=L->body;k<L->e-4;k++){
+		Instr *i=codeInstrs[k];
+		if(k>L->body&&isTarget(i))return NULL;
+		VecNode *r;
+		switch(i->op){
+			case OP_ADDR:
+			case OP_FPLOAD:
+				if(k+2<L->e-4&&codeInstrs[k+1]->op==OP_FPLOAD&&codeInstrs[k+1]->arg.i==L->iv&&codeInstrs[k+2]->op==OP_INDEX&&
+						(i->op==OP_ADDR||vecInvariantSlot(L,i->arg.i))){
+					if(!(r=vecNode(VN_ELEM,i,NULL,NULL)))return NULL;
+					r->size=codeInstrs[k+2]->arg.i;
+					k+=2;
+					}else if(i->op==OP_ADDR){
+					return NULL;
+					}else{
+					r=vecNode(vecInvariantSlot(L,i->arg.i)?VN_SCALAR:VN_SLOT,i,NULL,NULL);
+					}
+				break;
+			case OP_PUSH_D:r=vecNode(VN_SCALAR,i,NULL,NULL);break;
+			case OP_LOAD_I:
+			case OP_LOAD_F:
+				if(n<1||stack[n-1]->kind!=VN_ELEM)return NULL;
+				r=vecNode(VN_LOAD,i,stack[--n],NULL);
+				break;
+			case OP_ADD_D:
+			case OP_MUL_F:
+			case OP_ADD_I:
+				if(n<2)return NULL;
+				n-=2;
+				r=vecNode(VN_BIN,i,stack[n],stack[n+1]);
+				break;
+			case OP_STORE_F:
+				if(n!=2||stack[0]->kind!=VN_ELEM||k+2!=L->e-4||codeInstrs[k+1]->op!=OP_DROP||isTarget(codeInstrs[k+1]))return NULL;
+				*addr=stack[0];
+				return stack[1];
+			case OP_FPSTORE:
+				if(n!=1||k+1!=L->e-4)return NULL;
+				*addr=NULL;
+				*slot=i->arg.i;
+				return stack[0];
+			default:return NULL;
+			}
+		if(!r)return NULL;
+		stack[n++]=r;
+		}
+	return NULL;
+	}
+
+// returns true if the node loads a double element
+static bool isLoadF(VecNode *n){
+	return n->kind==VN_LOAD&&n->i->op==OP_LOAD_F&&n->a->size==8;
+	}
+
+// returns true if the node is bin(x,y) or bin(y,x), where x matches is and sets *x and *y
+static bool vecOperands(VecNode *n,Opcode bin,bool (*is)(VecNode*),VecNode **x,VecNode **y){
+	if(n->kind!=VN_BIN||n->i->op!=bin)return false;
+	if(is(n->b)){
+		VecNode *t=n->a;
+		*x=n->b;
+		*y=t;
+		return true;
+		}
+	*x=n->a;
+	*y=n->b;
+	return is(n->a);
+	}
+
+static bool isScalar(VecNode *n){
+	return n->kind==VN_SCALAR;
+	}
+
+// inserts after p a copy of the instruction src
+static Instr *copyInstr(Instr *p,Instr *src){
+	p=insertInstr(p,src->op);
+	p->arg=src->arg;
+	p->arg2=src->arg2;
+	return p;
+	}
+
+// inserts after p the address of the element iv, which is the first element processed by the vector instruction
+static Instr *vecElem(Instr *p,CountedLoop *L,VecNode *elem){
+	p=copyInstr(p,elem->i);
+	p=insertInstr(p,OP_FPLOAD);
+	p->arg.i=L->iv;
+	p=insertInstr(p,OP_INDEX);
+	p->arg.i=elem->size;
+	return p;
+	}
+
+// inserts after p the bound of the loop
+static Instr *vecBound(Instr *p,CountedLoop *L){
+	p=insertInstr(p,L->constBound?OP_PUSH_I:OP_FPLOAD);
+	p->arg.i=L->bound;
+	return p;
+	}
+
+// inserts after p the number of the remaining iterations: bound-iv
+static Instr *vecCount(Instr *p,CountedLoop *L){
+	p=vecBound(p,L);
+	p=insertInstr(p,OP_FPLOAD);
+	p->arg.i=L->iv;
+	return insertInstr(p,OP_SUB_I);
+	}
+
+// replaces the body of the loop with a vector instruction, if it has one of the forms (in any operand order):
+//		c[i]=a[i]+b[i] (double) -> VADD_F
+//		c[i]=a[i]+b[i]*k (double, k invariant) -> VMULADD_F
+//		s=s+a[i] (int) -> VSUM_I
+// returns the last instruction which replaces the loop, or NULL if the loop was not changed
+static Instr *vectorizeLoop(CountedLoop *L){
+	if(L->exitOp!=OP_JGE_I||L->step!=1)return NULL;
+	VecNode *addr,*v,*x,*y,*p,*q;
+	int s;
+	if(!(v=vecStatement(L,&addr,&s)))return NULL;
+	Instr *last=codeInstrs[L->body-1];
+	if(addr){
+		if(addr->size!=8||!vecOperands(v,OP_ADD_D,isLoadF,&x,&y))return NULL;
+		if(isLoadF(y)){
+			last=vecElem(last,L,addr);
+			last=vecElem(last,L,x->a);
+			last=vecElem(last,L,y->a);
+			last=insertInstr(vecCount(last,L),OP_VADD_F);
+			}else if(vecOperands(y,OP_MUL_F,isLoadF,&p,&q)&&isScalar(q)){
+			last=vecElem(last,L,addr);
+			last=vecElem(last,L,x->a);
+			last=vecElem(last,L,p->a);
+			last=copyInstr(last,q->i);
+			last=insertInstr(vecCount(last,L),OP_VMULADD_F);
+			}else return NULL;
+		}else{
+		if(s==L->iv||s==L->bound||slotAddressTaken(s)||v->kind!=VN_BIN||v->i->op!=OP_ADD_I)return NULL;
+		if(v->a->kind==VN_SLOT&&v->a->i->arg.i==s){x=v->a;y=v->b;}
+		else if(v->b->kind==VN_SLOT&&v->b->i->arg.i==s){x=v->b;y=v->a;}
+		else return NULL;
+		if(y->kind!=VN_LOAD||y->i->op!=OP_LOAD_I||y->a->size!=4)return NULL;
+		last=copyInstr(last,x->i);
+		last=vecElem(last,L,y->a);
+		last=insertInstr(vecCount(last,L),OP_VSUM_I);
+		last=insertInstr(last,OP_FPSTORE);
+		last->arg.i=s;
+		}
+	// after the loop iv==bound
+	last=vecBound(last,L);
+	last=insertInstr(last,OP_FPSTORE);
+	last->arg.i=L->iv;
+	last->next=codeInstrs[L->e+1];
+	for(int k=L->body;k<=L->e;k++)free(codeInstrs[k]);
+	optStats.vectorized++;
+	return last;
+	}
+
+void vectorize(Symbol *fn){
+	if(!vectorizeEnabled)return;
+	Instr *code=fn->fn.instr;
+	for(Instr *i=code;i;i=i->next){
+		if(i->op!=OP_JMP)continue;
+		indexCode(code);
+		int h=instrIdx(i->arg.instr),e=instrIdx(i);
+		if(h<=0||h>=e)continue;
+		collectTargets(code);
+		CountedLoop L;
+		if(!countedLoop(h,e,&L))continue;
+		Instr *last=vectorizeLoop(&L);
+		if(last)i=last;
+		}
+	}
+
+// replaces i*c with derived induction variables in the loop codeInstrs[h..e]
+static void loopInductionVars(Symbol *fn,int h,int e){
+	int iv,step;
+	if(!loopIncrement(h,e,&iv,&step))return;
+	// the loop is entered only through its header and only the first instruction of the increment can be a jump target,
+	// because the derived variables are incremented before it
+	for(int k=0;k<nCode;k++){
+		Instr *i=codeInstrs[k];
+		if(!isJump(i))continue;
+		int t=instrIdx(i->arg.instr);
+		if(((k<h||k>e)&&t>h&&t<=e)||(t>e-4&&t<=e))return;
+		}
+	enum{MAX_DERIVED=8};
+	int factors[MAX_DERIVED],slots[MAX_DERIVED],nDerived=0;
+	static const Opcode ivMul[]={OP_FPLOAD,OP_PUSH_I,OP_MUL_I},mulIv[]={OP_PUSH_I,OP_FPLOAD,OP_MUL_I};
+	for(int k=h;k+2<e-4;k++){
+		Instr *i=codeInstrs[k];
+		int c;
+		if(matchSeq(i,ivMul,3)&&i->arg.i==iv)c=i->next->arg.i;
+		else if(matchSeq(i,mulIv,3)&&i->next->arg.i==iv)c=i->arg.i;
+		else continue;
+		int j;
+		for(j=0;j<nDerived&&factors[j]!=c;j++){}
+		if(j==nDerived){
+			if(nDerived==MAX_DERIVED)continue;
+			factors[nDerived]=c;
+			slots[nDerived++]=++fn->fn.instr->arg.i;
+			}
+		i->op=OP_FPLOAD;
+		i->arg.i=slots[j];
+		i->next->op=OP_NOP;
+		i->next->next->op=OP_NOP;
+		optStats.ivMuls++;
+		k+=2;
+		}
+	if(!nDerived)return;
+	// the initial values, in a pre-header
+	Instr *p=codeInstrs[h-1];
+	for(int j=0;j<nDerived;j++){
+		p=insertInstr(p,OP_FPLOAD);
+		p->arg.i=iv;
+		p=insertInstr(p,OP_PUSH_I);
+		p->arg.i=factors[j];
+		p=insertInstr(p,OP_MUL_I);
+		p=insertInstr(p,OP_FPSTORE);
+		p->arg.i=slots[j];
+		}
+	Instr *pre=codeInstrs[h-1]->next;
+	// the increments, before the increment of iv
+	Instr *inc=codeInstrs[e-4],*first=NULL;
+	p=codeInstrs[e-5];
+	for(int j=0;j<nDerived;j++){
+		p=insertInstr(p,OP_FPLOAD);
+		p->arg.i=slots[j];
+		if(!first)first=p;
+		p=insertInstr(p,OP_PUSH_I);
+		p->arg.i=(int)((unsigned)factors[j]*(unsigned)step);
+		p=insertInstr(p,OP_ADD_I);
+		p=insertInstr(p,OP_FPSTORE);
+		p->arg.i=slots[j];
+		}
+	for(int k=0;k<nCode;k++){
+		Instr *i=codeInstrs[k];
+		if(!isJump(i))continue;
+		if((k<h||k>e)&&i->arg.instr==codeInstrs[h])i->arg.instr=pre;
+		else if(i->arg.instr==inc)i->arg.instr=first;
+		}
+	}
+
+void inductionVars(Symbol *fn){
+	Instr *code=fn->fn.instr;
+	for(Instr *i=code;i;i=i->next){
+		if(i->op!=OP_JMP)continue;
+		indexCode(code);
+		int h=instrIdx(i->arg.instr),e=instrIdx(i);
+		if(h>0&&h<e){
+			collectTargets(code);
+			loopInductionVars(fn,h,e);
+			}
+		}
+	delNops(code);
+	}
+
+// returns k if c=2^k, else -1
+static int log2Exact(int c){
+	if(c<=0||(c&(c-1)))return -1;
+	int k=0;
+	while(c>1){
+		c>>=1;
+		k++;
+		}
+	return k;
+	}
+
+// computes the magic number and the shift for the signed division by d>=2 (Hacker's Delight, 10-1)
+static void magicDiv(int d,int *magic,int *shift){
+	const unsigned two31=0x80000000u;
+	unsigned ad=(unsigned)d;
+	unsigned anc=two31-1-two31%ad;		// the absolute value of nc
+	int p=31;
+	unsigned q1=two31/anc,r1=two31-q1*anc;		// 2^p/|nc| and its remainder
+	unsigned q2=two31/ad,r2=two31-q2*ad;		// 2^p/|d| and its remainder
+	unsigned delta;
+	do{
+		p++;
+		q1*=2;
+		r1*=2;
+		if(r1>=anc){
+			q1++;
+			r1-=anc;
+			}
+		q2*=2;
+		r2*=2;
+		if(r2>=ad){
+			q2++;
+			r2-=ad;
+			}
+		delta=ad-r2;
+		}while(q1<delta||(q1==delta&&r1==0));
+	*magic=(int)(q2+1);
+	*shift=p-32;
+	}
+
+void strengthReduce(Symbol *fn){
+	Instr *code=fn->fn.instr;
+	collectTargets(code);
+	static const Opcode cMul[]={OP_PUSH_I,OP_FPLOAD,OP_MUL_I},mulC[]={OP_PUSH_I,OP_MUL_I},divC[]={OP_PUSH_I,OP_DIV_I};
+	for(Instr *i=code;i;i=i->next){
+		if(matchSeq(i,cMul,3)){		// c*x -> x*c
+			int c=i->arg.i;
+			i->op=OP_FPLOAD;
+			i->arg.i=i->next->arg.i;
+			i=i->next;
+			i->op=OP_PUSH_I;
+			i->arg.i=c;
+			}
+		bool mul=matchSeq(i,mulC,2);
+		if(!mul&&!matchSeq(i,divC,2))continue;
+		int c=i->arg.i,k=log2Exact(c);
+		if(c==1){
+			i->op=OP_NOP;
+			}else if(k>0){
+			i->op=mul?OP_SHL_I:OP_SHR_I;
+			i->arg.i=k;
+			}else if(mul){
+			i->op=OP_MULC_I;
+			}else if(c>=2){
+			i->op=OP_DIVM_I;
+			magicDiv(c,&i->arg.i,&i->arg2);
+			}else{
+			continue;		// 0 and the negative divisors remain DIV_I
+			}
+		i->next->op=OP_NOP;
+		optStats.strength++;
+		}
+	delNops(code);
+	}
+
+// replaces the back jump codeInstrs[e] of the loop codeInstrs[h..e] with a copy of the loop test,
+// whose jump is negated, so it jumps to the body and it continues after the loop
+// the loop test reads only values (at most 4 instructions) and it ends with a conditional jump after the loop
+static bool rotateLoop(int h,int e){
+	int b;
+	for(b=h;b<e&&b-h<4;b++){
+		Opcode op=codeInstrs[b]->op;
+		if(op!=OP_FPLOAD&&op!=OP_PUSH_I&&op!=OP_PUSH_D&&op!=OP_ADDR&&op!=OP_LOAD_I&&op!=OP_LOAD_F&&op!=OP_LOAD_C)break;
+		}
+	Instr *br=codeInstrs[b];
+	Opcode neg=negatedJump(br->op);
+	if(neg==OP_NOP||b+1>=e||e+1>=nCode||br->arg.instr!=codeInstrs[e+1])return false;
+	for(int k=h+1;k<=b;k++){
+		if(isTarget(codeInstrs[k]))return false;
+		}
+	// the back jump becomes the first instruction of the copy, so the jumps to it remain valid
+	Instr *p=codeInstrs[e];
+	for(int k=h;k<=b;k++){
+		Instr *src=codeInstrs[k];
+		if(k>h)p=insertInstr(p,src->op);
+		p->op=src->op;
+		p->arg=src->arg;
+		p->arg2=src->arg2;
+		p->prof=NULL;
+		}
+	p->op=neg;
+	p->arg.instr=codeInstrs[b+1];
+	optStats.profRotated++;
+	return true;
+	}
+
+void layoutCode(Symbol *fn){
+	Instr *code=fn->fn.instr;
+	// the loops are rotated before the blocks are reordered, while their exit follows their back jump
+	if(profileUse){
+		indexCode(code);
+		collectTargets(code);
+		for(int k=1;k<nCode;k++){
+			Instr *i=codeInstrs[k];
+			ProfileData *pd=i->prof;
+			if(i->op!=OP_JMP||!pd||!pd->entries||pd->count<2*pd->entries)continue;
+			int h=instrIdx(i->arg.instr);
+			if(h>0&&h<k&&rotateLoop(h,k)){
+				indexCode(code);
+				collectTargets(code);
+				}
+			}
+		}
+	Cfg *g=cfgBuild(fn);
+	if(cfgLayout(g))delNops(code);
+	cfgFree(g);
+	}
+
+// a function is pure if it accesses only its own frame: it has only scalar parameters, it does not take
+// the address of a global variable, it does not call extern functions and it calls only pure functions
+// a function can call only itself and the functions defined before it, so their purity is already known
+static bool inferPure(Symbol *fn){
+	for(Symbol *p=fn->fn.params;p;p=p->next){
+		if(p->type.tb==TB_STRUCT||p->type.n>=0)return false;
+		}
+	for(Instr *i=fn->fn.instr;i;i=i->next){
+		switch(i->op){
+			case OP_ADDR:
+			case OP_CALL_EXT:
+			case OP_VADD_F:
+			case OP_VMULADD_F:
+				return false;
+			case OP_CALL:
+			case OP_TAILCALL:{
+				if(i->arg.instr==fn->fn.instr)break;
+				Symbol *callee=findFn(i);
+				if(!callee||!callee->fn.pure)return false;
+				break;
+				}
+			default:break;
+			}
+		}
+	return true;
+	}
+
+void optimizeFn(Symbol *fn){
+	optStats.instrBefore+=countInstr(fn->fn.instr);
+	// the optimizations keep the purity, so it is inferred before them and the calls of fn can be optimized
+	// by cse and licm in the functions defined after it
+	fn->fn.pure=inferPure(fn);
+	if(fn->fn.pure)optStats.pureFns++;
+	if(profileUse&&profileAttach(fn))optStats.profFns++;
+	if(optLevel>=2){
+		inlineCalls(fn);
+		}
+	if(optLevel>=1){
+		peephole(fn);
+		dce(fn);
+		// the removed code can leave jumps to the next instruction
+		peephole(fn);
+		if(ssaEnabled){
+			ssaOptimize(fn);
+			peephole(fn);
+			}
+		tailCalls(fn);
+		}
+	if(optLevel>=2){
+		boundsChecks(fn);
+		vectorize(fn);
+		cse(fn);
+		licm(fn);
+		inductionVars(fn);
+		unrollLoops(fn);
+		strengthReduce(fn);
+		layoutCode(fn);
+		superinstr(fn);
+		}
+	optStats.instrAfter+=countInstr(fn->fn.instr);
+	}
+
+void treeShake(Symbol *fnMain){
+	Domain *d=globalDomain();
+	// the called functions, which are also used as a worklist
+	int nReached=0,capReached=symbolsLen(d->symbols);
+	Symbol **reached=(Symbol**)safeAlloc(capReached*sizeof(Symbol*));
+	reached[nReached++]=fnMain;
+	for(int k=0;k<nReached;k++){
+		for(Instr *i=reached[k]->fn.instr;i;i=i->next){
+			if(i->op!=OP_CALL&&i->op!=OP_TAILCALL)continue;
+			Symbol *callee=findFn(i);
+			if(!callee)continue;
+			int j;
+			for(j=0;j<nReached&&reached[j]!=callee;j++){}
+			if(j==nReached)reached[nReached++]=callee;
+			}
+		}
+	for(Symbol **ps=&d->symbols;*ps;){
+		Symbol *s=*ps;
+		bool used=s->kind!=SK_FN||s->fn.extFnPtr;
+		for(int j=0;!used&&j<nReached;j++){
+			if(reached[j]==s)used=true;
+			}
+		if(used){
+			ps=&s->next;
+			continue;
+			}
+		int n=countInstr(s->fn.instr);
+		delInstrAfter(s->fn.instr);
+		free(s->fn.instr);
+		optStats.deadFns++;
+		optStats.deadFnsInstr+=n;
+		optStats.instrAfter-=n;
+		*ps=s->next;
+		freeSymbol(s);
+		}
+	free(reached);
+	}
+
+typedef struct{		// a global variable, for layoutData and constGlobals
+	Symbol *var;
+	int oldOffset;
+	int refs;		// the number of ADDR instructions which point into it
+	}DataVar;
+
+static int cmpDataVarRefs(const void *a,const void *b){
+	const DataVar *x=(const DataVar*)a,*y=(const DataVar*)b;
+	if(x->refs!=y->refs)return x->refs>y->refs?-1:1;
+	return x->oldOffset-y->oldOffset;
+	}
+
+// the global whose old offset range contains offset, from vars sorted by the old offsets
+// an offset after the end of a variable (ex: a constant index out of bounds) belongs to it
+static DataVar *dataVarAt(DataVar *vars,int nVars,int offset){
+	int lo=0,hi=nVars-1;
+	while(lo<hi){
+		int mid=(lo+hi+1)/2;
+		if(vars[mid].oldOffset<=offset)lo=mid;
+		else hi=mid-1;
+		}
+	return &vars[lo];
+	}
+
+void layoutData(){
+	Domain *d=globalDomain();
+	int nVars=0;
+	for(Symbol *s=d->symbols;s;s=s->next)nVars+=s->kind==SK_VAR;
+	if(!nVars)return;
+	DataVar *vars=(DataVar*)safeAlloc(nVars*sizeof(DataVar));
+	nVars=0;
+	// the globals are allocated in the order of their definitions
+	for(Symbol *s=d->symbols;s;s=s->next){
+		if(s->kind==SK_VAR)vars[nVars++]=(DataVar){s,s->dataOffset,0};
+		}
+	for(Symbol *s=d->symbols;s;s=s->next){
+		if(s->kind!=SK_FN||s->fn.extFnPtr)continue;
+		for(Instr *i=s->fn.instr;i;i=i->next){
+			if(i->op==OP_ADDR)dataVarAt(vars,nVars,i->arg.i)->refs++;
+			}
+		}
+	// the new order: the used scalars, the most used first, then the arrays and the structs, then the unused scalars
+	DataVar *order=(DataVar*)safeAlloc(nVars*sizeof(DataVar));
+	int n=0;
+	for(int k=0;k<nVars;k++){
+		Type *t=&vars[k].var->type;
+		if(vars[k].refs&&t->n<0&&t->tb!=TB_STRUCT)order[n++]=vars[k];
+		}
+	qsort(order,n,sizeof(DataVar),cmpDataVarRefs);
+	for(int k=0;k<nVars;k++){
+		Type *t=&vars[k].var->type;
+		if(t->n>=0||t->tb==TB_STRUCT)order[n++]=vars[k];
+		}
+	for(int k=0;k<nVars;k++){
+		Type *t=&vars[k].var->type;
+		if(!vars[k].refs&&t->n<0&&t->tb!=TB_STRUCT)order[n++]=vars[k];
+		}
+	dataSize=0;
+	for(int k=0;k<nVars;k++){
+		Symbol *v=order[k].var;
+		v->dataOffset=dataAlloc(typeSize(&v->type),typeAlign(&v->type));
+		if(v->dataOffset!=order[k].oldOffset)optStats.globalsMoved++;
+		}
+	for(Symbol *s=d->symbols;s;s=s->next){
+		if(s->kind!=SK_FN||s->fn.extFnPtr)continue;
+		for(Instr *i=s->fn.instr;i;i=i->next){
+			if(i->op!=OP_ADDR)continue;
+			DataVar *v=dataVarAt(vars,nVars,i->arg.i);
+			i->arg.i+=v->var->dataOffset-v->oldOffset;
+			}
+		}
+	free(order);
+	free(vars);
+	}
+
+// returns the instruction which takes from stack the value pushed by i and in depth the number of values above it
+// returns NULL if it is not found before a jump, a jump target or an instruction with an unknown stack effect
+static Instr *consumerOf(Instr *i,int *depth){
+	int d=0;
+	for(Instr *c=i->next;c;c=c->next){
+		int pops,pushes;
+		if(isTarget(c)||!stackEffect(c,&pops,&pushes))return NULL;
+		if(pops>d){
+			*depth=d;
+			return c;
+			}
+		if(isJump(c))return NULL;
+		d+=pushes-pops;
+		}
+	return NULL;
+	}
+
+// the struct array transformed by soaLayout
+static Symbol *soaVar;
+static int soaN,soaSize;
+
+enum{SOA_ARG,SOA_NOP,SOA_INDEX,SOA_NONE};
+
+typedef struct{		// a change of the code, applied only if all the accesses of soaVar can be changed
+	Symbol *fn;
+	Instr *i;
+	int kind;		// SOA_ARG: i->arg.i=arg, SOA_NOP: i becomes NOP, SOA_INDEX: FPLOAD t -> ADDR arg; FPLOAD t; INDEX arg2
+	int arg,arg2;
+	int slot;		// for the stores and the loads of a slot, its index in soaSlots, else -1
+	}SoaEdit;
+
+static SoaEdit *soaEdits;
+static int nSoaEdits,capSoaEdits;
+
+typedef struct{		// a local variable in which cse saved the address of an element of soaVar, or of a field of it
+	int idx;
+	int offset;		// the offset of the saved address in the element
+	int stores;		// the number of its FPSTOREs
+	}SoaSlot;
+
+static SoaSlot *soaSlots;
+static int nSoaSlots,capSoaSlots;
+
+static void soaEdit(Symbol *fn,Instr *i,int kind,int arg,int arg2){
+	soaEdits=(SoaEdit*)growArray(soaEdits,&capSoaEdits,nSoaEdits+1,64,sizeof(SoaEdit));
+	soaEdits[nSoaEdits++]=(SoaEdit){fn,i,kind,arg,arg2,-1};
+	}
+
+// the member of the struct of soaVar which contains the byte at offset
+static Symbol *soaField(int offset){
+	Symbol *m=soaVar->type.s->structMembers;
+	while(m->next&&m->next->varIdx<=offset)m=m->next;
+	return m;
+	}
+
+// the offset of the array of the field f in soaVar
+static int soaFieldArray(Symbol *f){
+	return soaVar->dataOffset+soaN*f->varIdx;
+	}
+
+// returns true if the address pushed by i, which is at rem bytes in the field f of an element, is used only
+// to access that field: it is the address of a load or a store inside the field, or the field is an array which is indexed
+static bool soaFieldUse(Instr *i,Symbol *f,int rem){
+	int d,access,addrDepth=0;
+	Instr *c=consumerOf(i,&d);
+	if(!c)return false;
+	switch(c->op){
+		case OP_LOAD_C:access=1;break;
+		case OP_LOAD_I:access=sizeof(int);break;
+		case OP_LOAD_F:access=sizeof(double);break;
+		case OP_STORE_C:access=1;addrDepth=1;break;
+		case OP_STORE_I:access=sizeof(int);addrDepth=1;break;
+		case OP_STORE_F:access=sizeof(double);addrDepth=1;break;
+		case OP_INDEX:
+		case OP_INDEX_CHK:
+			return d==1&&f->type.n>0&&rem==0;
+		default:return false;
+		}
+	return d==addrDepth&&rem+access<=typeSize(&f->type);
+	}
+
+// the address pushed by i (INDEX or FPLOAD of a slot), at o bytes in an element, is followed by optional OFFSETs
+// returns the field, or NULL if the address is not used only to access a field
+// the first OFFSET is changed to the offset in the field and the others to 0
+static Symbol *soaFieldOf(Symbol *fn,Instr *i,int o){
+	int d;
+	Instr *c=consumerOf(i,&d),*last=i;
+	for(;c&&c->op==OP_OFFSET&&d==0;c=consumerOf(c,&d)){
+		o+=c->arg.i;
+		last=c;
+		}
+	if(o<0||o>=soaSize)return NULL;
+	Symbol *f=soaField(o);
+	int rem=o-f->varIdx;
+	if(!soaFieldUse(last,f,rem))return NULL;
+	for(c=i;c!=last;rem=0){
+		c=consumerOf(c,&d);
+		soaEdit(fn,c,SOA_ARG,rem,0);
+		}
+	return f;
+	}
+
+// ADDR base; ...; INDEX size: the address of an element with a computed index
+static bool soaElement(Symbol *fn,Instr *addr,Instr *index){
+	int d,o=0;
+	Instr *offset=NULL,*c=consumerOf(index,&d);
+	if(c&&c->op==OP_OFFSET&&d==0){
+		offset=c;
+		o=c->arg.i;
+		c=consumerOf(c,&d);
+		}
+	if(c&&c->op==OP_FPSTORE&&d==0&&c->arg.i>0&&index->op==OP_INDEX){
+		// the address is saved in a local variable by cse, which will keep the index instead
+		int k;
+		for(k=0;k<nSoaSlots&&soaSlots[k].idx!=c->arg.i;k++){}
+		if(k==nSoaSlots){
+			soaSlots=(SoaSlot*)growArray(soaSlots,&capSoaSlots,nSoaSlots+1,8,sizeof(SoaSlot));
+			soaSlots[k]=(SoaSlot){c->arg.i,o,0};
+			nSoaSlots++;
+			}
+		if(soaSlots[k].offset!=o)return false;
+		soaSlots[k].stores++;
+		// the arg of the NOPs is the role of the instruction, for the slots whose address is kept (see soaAnalyze)
+		soaEdit(fn,addr,SOA_NOP,0,0);
+		soaEdits[nSoaEdits-1].slot=k;
+		soaEdit(fn,index,SOA_NOP,1,0);
+		soaEdits[nSoaEdits-1].slot=k;
+		if(offset){
+			soaEdit(fn,offset,SOA_NOP,2,0);
+			soaEdits[nSoaEdits-1].slot=k;
+			}
+		return true;
+		}
+	Symbol *f=soaFieldOf(fn,index,0);
+	if(!f)return false;
+	soaEdit(fn,addr,SOA_ARG,soaFieldArray(f),0);
+	soaEdit(fn,index,SOA_ARG,typeSize(&f->type),0);
+	return true;
+	}
+
+// returns true if all the accesses of soaVar from fn go through a field and adds their changes to soaEdits
+static bool soaAnalyze(Symbol *fn){
+	int base=soaVar->dataOffset,rem,first=nSoaEdits;
+	collectTargets(fn->fn.instr);
+	nSoaSlots=0;
+	for(Instr *i=fn->fn.instr;i;i=i->next){
+		if(i->op!=OP_ADDR||i->arg.i<base||i->arg.i>=base+soaN*soaSize)continue;
+		int off=i->arg.i-base,d;
+		Instr *c=consumerOf(i,&d);
+		if(c&&(c->op==OP_INDEX||c->op==OP_INDEX_CHK)&&d==1&&off==0&&c->arg.i==soaSize){
+			if(!soaElement(fn,i,c))return false;
+			continue;
+			}
+		// a constant element: ADDR base+k*size+offset, with the OFFSETs which follow it (-O0) added to its address
+		Instr *last=i;
+		while(c&&c->op==OP_OFFSET&&d==0){
+			off+=c->arg.i;
+			soaEdit(fn,c,SOA_ARG,0,0);
+			last=c;
+			c=consumerOf(c,&d);
+			}
+		if(off>=soaN*soaSize)return false;
+		int k=off/soaSize;
+		Symbol *f=soaField(off%soaSize);
+		rem=off%soaSize-f->varIdx;
+		if(!soaFieldUse(last,f,rem))return false;
+		soaEdit(fn,i,SOA_ARG,soaFieldArray(f)+k*typeSize(&f->type)+rem,0);
+		}
+	// the slots must be written only with the element addresses and each load of them must access a field
+	for(int k=0;k<nSoaSlots;k++){
+		int t=soaSlots[k].idx,stores=0;
+		Symbol *field=NULL;		// the field of all the loads, or NULL if they access different fields
+		bool same=true;
+		for(Instr *i=fn->fn.instr;i;i=i->next){
+			switch(i->op){
+				case OP_FPSTORE:
+					stores+=i->arg.i==t;
+					break;
+				case OP_FPADDR_I:
+				case OP_FPADDR_F:
+				case OP_INCFP_I:
+					if(i->arg.i==t)return false;
+					break;
+				case OP_ADDFP_I:
+					if(i->arg.i==t||i->arg2==t)return false;
+					break;
+				case OP_FPLOAD:{
+					if(i->arg.i!=t)break;
+					Symbol *f=soaFieldOf(fn,i,soaSlots[k].offset);
+					if(!f)return false;
+					same=same&&(!field||field==f);
+					field=f;
+					soaEdit(fn,i,SOA_INDEX,soaFieldArray(f),typeSize(&f->type));
+					soaEdits[nSoaEdits-1].slot=k;
+					break;
+					}
+				default:break;
+				}
+			}
+		if(stores!=soaSlots[k].stores)return false;
+		// if all the loads access the same field, the slot keeps the address of the field of the element
+		if(!same||!field||soaSlots[k].offset!=field->varIdx)continue;
+		for(int j=first;j<nSoaEdits;j++){
+			SoaEdit *e=&soaEdits[j];
+			if(e->slot!=k)continue;
+			if(e->kind==SOA_INDEX)e->kind=SOA_NONE;
+			else{
+				int role=e->arg;
+				e->kind=SOA_ARG;
+				e->arg=role==0?soaFieldArray(field):(role==1?typeSize(&field->type):0);
+				}
+			}
+		}
+	return true;
+	}
+
+void soaLayout(){
+	Domain *d=globalDomain();
+	for(Symbol *v=d->symbols;v;v=v->next){
+		if(v->kind!=SK_VAR||v->type.tb!=TB_STRUCT||v->type.n<2)continue;
+		soaVar=v;
+		soaN=v->type.n;
+		Type t=v->type;
+		t.n=-1;
+		soaSize=typeSize(&t);
+		nSoaEdits=0;
+		bool ok=true;
+		for(Symbol *s=d->symbols;ok&&s;s=s->next){
+			if(s->kind==SK_FN&&!s->fn.extFnPtr)ok=soaAnalyze(s);
+			}
+		if(!ok)continue;
+		optStats.soaArrays++;
+		for(int k=0;k<nSoaEdits;k++){
+			SoaEdit *e=&soaEdits[k];
+			switch(e->kind){
+				case SOA_ARG:
+					e->i->arg.i=e->arg;
+					break;
+				case SOA_NOP:
+					e->i->op=OP_NOP;
+					break;
+				case SOA_NONE:
+					continue;
+				case SOA_INDEX:{
+					int t=e->i->arg.i;
+					e->i->op=OP_ADDR;
+					e->i->arg.i=e->arg;
+					Instr *load=insertInstr(e->i,OP_FPLOAD);
+					load->arg.i=t;
+					insertInstr(load,OP_INDEX)->arg.i=e->arg2;
+					optStats.instrAfter+=2;
+					break;
+					}
+				}
+			optStats.soaEdits++;
+			}
+		// the NOPs and the OFFSETs 0 are removed
+		for(int k=0;k<nSoaEdits&&optLevel>=1;k++){
+			Symbol *fn=soaEdits[k].fn;
+			if(k&&soaEdits[k-1].fn==fn)continue;
+			int n=countInstr(fn->fn.instr);
+			peephole(fn);
+			optStats.instrAfter+=countInstr(fn->fn.instr)-n;
+			}
+		}
+	free(soaEdits);
+	free(soaSlots);
+	soaEdits=NULL;
+	soaSlots=NULL;
+	nSoaEdits=capSoaEdits=nSoaSlots=capSoaSlots=0;
+	}
+
+// returns the load of the whole scalar variable v, if it follows the instruction addr (ADDR), else NULL
+static Instr *loadOf(Instr *addr,Symbol *v){
+	Instr *load=addr->next;
+	if(addr->arg.i!=v->dataOffset||!load||isTarget(load)||v->type.n>=0)return NULL;
+	switch(v->type.tb){
+		case TB_INT:return load->op==OP_LOAD_I?load:NULL;
+		case TB_DOUBLE:return load->op==OP_LOAD_F?load:NULL;
+		case TB_CHAR:return load->op==OP_LOAD_C?load:NULL;
+		default:return NULL;
+		}
+	}
+
+void constGlobals(){
+	Domain *d=globalDomain();
+	int nVars=0;
+	for(Symbol *s=d->symbols;s;s=s->next)nVars+=s->kind==SK_VAR;
+	if(!nVars)return;
+	// here refs counts the ADDR instructions which are not followed by a load of their whole variable:
+	// its address can be used for a write
+	DataVar *vars=(DataVar*)safeAlloc(nVars*sizeof(DataVar));
+	nVars=0;
+	for(Symbol *s=d->symbols;s;s=s->next){
+		if(s->kind==SK_VAR)vars[nVars++]=(DataVar){s,s->dataOffset,0};
+		}
+	for(Symbol *s=d->symbols;s;s=s->next){
+		if(s->kind!=SK_FN||s->fn.extFnPtr)continue;
+		collectTargets(s->fn.instr);
+		for(Instr *i=s->fn.instr;i;i=i->next){
+			if(i->op!=OP_ADDR)continue;
+			DataVar *v=dataVarAt(vars,nVars,i->arg.i);
+			if(!loadOf(i,v->var))v->refs++;
+			}
+		}
+	bool *used=(bool*)safeAlloc(nVars*sizeof(bool));
+	memset(used,0,nVars*sizeof(bool));
+	for(Symbol *s=d->symbols;s;s=s->next){
+		if(s->kind!=SK_FN||s->fn.extFnPtr)continue;
+		collectTargets(s->fn.instr);
+		bool changed=false;
+		for(Instr *i=s->fn.instr;i;i=i->next){
+			if(i->op!=OP_ADDR)continue;
+			DataVar *v=dataVarAt(vars,nVars,i->arg.i);
+			Instr *load=loadOf(i,v->var);
+			if(v->refs||!load)continue;
+			// the global is never written, so it keeps the 0 from dataInit
+			if(v->var->type.tb==TB_DOUBLE){
+				i->op=OP_PUSH_D;
+				i->arg.f=0;
+				}else{
+				i->op=OP_PUSH_I;
+				i->arg.i=0;
+				}
+			load->op=OP_NOP;
+			used[v-vars]=true;
+			optStats.constLoads++;
+			changed=true;
+			}
+		if(changed){
+			// the conditions which depend on the constants are folded and their dead branches are removed
+			int n=countInstr(s->fn.instr);
+			peephole(s);
+			dce(s);
+			peephole(s);
+			optStats.instrAfter+=countInstr(s->fn.instr)-n;
+			}
+		}
+	for(int k=0;k<nVars;k++)optStats.constGlobals+=used[k];
+	free(used);
+	free(vars);
+	}
+
+void linkOptimize(){
+	// the calls of each function are consecutive in linkCalls
+	for(int k=0,n;k<nLinkCalls;k+=n){
+		Symbol *fn=linkCallers[k];
+		for(n=1;k+n<nLinkCalls&&linkCallers[k+n]==fn;n++){}
+		int inlined=optStats.inlined,nInstr=countInstr(fn->fn.instr);
+		inlineCallsIn(fn,linkCalls+k,n);
+		if(optStats.inlined==inlined)continue;
+		optStats.importedInlined+=optStats.inlined-inlined;
+		peephole(fn);
+		dce(fn);
+		peephole(fn);
+		optStats.instrAfter+=countInstr(fn->fn.instr)-nInstr;
+		}
+	// the functions which call pure functions from other modules can be pure
+	for(bool changed=true;changed;){
+		changed=false;
+		for(Symbol *s=globalDomain()->symbols;s;s=s->next){
+			if(s->kind!=SK_FN||s->fn.extFnPtr||s->fn.pure||!inferPure(s))continue;
+			s->fn.pure=true;
+			optStats.pureFns++;
+			changed=true;
+			}
+		}
+	constGlobals();
+	}
+
+typedef struct{		// a call with constant arguments, for specializeCalls
+	Symbol *caller;
+	Instr *call;
+	Symbol *callee;
+	// args[k] is the PUSH_I or PUSH_D which is the whole code of the argument k,
+	// if it is a constant which can replace its parameter, else NULL
+	Instr **args;
+	long long weight;		// 1, or the execution count of the call from the profile
+	int group;		// the calls with the same callee and the same constant arguments are in the same group
+	}SpecCall;
+
+// sets readOnly[k] to true if the parameter k of fn is never written and its address is never taken,
+// so all its loads give the value of the argument
+static void readOnlyParams(Symbol *fn,int nParams,bool *readOnly){
+	for(int k=0;k<nParams;k++)readOnly[k]=true;
+	for(Instr *i=fn->fn.instr->next;i;i=i->next){
+		switch(i->op){
+			case OP_FPSTORE:
+			case OP_FPADDR_I:
+			case OP_FPADDR_F:
+			case OP_INCFP_I:
+				if(i->arg.i<0)readOnly[i->arg.i+nParams+1]=false;		// a parameter: idx=paramIdx-nParams-1
+				break;
+			default:break;
+			}
+		}
+	}
+
+// finds the constant arguments of the call codeInstrs[c] (see indexCode): args[k] is set to the PUSH_I or PUSH_D
+// which is the whole code of the argument k, or to NULL
+// the arguments are delimited from the last one, by their stack effects, until one of them contains a jump or a jump target
+static void constArgs(int c,int nParams,Instr **args){
+	for(int k=0;k<nParams;k++)args[k]=NULL;
+	// a jump to the call or into its arguments comes with other values on the stack (like the value of a && b)
+	// only the first instruction of the first argument can be a jump target
+	if(isTarget(codeInstrs[c]))return;
+	int j=c-1;
+	for(int k=nParams-1;k>=0;k--){
+		int end=j,need=1;		// the values of the argument which are pushed before codeInstrs[j]
+		for(;;j--){
+			if(j<1)return;		// ENTER
+			Instr *i=codeInstrs[j];
+			int pops,pushes;
+			if(isJump(i)||!stackEffect(i,&pops,&pushes)||pushes>need)return;
+			need+=pops-pushes;
+			if(isTarget(i)&&(need||k))return;
+			if(!need)break;
+			}
+		Instr *push=codeInstrs[j--];
+		if(j+1==end&&(push->op==OP_PUSH_I||push->op==OP_PUSH_D))args[k]=push;
+		}
+	}
+
+// returns true if the calls a and b have the same constant arguments
+static bool sameConstArgs(SpecCall *a,SpecCall *b,int nParams){
+	for(int k=0;k<nParams;k++){
+		Instr *x=a->args[k],*y=b->args[k];
+		if(!x||!y){
+			if(x!=y)return false;
+			}else if(x->op!=y->op||(x->op==OP_PUSH_I?x->arg.i!=y->arg.i:memcmp(&x->arg.f,&y->arg.f,sizeof(double)))){
+			return false;
+			}
+		}
+	return true;
+	}
+
+// returns the new FP index of a parameter or a local variable of a function specialized by specializeFn
+static int specializedIdx(int idx,int nParams,const int *newIdx){
+	return idx<0?newIdx[idx+nParams+1]:idx;
+	}
+
+// returns a copy of callee, whose parameters with the constant arguments args[k]!=NULL are replaced by their values
+// and removed from its frame, and whose code is folded with the constants
+static Symbol *specializeFn(Symbol *callee,Instr **args,int nth){
+	int nParams=symbolsLen(callee->fn.params),newN=0;
+	char *name=(char*)safeAlloc(strlen(callee->name)+12);
+	sprintf(name,"%s.%d",callee->name,nth);
+	Symbol *fn=newSymbol(name,SK_FN);
+	fn->type=callee->type;
+	fn->fn.pure=callee->fn.pure;
+	for(Symbol *p=callee->fn.params;p;p=p->next){
+		if(args[p->paramIdx])continue;
+		Symbol *q=addSymbolToList(&fn->fn.params,dupSymbol(p));
+		q->owner=fn;
+		q->paramIdx=newN++;
+		}
+	for(Symbol *v=callee->fn.locals;v;v=v->next){
+		addSymbolToList(&fn->fn.locals,dupSymbol(v))->owner=fn;
+		}
+	// the remaining parameters keep their order, before the return address
+	int *newIdx=(int*)safeAlloc((nParams+1)*sizeof(int));
+	for(int k=0,m=0;k<nParams;k++)newIdx[k]=args[k]?0:m++-newN-1;		// 0 for the removed parameters
+	indexCode(callee->fn.instr);
+	Instr **copies=(Instr**)safeAlloc(nCode*sizeof(Instr*));
+	Instr *last=NULL;
+	for(int k=0;k<nCode;k++){
+		Instr *src=codeInstrs[k];
+		last=last?insertInstr(last,src->op):addInstr(&fn->fn.instr,src->op);
+		last->arg=src->arg;
+		last->arg2=src->arg2;
+		last->prof=src->prof;
+		copies[k]=last;
+		}
+	for(int k=0;k<nCode;k++){
+		Instr *i=copies[k];
+		switch(i->op){
+			case OP_ENTER:
+			case OP_TAILCALL:
+				i->arg2=newN;
+				break;
+			case OP_RET:
+			case OP_RET_VOID:
+				i->arg.i=newN;
+				break;
+			case OP_FPLOAD:
+				if(i->arg.i<0&&args[i->arg.i+nParams+1]){
+					Instr *c=args[i->arg.i+nParams+1];
+					i->op=c->op;
+					i->arg=c->arg;
+					break;
+					}
+				i->arg.i=specializedIdx(i->arg.i,nParams,newIdx);
+				break;
+			case OP_FPSTORE:
+			case OP_FPADDR_I:
+			case OP_FPADDR_F:
+			case OP_FPADDR:
+			case OP_INCFP_I:
+				i->arg.i=specializedIdx(i->arg.i,nParams,newIdx);
+				break;
+			case OP_ADDFP_I:{
+				Instr *a=i->arg.i<0?args[i->arg.i+nParams+1]:NULL;
+				Instr *b=i->arg2<0?args[i->arg2+nParams+1]:NULL;
+				if(a&&b){
+					i->op=OP_PUSH_I;
+					i->arg.i=(int)((unsigned)a->arg.i+(unsigned)b->arg.i);
+					}else if(a||b){
+					// FP[x]+c -> FPLOAD x; ADDC_I c
+					int x=a?i->arg2:i->arg.i;
+					i->op=OP_FPLOAD;
+					i->arg.i=specializedIdx(x,nParams,newIdx);
+					insertInstr(i,OP_ADDC_I)->arg.i=(a?a:b)->arg.i;
+					}else{
+					i->arg.i=specializedIdx(i->arg.i,nParams,newIdx);
+					i->arg2=specializedIdx(i->arg2,nParams,newIdx);
+					}
+				break;
+				}
+			default:
+				if(isJump(i))i->arg.instr=copies[instrIdx(i->arg.instr)];
+			}
+		}
+	free(copies);
+	free(newIdx);
+	// the conditions on the constants select a single branch and the other ones become unreachable
+	peephole(fn);
+	dce(fn);
+	peephole(fn);
+	strengthReduce(fn);
+	superinstr(fn);
+	return fn;
+	}
+
+void specializeCalls(){
+	if(specializeLimit<=0)return;
+	Domain *d=globalDomain();
+	SpecCall *calls=NULL;
+	int nCalls=0,capCalls=0;
+	for(Symbol *s=d->symbols;s;s=s->next){
+		if(s->kind!=SK_FN||s->fn.extFnPtr)continue;
+		collectTargets(s->fn.instr);
+		indexCode(s->fn.instr);
+		for(int c=0;c<nCode;c++){
+			Instr *call=codeInstrs[c];
+			if(call->op!=OP_CALL&&call->op!=OP_TAILCALL)continue;
+			Symbol *callee=findFn(call);
+			if(!callee||callee->fn.imported||profileCold(call)||countInstr(callee->fn.instr)>specializeBudget)continue;
+			int nParams=symbolsLen(callee->fn.params);
+			Instr **args=(Instr**)safeAlloc((nParams+1)*sizeof(Instr*));
+			bool *readOnly=(bool*)safeAlloc((nParams+1)*sizeof(bool));
+			constArgs(c,nParams,args);
+			readOnlyParams(callee,nParams,readOnly);
+			bool any=false;
+			for(int k=0;k<nParams;k++){
+				if(!readOnly[k])args[k]=NULL;
+				if(args[k])any=true;
+				}
+			free(readOnly);
+			if(!any){
+				free(args);
+				continue;
+				}
+			calls=(SpecCall*)growArray(calls,&capCalls,nCalls+1,16,sizeof(SpecCall));
+			calls[nCalls++]=(SpecCall){s,call,callee,args,call->prof?call->prof->count:1,-1};
+			}
+		}
+	// the groups of calls, each with the sum of the weights of its calls
+	int nGroups=0;
+	long long *weights=(long long*)safeAlloc((nCalls+1)*sizeof(long long));
+	for(int k=0;k<nCalls;k++){
+		if(calls[k].group>=0)continue;
+		int nParams=symbolsLen(calls[k].callee->fn.params);
+		weights[nGroups]=0;
+		for(int j=k;j<nCalls;j++){
+			if(calls[j].group<0&&calls[j].callee==calls[k].callee&&sameConstArgs(&calls[k],&calls[j],nParams)){
+				calls[j].group=nGroups;
+				weights[nGroups]+=calls[j].weight;
+				}
+			}
+		nGroups++;
+		}
+	bool *changed=(bool*)safeAlloc((nCalls+1)*sizeof(bool));
+	memset(changed,0,(nCalls+1)*sizeof(bool));
+	for(Symbol *callee=d->symbols;callee;callee=callee->next){
+		if(callee->kind!=SK_FN||callee->fn.extFnPtr)continue;
+		// the most frequent groups of this callee are specialized first
+		for(int nClones=0;nClones<specializeLimit;){
+			int best=-1;
+			for(int k=0;k<nCalls;k++){
+				int g=calls[k].group;
+				if(calls[k].callee==callee&&g>=0&&(best<0||weights[g]>weights[calls[best].group]))best=k;
+				}
+			if(best<0)break;
+			int g=calls[best].group;
+			for(int k=0;k<nCalls;k++){
+				if(calls[k].group==g)calls[k].group=-1;
+				}
+			Symbol *fn=specializeFn(callee,calls[best].args,nClones+1);
+			// the clone is kept only if the constants simplified its code
+			int n=countInstr(fn->fn.instr);
+			if(n>=countInstr(callee->fn.instr)){
+				delInstrAfter(fn->fn.instr);
+				free(fn->fn.instr);
+				free((char*)fn->name);
+				freeSymbol(fn);
+				continue;
+				}
+			fn->next=callee->next;
+			callee->next=fn;
+			nClones++;
+			optStats.specialized++;
+			optStats.instrAfter+=n;
+			int nParams=symbolsLen(callee->fn.params);
+			for(int k=0;k<nCalls;k++){
+				SpecCall *sc=&calls[k];
+				if(sc->callee!=callee||!sameConstArgs(sc,&calls[best],nParams))continue;
+				for(int a=0;a<nParams;a++){
+					if(sc->args[a])sc->args[a]->op=OP_NOP;
+					}
+				sc->call->arg.instr=fn->fn.instr;
+				changed[k]=true;
+				optStats.specializedCalls++;
+				}
+			}
+		}
+	// the NOPs of the removed arguments are deleted
+	for(int k=0;k<nCalls;k++){
+		if(!changed[k])continue;
+		Symbol *s=calls[k].caller;
+		for(int j=k;j<nCalls;j++){
+			if(calls[j].caller==s)changed[j]=false;
+			}
+		int n=countInstr(s->fn.instr);
+		peephole(s);
+		optStats.instrAfter+=countInstr(s->fn.instr)-n;
+		}
+	for(int k=0;k<nCalls;k++)free(calls[k].args);
+	free(calls);
+	free(weights);
+	free(changed);
+	}
+
+void memoizeCalls(){
+	for(Symbol *s=globalDomain()->symbols;s;s=s->next){
+		if(s->kind!=SK_FN||s->fn.extFnPtr)continue;
+		for(Instr *i=s->fn.instr;i;i=i->next){
+			if(i->op!=OP_CALL)continue;
+			Symbol *callee=findFn(i);
+			if(!callee||!memoizable(callee))continue;
+			i->op=OP_CALL_MEMO;
+			i->arg2=memoTableOf(callee);
+			optStats.memoCalls++;
+			}
+		}
+	}
+
+void flattenCode(Symbol *fnMain){
+	Domain *d=globalDomain();
+	// the functions in the order in which they are reached from fnMain, followed by the ones which are never called
+	int nFns=0,capFns=symbolsLen(d->symbols);
+	Symbol **fns=(Symbol**)safeAlloc(capFns*sizeof(Symbol*));
+	fns[nFns++]=fnMain;
+	for(int k=0;k<nFns;k++){
+		for(Instr *i=fns[k]->fn.instr;i;i=i->next){
+			if(i->op!=OP_CALL&&i->op!=OP_TAILCALL&&i->op!=OP_CALL_MEMO)continue;
+			Symbol *callee=findFn(i);
+			if(!callee)continue;
+			int j;
+			for(j=0;j<nFns&&fns[j]!=callee;j++){}
+			if(j==nFns)fns[nFns++]=callee;
+			}
+		}
+	for(Symbol *s=d->symbols;s;s=s->next){
+		if(s->kind!=SK_FN||s->fn.extFnPtr)continue;
+		int j;
+		for(j=0;j<nFns&&fns[j]!=s;j++){}
+		if(j==nFns)fns[nFns++]=s;
+		}
+	int n=0;
+	for(int k=0;k<nFns;k++)n+=countInstr(fns[k]->fn.instr);
+	Instr **old=(Instr**)safeAlloc(n*sizeof(Instr*));
+	Instr *flat=(Instr*)safeAlloc(n*sizeof(Instr));
+	n=0;
+	for(int k=0;k<nFns;k++){
+		for(Instr *i=fns[k]->fn.instr;i;i=i->next){
+			old[n]=i;
+			flat[n]=*i;
+			flat[n].next=i->next?&flat[n+1]:NULL;
+			n++;
+			}
+		}
+	// each old instruction points to its copy, so the jump targets and the called functions can be translated
+	for(int k=0;k<n;k++)old[k]->next=&flat[k];
+	for(int k=0;k<n;k++){
+		Instr *i=&flat[k];
+		if(isJump(i)||i->op==OP_CALL||i->op==OP_TAILCALL||i->op==OP_CALL_MEMO)i->arg.instr=i->arg.instr->next;
+		}
+	for(int k=0;k<nFns;k++)fns[k]->fn.instr=fns[k]->fn.instr->next;
+	for(int k=0;k<n;k++)free(old[k]);
+	optStats.flatInstr=n;
+	free(old);
+	free(fns);
+	}
+
+void showOptStats(){
+	printf("// optimizations: %d -> %d instructions\n",optStats.instrBefore,optStats.instrAfter);
+	printf("//\tNOPs removed: %d\n",optStats.nops);
+	printf("//\tjumps threaded or removed: %d\n",optStats.jumps);
+	printf("//\tFPADDR+LOAD -> FPLOAD: %d\n",optStats.loads);
+	printf("//\tFPADDR+STORE+DROP -> FPSTORE: %d\n",optStats.stores);
+	printf("//\tpushed and dropped values removed: %d\n",optStats.pushDrops);
+	printf("//\tconstant addresses folded: %d\n",optStats.addrs);
+	printf("//\tconstant expressions folded: %d\n",optStats.consts);
+	printf("//\tsuperinstructions: %d\n",optStats.supers);
+	printf("//\tinlined calls: %d\n",optStats.inlined);
+	printf("//\tspecialized functions: %d, calls with constant arguments redirected to them: %d\n",
+		optStats.specialized,optStats.specializedCalls);
+	printf("//\ttail calls: %d\n",optStats.tailCalls);
+	printf("//\tcommon subexpressions reused: %d\n",optStats.cse);
+	printf("//\tloop invariant expressions hoisted: %d\n",optStats.hoisted);
+	printf("//\tloops unrolled: %d, fully unrolled: %d\n",optStats.unrolled,optStats.fullyUnrolled);
+	printf("//\tinduction variable multiplications reduced: %d\n",optStats.ivMuls);
+	printf("//\tmultiplications and divisions by constants reduced: %d\n",optStats.strength);
+	printf("//\tbounds checks removed: %d\n",optStats.bounds);
+	printf("//\tloops vectorized: %d\n",optStats.vectorized);
+	printf("//\tcode layout: %d blocks moved, %d branches negated\n",optStats.blocksMoved,optStats.branchesFlipped);
+	printf("//\tpure functions: %d, memoized calls: %d\n",optStats.pureFns,optStats.memoCalls);
+	printf("//\tglobals: %d bytes in the data segment, %d moved\n",dataSize,optStats.globalsMoved);
+	printf("//\tglobals never written: %d, %d loads replaced by constants\n",optStats.constGlobals,optStats.constLoads);
+	if(optStats.modules>1){
+		printf("//\tlink: %d modules, %d calls of imported functions, %d inlined\n",
+			optStats.modules,optStats.importedCalls,optStats.importedInlined);
+		}
+	printf("//\tstring literals: %d in the constant pool (%d bytes)\n",constStrings,constSize);
+	printf("//\tcode flattened: %d instructions in one array (%d bytes)\n",optStats.flatInstr,optStats.flatInstr*(int)sizeof(Instr));
+	if(profileUse){
+		printf("//\tprofile: %d functions, %d hot calls inlined over the budget, %d cold calls and %d cold loops skipped,\n",
+			optStats.profFns,optStats.profInlined,optStats.profColdCalls,optStats.profColdLoops);
+		printf("//\t\t%d loops rotated\n",optStats.profRotated);
+		}
+	if(soaEnabled)printf("//\tstruct arrays stored as arrays of fields: %d, %d instructions changed\n",optStats.soaArrays,optStats.soaEdits);
+	if(ssaEnabled){
+		printf("//\tSSA: %d functions (%d not lifted), %d values folded, %d dead values removed\n",
+			optStats.ssaFns,optStats.ssaSkipped,optStats.ssaFolded,optStats.ssaDead);
+		}
+	printf("//\tunreachable instructions removed: %d\n",optStats.dead);
+	printf("//\tfunctions never called removed: %d (%d instructions, %d bytes)\n",
+		optStats.deadFns,optStats.deadFnsInstr,optStats.deadFnsInstr*(int)sizeof(Instr));
+	}
@@ -0,0 +1,293 @@
+#pragma once
+
+// bytecode optimizations
+// they are applied on the code of each function, after it is generated
+
+#include <stdbool.h>
+#include "ad.h"
+
+typedef struct{		// the statistics of the optimizations
+	int instrBefore;		// the number of instructions before optimizations
+	int instrAfter;		// the number of instructions after optimizations
+	int nops;		// removed NOPs
+	int jumps;		// threaded or removed jumps
+	int loads;		// FPADDR+LOAD fused into FPLOAD
+	int stores;		// FPADDR+...+STORE+DROP fused into FPSTORE
+	int pushDrops;		// removed values which were immediately dropped
+	int addrs;		// ADDR or PUSH_I followed by OFFSET or INDEX, folded into a single address or offset
+	int consts;		// int operations and conditions with constant operands, folded into their results
+	int supers;		// sequences replaced by superinstructions
+	int dead;		// removed unreachable instructions
+	int deadFns;		// removed functions which are never called
+	int deadFnsInstr;		// the instructions of the removed functions
+	int inlined;		// calls replaced by the body of the called function
+	int specialized;		// copies of functions specialized for constant arguments
+	int specializedCalls;		// calls redirected to the specialized copies
+	int tailCalls;		// CALL+RET replaced by TAILCALL
+	int cse;		// computations of expressions replaced by the loads of the slots which hold their values
+	int hoisted;		// loop invariant expressions moved before their loops
+	int unrolled;		// counted loops unrolled, with a remainder loop
+	int fullyUnrolled;		// counted loops replaced by copies of their body
+	int ivMuls;		// multiplications of induction variables replaced by derived induction variables
+	int strength;		// multiplications and divisions by constants replaced by MULC, SHL, SHR or DIVM
+	int bounds;		// INDEX_CHK proved in bounds and replaced by INDEX
+	int vectorized;		// counted loops replaced by a vector instruction
+	int profFns;		// functions with counts from the profile
+	int profInlined;		// hot calls inlined only because of their larger budget
+	int profColdCalls;		// calls not inlined, because they were not executed in the profiled run
+	int profColdLoops;		// loops not unrolled, because they ran less than 2 iterations for each entry
+	int profRotated;		// loops whose back jump was replaced by a copy of their test
+	int blocksMoved;		// basic blocks moved by the code layout
+	int branchesFlipped;		// conditional jumps negated by the code layout, so their likely successor follows them
+	int flatInstr;		// instructions copied by flattenCode into the contiguous code array
+	int globalsMoved;		// global variables moved by layoutData
+	int soaArrays;		// global struct arrays stored as an array for each field (atomc -soa)
+	int soaEdits;		// the instructions changed for them
+	int constGlobals;		// global variables which are never written, whose loads became constants
+	int constLoads;		// the loads of these variables
+	int modules;		// linked modules (see link.h)
+	int importedCalls;		// calls of the functions imported from other modules
+	int importedInlined;		// calls of imported functions inlined at link time
+	int pureFns;		// functions which access only their own frame
+	int memoCalls;		// calls of pure functions replaced by CALL_MEMO (atomc -memo)
+	int ssaFns;		// functions optimized in SSA form
+	int ssaSkipped;		// functions which could not be lifted in SSA form
+	int ssaFolded;		// SSA values and jumps folded by the constant propagation
+	int ssaDead;		// removed SSA values which were not used
+	}OptStats;
+
+extern OptStats optStats;
+
+// the optimization level:
+//		0 - no optimizations
+//		1 - optimizations local to each function: peephole, dead code elimination, tail calls
+//		2 - all the optimizations (default)
+extern int optLevel;
+
+// the maximum number of instructions of a function which can be inlined (without ENTER)
+extern int inlineBudget;
+
+// the unroll factor of the counted loops (default 4, 0 or 1 disables the unrolling)
+extern int unrollFactor;
+
+// the maximum number of instructions of the copies of a loop body, for the unrolled and fully unrolled loops
+extern int unrollBudget;
+
+// the maximum number of specialized copies of a function (default 4, 0 disables the specialization)
+extern int specializeLimit;
+
+// the maximum number of instructions of a function which can be specialized
+extern int specializeBudget;
+
+// if true, the global struct arrays are stored as an array for each field, if possible (atomc -soa, see soaLayout)
+extern bool soaEnabled;
+
+// if false, the loops are not vectorized (atomc -vectorize=0)
+extern bool vectorizeEnabled;
+
+// returns in pops and pushes how many values the instruction takes from stack and how many puts back
+// for calls, these are the parameters and the returned value
+// returns false if the effect is not known or the instruction leaves the function (RET, HALT)
+bool stackEffect(Instr *i,int *pops,int *pushes);
+
+// returns true if the instruction has as argument a jump target
+bool isJump(Instr *i);
+
+// the instructions of the function indexed by indexCode, in order
+extern Instr **codeInstrs;
+extern int nCode;
+
+// fills codeInstrs with the instructions of code and indexes them by address, for instrIdx
+// there is only one index, so it is valid until the next call
+void indexCode(Instr *code);
+
+// returns the index of the instruction in the code indexed by indexCode, or -1 if it is not there
+int instrIdx(Instr *i);
+
+// returns true if the execution never continues with the next instruction
+bool endsFlow(Instr *i);
+
+// an instruction and its index in the code of a function
+// an array of them sorted with cmpInstrIdx (by address) gives the index of an instruction with findIdx
+typedef struct{
+	Instr *instr;
+	int idx;
+	}InstrIdx;
+
+// compares two InstrIdx by the address of their instructions, for qsort
+int cmpInstrIdx(const void *a,const void *b);
+
+// returns the index of i from v, sorted with cmpInstrIdx, or -1 if it is not there
+int findIdx(InstrIdx *v,int n,Instr *i);
+
+// returns the immediate form of an int compare and branch instruction, or OP_JF if br has none
+Opcode immediateBranch(Opcode br);
+
+// returns the conditional jump which jumps exactly when br does not jump, or OP_NOP if br is not a conditional jump
+Opcode negatedJump(Opcode br);
+
+// returns the function called by a CALL, TAILCALL or CALL_EXT instruction, or NULL if it is not found
+Symbol *findFn(Instr *i);
+
+// peephole optimizations on the code of the function fn:
+//		- NOP elimination, with the retargeting of the jumps to them
+//		- jump to jump threading and jumps to the next instruction
+//		- FPADDR+LOAD -> FPLOAD
+//		- FPADDR+...+STORE+DROP -> ...+FPSTORE
+//		- removal of the values pushed only to be dropped
+//		- ADDR p; OFFSET k -> ADDR p+k, OFFSET a; OFFSET b -> OFFSET a+b, PUSH_I ct; INDEX size -> OFFSET ct*size
+//		- the int operations and the conditions with constant operands: PUSH_I 2; PUSH_I 3; MUL_I -> PUSH_I 6
+void peephole(Symbol *fn);
+
+// replaces the most executed sequences of instructions with superinstructions
+// the sequences were chosen from the VM statistics (atomc -stats tests/bench.c):
+//		FPLOAD idx; PUSH_I ct; ADD_I; FPSTORE idx -> INCFP_I idx,ct
+//		FPLOAD idx; FPLOAD idx2; ADD_I -> ADDFP_I idx,idx2
+//		PUSH_I ct; ADD_I -> ADDC_I ct
+void superinstr(Symbol *fn);
+
+// dead code elimination: removes from the code of the function fn
+// the instructions which cannot be reached from its beginning
+void dce(Symbol *fn);
+
+// replaces in the code of the function fn the calls to the small functions (at most inlineBudget instructions)
+// with the code of these functions
+// the recursive functions are not inlined
+// the parameters and the local variables of the inlined function are moved in new local variables of fn,
+// which are shared by all the inlined calls, and RET becomes a jump after the inlined code
+void inlineCalls(Symbol *fn);
+
+// replaces the calls followed by a return (return f(...);) with TAILCALL,
+// which reuses the frame of fn, so the tail recursion runs in constant stack space
+// a function with local arrays or structs (FPADDR) is not changed, because the called function could use them
+void tailCalls(Symbol *fn);
+
+// common subexpression elimination, by value numbering in the extended basic blocks
+// (a block and the blocks entered only from it by a conditional jump not taken):
+// a pure expression computed again is replaced by FPLOAD of a slot which holds its value: a variable in which
+// it was stored or a new local variable, in which its first computation is saved
+// the loaded frame slots and memory have versions, which change at each write of the slot, STORE or call of
+// a function which is not pure (including the extern functions), so the expressions which read them are not reused after a write
+void cse(Symbol *fn);
+
+// loop invariant code motion: in each loop (a backward jump) finds the expressions which compute the same value
+// in all the iterations, computes them once in a pre-header before the loop and saves their values in new local variables
+// an invariant expression has no side effects, cannot trap and its operands are:
+//		- constants and addresses
+//		- variables which are not written in the loop
+//		- loaded values, if the loop does not write the memory (STORE, calls of functions which are not pure)
+void licm(Symbol *fn);
+
+// induction variable strength reduction: in a loop whose body ends with the increment of the int local variable i
+// (i=i+step or i=i-step, the only write of i in the loop), i*c (c constant) is replaced by a new local variable d,
+// set to i*c before the loop and incremented by c*step together with i
+// the results are the same as those of MUL_I, because both wrap around on overflow
+void inductionVars(Symbol *fn);
+
+// replaces the multiplications and divisions by constants with cheaper instructions:
+//		x*1, x/1 -> x
+//		x*2^k -> SHL_I k
+//		x*c -> MULC_I c
+//		x/2^k -> SHR_I k (rounds towards 0 like DIV_I)
+//		x/d -> DIVM_I magic,shift (d>=2), a multiplication by the magic number of d instead of a division
+void strengthReduce(Symbol *fn);
+
+// loop unrolling of the counted loops: while(i<n){...; i=i+step;} (or with <=, >, >=), where i is an int local variable
+// written only by the increment at the end of the body, step is a constant and n is a constant
+// or a variable which is not written in the loop
+//		- if the number of iterations is known at compile time and the copies fit in unrollBudget,
+//		the loop is replaced by that many copies of its body
+//		- else a loop with unrollFactor copies of the body runs while at least unrollFactor iterations remain,
+//		followed by the original loop for the remaining iterations
+void unrollLoops(Symbol *fn);
+
+// bounds check elimination: in a counted loop with a constant bound and a constant initial value
+// (see unrollLoops), the range of the induction variable i in the body is known
+// INDEX_CHK of an array with i or i+-c as index becomes INDEX if this range is in the bounds of the array
+void boundsChecks(Symbol *fn);
+
+// auto-vectorization: a counted loop while(i<n){...; i=i+1;} (see unrollLoops) whose body is one of the statements
+// below (with the operands in any order) is replaced by a single vector instruction, which processes the elements [i,n)
+// with SIMD instructions in the VM and then i is set to n:
+//		c[i]=a[i]+b[i] -> VADD_F (double arrays)
+//		c[i]=a[i]+b[i]*k -> VMULADD_F (double arrays, k a constant or a variable which is not written in the loop)
+//		s=s+a[i] -> VSUM_I (int array, s a local variable)
+// the arrays are globals or array parameters which are not written in the loop and the index must be exactly i
+// the results are the same as the ones of the scalar loop, including for overlapping arrays
+void vectorize(Symbol *fn);
+
+// code layout: the basic blocks are reordered so the likely successor of each block follows it (see cfg.h),
+// using the profile (atomc -profile-use, see profile.h) if it exists or static heuristics
+// the unlikely blocks (ex: the else block of an if/else, an early return) are moved after the trace which skips them,
+// and the blocks which were not executed in the profiled run are moved at the end of the function,
+// so the likely path of an if/else continues into the code after it without a JMP
+// with a profile, in a loop which runs at least 2 iterations for each entry, the back jump is first replaced
+// by a copy of the test from the loop beginning, with a negated jump to the body, so each iteration executes one JMP less
+// the profile also guides inlineCalls (the calls which were not executed are not inlined and the hot ones
+// can have 4 times more instructions) and unrollLoops (the loops which were not executed or which run less than
+// 2 iterations are not unrolled, the hot ones are unrolled 2 times more, but not more than their average trip count)
+void layoutCode(Symbol *fn);
+
+// applies on the code of the function fn the optimizations enabled by optLevel
+// before them, it sets fn->fn.pure if the function is pure (see memo.h)
+void optimizeFn(Symbol *fn);
+
+// whole program optimization: starting from fnMain, builds the call graph from the CALL instructions
+// and removes (and frees) the functions which are never called
+// it must be called after the whole program was compiled
+void treeShake(Symbol *fnMain);
+
+// reorders the global variables in the data segment: the scalars which are used by the code are grouped at
+// its beginning, the most used first, followed by the arrays and the structs and by the unused scalars
+// the offsets of the ADDR instructions are moved with their variables
+// it must be called after the whole program was compiled and optimized, before dataInit (see vm.h)
+void layoutData();
+
+// structure of arrays layout: a global array of structs whose elements are accessed only through their fields
+// (v[i].n, v[2].text[j]) is stored as an array for each field, one after another in the place of the array:
+//		struct S{int n;char text[16];} v[10];		v[i].n is at DS+v+i*4 and v[i].text at DS+v+10*4+i*16
+// so a loop which reads a single field reads only the memory of that field
+// the address of a field of an element with a computed index: ADDR v; i; INDEX 20; OFFSET 4 becomes
+// ADDR v+40; i; INDEX 16, and the constant addresses of the fields (ADDR v+k*20+4) are moved in their arrays
+// an element address saved by cse in a local variable is replaced by its index, which is indexed at each use
+// the array is not changed if its address or the address of an element is used in another way (ex: passed to a function)
+// it must be called after the whole program was compiled and optimized, before flattenCode and dataInit
+void soaLayout();
+
+// constant propagation of the global variables which are never written: a global has no initializer,
+// so if its address is used only to load its whole value (the scalar globals), it is always 0
+// the loads are replaced with PUSH_I 0 or PUSH_D 0, and the conditions which depend on them are folded
+// it must be called after the whole program was compiled, before layoutData
+void constGlobals();
+
+// the link time optimizations, on the whole program linked by linkModules (see link.h), before treeShake:
+//		- the calls of the functions imported from other modules, which could not be inlined when their
+//		module was compiled, are inlined (see inlineCalls)
+//		- the purity is inferred again for the functions which call imported functions (see memo.h)
+//		- the global variables which are never written become constants (see constGlobals)
+void linkOptimize();
+
+// interprocedural constant propagation: the calls whose arguments are constants (PUSH_I or PUSH_D) are grouped
+// by the called function and the tuple of their constant arguments, and the function is copied for its most
+// frequent tuples (weighted by the profile, if it exists), at most specializeLimit copies of each function
+// with at most specializeBudget instructions:
+//		int f(int n,int mode){...}		f(x,2) -> f.1(x), where f.1 has only the parameter n
+// in each copy, the loads of the constant parameters are replaced by their values and removed from its frame,
+// then the copy is folded by peephole and dce; it is kept only if it became shorter than the original function,
+// and then its calls are redirected to it, without the pushes of the constant arguments
+// only the parameters which are never written and whose address is never taken are replaced
+// the functions which are no longer called are removed by treeShake, so it must be called before it
+void specializeCalls();
+
+// replaces the calls of the memoizable functions (see memo.h) with CALL_MEMO, with a table for each called function
+// it must be called after the whole program was compiled and optimized (atomc -memo)
+void memoizeCalls();
+
+// copies the code of all the functions into a single array, in the order in which the functions are reached from fnMain
+// and with the instructions of each function in their layout order, so the executed code is contiguous in memory
+// the jumps, the calls and the functions are retargeted to the copies and the old instructions are freed
+// it must be called after the whole program was compiled and optimized, because the copies cannot be freed one by one
+void flattenCode(Symbol *fnMain);
+
+// shows the optimizations statistics
+void showOptStats();
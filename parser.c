@@ -9,6 +9,7 @@
 #include "at.h"
 #include "gc.h"
 #include "vm.h"
+#include "opt.h"
 
 Token *iTk;		// the iterator in the tokens list
 Token *consumedTk;		// the last consumed token
@@ -163,7 +164,7 @@ bool varDef(){
 				if(owner){
 					switch(owner->kind){
                     	case SK_FN:
-                        	var->varIdx=symbolsLen(owner->fn.locals);
+                        	var->varIdx=localsSlots(owner->fn.locals);
                         	addSymbolToList(&owner->fn.locals,dupSymbol(var));
                         	break;
                     	case SK_STRUCT:
@@ -174,7 +175,7 @@ bool varDef(){
                         	break;
                 	} 
 				}else{
-					var->varMem=safeAlloc(typeSize(&t));
+					var->dataOffset=dataAlloc(typeSize(&t),typeAlign(&t));
 				}
 				addSymbolToDomain(symTable, var);
 				return true;
@@ -290,7 +291,7 @@ bool exprPrimary(Ret *r) { //myFunction(1, "hello", 3.14)
                 }
 
                 addRVal(&owner->fn.instr, rArg.lval, &rArg.type);
-                insertConvIfNeeded(lastInstr(owner->fn.instr), &rArg.type, &param->type);
+                convIfNeeded(lastInstr(owner->fn.instr), &rArg, &param->type);
 
                 param = param->next;
 
@@ -306,7 +307,7 @@ bool exprPrimary(Ret *r) { //myFunction(1, "hello", 3.14)
                             }
 
                             addRVal(&owner->fn.instr, rArg.lval, &rArg.type);
-                            insertConvIfNeeded(lastInstr(owner->fn.instr), &rArg.type, &param->type);
+                            convIfNeeded(lastInstr(owner->fn.instr), &rArg, &param->type);
 
                             param = param->next;
                         } 
@@ -324,7 +325,7 @@ bool exprPrimary(Ret *r) { //myFunction(1, "hello", 3.14)
                     tkerr("Too few arguments in function call");
                 }
 
-                *r = (Ret){s->type, false, true};
+                *r = (Ret){.type = s->type, .lval = false, .ct = true};
 
                 if (s->fn.extFnPtr){
                     addInstr(&owner->fn.instr, OP_CALL_EXT)->arg.extFnPtr = s->fn.extFnPtr;
@@ -346,15 +347,20 @@ bool exprPrimary(Ret *r) { //myFunction(1, "hello", 3.14)
                 tkerr("A function can only be called");
             }
 
-            *r = (Ret){s->type, true, s->type.n >= 0};
+            *r = (Ret){.type = s->type, .lval = true, .ct = s->type.n >= 0};
 
             if (s->kind == SK_VAR){
                 if (s->owner == NULL) {// global variables
-                    addInstr(&owner->fn.instr, OP_ADDR)->arg.p = s->varMem;
+                    addInstr(&owner->fn.instr, OP_ADDR)->arg.i = s->dataOffset;
                 } 
+                else if (s->type.n >= 0 || s->type.tb == TB_STRUCT){// local arrays and structs, stored inline in the frame
+                    Instr *addr = addInstrWithInt(&owner->fn.instr, OP_FPADDR, s->varIdx + 1);
+                    addr->arg2 = frameSlots(&s->type);
+                }
                 else{// local variables
                     switch (s->type.tb){
                         case TB_INT:
+                        case TB_CHAR:
                             addInstrWithInt(&owner->fn.instr, OP_FPADDR_I, s->varIdx + 1);
                             break;
                         case TB_DOUBLE:
@@ -366,8 +372,13 @@ bool exprPrimary(Ret *r) { //myFunction(1, "hello", 3.14)
             }
 
             if (s->kind == SK_PARAM){
-                switch (s->type.tb){
+                // an array parameter contains the address of the array
+                if (s->type.n >= 0){
+                    addInstrWithInt(&owner->fn.instr, OP_FPLOAD, s->paramIdx - symbolsLen(s->owner->fn.params) - 1);
+                }
+                else switch (s->type.tb){
                     case TB_INT:
+                    case TB_CHAR:
                         addInstrWithInt(&owner->fn.instr, OP_FPADDR_I, s->paramIdx - symbolsLen(s->owner->fn.params) - 1);
                         break;
                     case TB_DOUBLE:
@@ -380,25 +391,32 @@ bool exprPrimary(Ret *r) { //myFunction(1, "hello", 3.14)
         return true;
     } 
     else if (consume(INT)){
-        *r = (Ret){{TB_INT, NULL, -1}, false, true};
-
         Token *ct = consumedTk;
+        *r = (Ret){{TB_INT, NULL, -1}, false, true, true, {.i = ct->i}};
+
         addInstrWithInt(&owner->fn.instr, OP_PUSH_I, ct->i);
         return true;
     } 
     else if (consume(DOUBLE)){
-        *r = (Ret){{TB_DOUBLE, NULL, -1}, false, true};
-
         Token *ct = consumedTk;
+        *r = (Ret){{TB_DOUBLE, NULL, -1}, false, true, true, {.f = ct->d}};
+
         addInstrWithDouble(&owner->fn.instr, OP_PUSH_D, ct->d);
         return true;
     } 
     else if (consume(CHAR)){
-        *r = (Ret){{TB_CHAR, NULL, -1}, false, true};
+        Token *ct = consumedTk;
+        *r = (Ret){{TB_CHAR, NULL, -1}, false, true, true, {.i = ct->c}};
+
+        // the char values are kept as int on stack
+        addInstrWithInt(&owner->fn.instr, OP_PUSH_I, ct->c);
         return true;
     } 
     else if (consume(STRING)){
-        *r = (Ret){{TB_CHAR, NULL, 0}, false, true};
+        *r = (Ret){.type = {TB_CHAR, NULL, 0}, .lval = false, .ct = true};
+
+        // the value of a string literal is its address in the constant pool
+        addInstr(&owner->fn.instr, OP_CADDR)->arg.i = constIntern(consumedTk->text);
         return true;
     } 
     else if (consume(LPAR)){
@@ -432,6 +450,9 @@ bool exprPostfixPrim(Ret *r){
 				if(r->type.n<0) tkerr("only an array can be indexed");
                 Type tInt={TB_INT,NULL,-1};
                 if(!convTo(&idx.type,&tInt))tkerr("the index is not convertible to int");
+                addRVal(&owner->fn.instr,idx.lval,&idx.type);
+                convIfNeeded(lastInstr(owner->fn.instr),&idx,&tInt);
+                addIndex(&owner->fn.instr,&r->type,&idx);
                 r->type.n=-1;
                 r->lval=true;
                 r->ct=false;
@@ -450,7 +471,8 @@ bool exprPostfixPrim(Ret *r){
 			if(r->type.tb!=TB_STRUCT)tkerr("a field can only be selected from a struct");
             Symbol *s=findSymbolInList(r->type.s->structMembers,tkName->text);
             if(!s) tkerr("the structure %s does not have a field%s",r->type.s->name,tkName->text);
-            *r=(Ret){s->type,true,s->type.n>=0};
+            if(s->varIdx)addInstrWithInt(&owner->fn.instr,OP_OFFSET,s->varIdx);
+            *r=(Ret){.type=s->type,.lval=true,.ct=s->type.n>=0};
             exprPostfixPrim(r);
             return true;
 		} else{
@@ -479,8 +501,7 @@ bool exprUnary(Ret *r){
 	if(consume(SUB)){
 		if(exprUnary(r)){
 			if(!canBeScalar(r))tkerr("unary - must have a scalar operand");
-			r->lval=false;
-			r->ct=true;
+			if(!foldUnary(lastInstr(owner->fn.instr),r,SUB))addNeg(&owner->fn.instr,r);
 			return true;
 		} else{
 			tkerr("Expected expression after unary minus '-'.");
@@ -489,8 +510,7 @@ bool exprUnary(Ret *r){
 	if(consume(NOT)){
 		if(exprUnary(r)){
 			if(!canBeScalar(r))tkerr("unary ! must have a scalar operand");
-			r->lval=false;
-			r->ct=true;
+			if(!foldUnary(lastInstr(owner->fn.instr),r,NOT))addNot(&owner->fn.instr,r);
 			return true;
 		} else{
 			tkerr("Expected expression after logical NOT '!'.");
@@ -518,7 +538,9 @@ bool exprCast(Ret *r){
 					if(op.type.tb==TB_STRUCT)tkerr("cannot convert a struct");
                     if(op.type.n>=0&&t.n<0)tkerr("an array can be converted only to another array");
                     if(op.type.n<0&&t.n>=0)tkerr("a scalar can be converted only to another scalar");
-                    *r=(Ret){t,false,true};
+                    addRVal(&owner->fn.instr,op.lval,&op.type);
+                    convIfNeeded(lastInstr(owner->fn.instr),&op,&t);
+                    *r=(Ret){t,false,true,op.known,op.val};
 					return true;
 				} else{
 					tkerr("Expected expression after type cast.");
@@ -526,9 +548,9 @@ bool exprCast(Ret *r){
 			} else{
 				tkerr("Missing closing parenthesis ')' after type in cast.");
 			}
-		} else {
-			tkerr("Expected type name after '('.");
 		}
+		// not a cast, but a parenthesized expression
+		iTk=startTk;
 	}
 	if(exprUnary(r)){
 		return true;
@@ -545,8 +567,8 @@ bool exprMulPrim(Ret *r){
         Ret right;
 
         Token *op = consumedTk;
-        Instr *lastLeft = lastInstr(owner->fn.instr);
         addRVal(&owner->fn.instr, r->lval, &r->type);
+        Instr *lastLeft = lastInstr(owner->fn.instr);
 
         if (exprCast(&right)){
             Type tDst;
@@ -556,9 +578,10 @@ bool exprMulPrim(Ret *r){
             }
 
             addRVal(&owner->fn.instr, right.lval, &right.type);
-            insertConvIfNeeded(lastLeft, &r->type, &tDst);
-            insertConvIfNeeded(lastInstr(owner->fn.instr), &right.type, &tDst);
-            switch (op->code){
+            convIfNeeded(lastLeft, r, &tDst);
+            convIfNeeded(lastInstr(owner->fn.instr), &right, &tDst);
+            bool folded = foldBinary(lastLeft, r, &right, op->code, &tDst);
+            if (!folded) switch (op->code){
                 case MUL:
                     switch (tDst.tb){
                         case TB_INT:
@@ -584,7 +607,7 @@ bool exprMulPrim(Ret *r){
                 default : break;
             }
 
-            *r = (Ret){tDst, false, true};
+            if (!folded) *r = (Ret){.type = tDst, .lval = false, .ct = true};
 
             if (exprMulPrim(r)){
                 return true;
@@ -623,8 +646,8 @@ bool exprAddPrim(Ret *r){
         Ret right;
 
         Token *op = consumedTk;
-        Instr *lastLeft = lastInstr(owner->fn.instr);
         addRVal(&owner->fn.instr, r->lval, &r->type);
+        Instr *lastLeft = lastInstr(owner->fn.instr);
 
         if (exprMul(&right)) {
             Type tDst;
@@ -633,9 +656,10 @@ bool exprAddPrim(Ret *r){
             }
 
             addRVal(&owner->fn.instr, right.lval, &right.type);
-            insertConvIfNeeded(lastLeft, &r->type, &tDst);
-            insertConvIfNeeded(lastInstr(owner->fn.instr), &right.type, &tDst);
-            switch (op->code){
+            convIfNeeded(lastLeft, r, &tDst);
+            convIfNeeded(lastInstr(owner->fn.instr), &right, &tDst);
+            bool folded = foldBinary(lastLeft, r, &right, op->code, &tDst);
+            if (!folded) switch (op->code){
                 case ADD:
                     switch (tDst.tb){
                         case TB_INT:
@@ -661,7 +685,7 @@ bool exprAddPrim(Ret *r){
                 default : break;
             }
 
-            *r = (Ret){tDst, false, true};
+            if (!folded) *r = (Ret){.type = tDst, .lval = false, .ct = true};
 
             if (exprAddPrim(r)){
                 return true;
@@ -702,8 +726,8 @@ bool exprRelPrim(Ret *r){
         Ret right;
 
         op = consumedTk;
-        Instr *lastLeft = lastInstr(owner->fn.instr);
         addRVal(&owner->fn.instr, r->lval, &r->type);
+        Instr *lastLeft = lastInstr(owner->fn.instr);
 
         if (exprAdd(&right)){
             Type tDst;
@@ -712,24 +736,26 @@ bool exprRelPrim(Ret *r){
             }
 
             addRVal(&owner->fn.instr, right.lval, &right.type);
-            insertConvIfNeeded(lastLeft, &r->type, &tDst);
-            insertConvIfNeeded(lastInstr(owner->fn.instr), &right.type, &tDst);
-            switch (op->code){
+            convIfNeeded(lastLeft, r, &tDst);
+            convIfNeeded(lastInstr(owner->fn.instr), &right, &tDst);
+            bool folded = foldBinary(lastLeft, r, &right, op->code, &tDst);
+            if (!folded) switch (op->code){
                 case LESS:
-                    switch (tDst.tb){
-                        case TB_INT:
-                            addInstr(&owner->fn.instr, OP_LESS_I);
-                            break;
-                        case TB_DOUBLE:
-                            addInstr(&owner->fn.instr, OP_LESS_F);
-                            break;
-                        default : break;
-                    }
+                    addInstr(&owner->fn.instr, tDst.tb == TB_DOUBLE ? OP_LESS_F : OP_LESS_I);
+                    break;
+                case LESSEQ:
+                    addInstr(&owner->fn.instr, tDst.tb == TB_DOUBLE ? OP_LESSEQ_F : OP_LESSEQ_I);
+                    break;
+                case GREATER:
+                    addInstr(&owner->fn.instr, tDst.tb == TB_DOUBLE ? OP_GREATER_F : OP_GREATER_I);
+                    break;
+                case GREATEREQ:
+                    addInstr(&owner->fn.instr, tDst.tb == TB_DOUBLE ? OP_GREATEREQ_F : OP_GREATEREQ_I);
                     break;
                 default : break;
             }
 
-            *r = (Ret){{TB_INT, NULL, -1}, false, true};
+            if (!folded) *r = (Ret){.type = {TB_INT, NULL, -1}, .lval = false, .ct = true};
 
             if (exprRelPrim(r)){
                 return true;
@@ -764,26 +790,23 @@ bool exprRel(Ret *r){
 // exprEqPrim : (EQUAL | NOTEQ) exprRel exprEqPrim | epsilon
 bool exprEqPrim(Ret *r){
 	puts("# exprEqPrim");
-	if(consume(EQUAL)){
-		Ret right;
-		if(exprRel(&right)){
-			Type tDst;
-            if(!arithTypeTo(&r->type,&right.type,&tDst))
-                tkerr("invalid operand type for == or!=");
-            *r=(Ret){{TB_INT,NULL,-1},false,true};
-            exprEqPrim(r);
-            return true;
-		} else {
-			tkerr("Expected expression after '=='.");
-		}
-	}
-	if(consume(NOTEQ)){
+	if(consume(EQUAL)||consume(NOTEQ)){
+		Token *op=consumedTk;
+		addRVal(&owner->fn.instr,r->lval,&r->type);
+		Instr *lastLeft=lastInstr(owner->fn.instr);
 		Ret right;
 		if(exprRel(&right)){
 			Type tDst;
             if(!arithTypeTo(&r->type,&right.type,&tDst))
                 tkerr("invalid operand type for == or!=");
-            *r=(Ret){{TB_INT,NULL,-1},false,true};
+            addRVal(&owner->fn.instr,right.lval,&right.type);
+            convIfNeeded(lastLeft,r,&tDst);
+            convIfNeeded(lastInstr(owner->fn.instr),&right,&tDst);
+            if(!foldBinary(lastLeft,r,&right,op->code,&tDst)){
+                if(op->code==EQUAL)addInstr(&owner->fn.instr,tDst.tb==TB_DOUBLE?OP_EQUAL_F:OP_EQUAL_I);
+                else addInstr(&owner->fn.instr,tDst.tb==TB_DOUBLE?OP_NOTEQ_F:OP_NOTEQ_I);
+                *r=(Ret){.type={TB_INT,NULL,-1},.lval=false,.ct=true};
+                }
             exprEqPrim(r);
             return true;
 		} else {
@@ -810,12 +833,25 @@ bool exprEq(Ret *r){
 bool exprAndPrim(Ret *r){
 	puts("# exprAndPrim");
 	if(consume(AND)){
+		Instr *lastLeft=lastInstr(owner->fn.instr);
+		// if the left operand is false, the right one is not evaluated
+		// a constant left operand gets its jump only if the result cannot be computed at compile time
+		Instr *falseJumps=r->known?NULL:addCondJumps(&owner->fn.instr,r,false);
 		Ret right;
 		if(exprEq(&right)){
 			Type tDst;
             if (!arithTypeTo(&r->type, &right.type, &tDst))
                 tkerr("invalid operand type for &&");
-            *r = (Ret) {{TB_INT, NULL, -1}, false, true};
+            if (r->known && right.known){
+                convIfNeeded(lastLeft, r, &tDst);
+                convIfNeeded(lastInstr(owner->fn.instr), &right, &tDst);
+                }
+            if (!foldBinary(lastLeft, r, &right, AND, &tDst)){
+                if(r->known)falseJumps=insertCondJump(lastLeft,r,false);
+                falseJumps=joinJumps(falseJumps,addCondJumps(&owner->fn.instr,&right,false));
+                addCondValue(&owner->fn.instr,NULL,falseJumps);
+                *r = (Ret){.type = {TB_INT, NULL, -1}, .lval = false, .ct = true};
+                }
             exprAndPrim(r);
             return true;
 		} else {
@@ -842,6 +878,10 @@ bool exprAnd(Ret *r){
 bool exprOrPrim(Ret *r){
 	puts("# exprOrPrim");
 	if(consume(OR)){
+		Instr *lastLeft=lastInstr(owner->fn.instr);
+		// if the left operand is true, the right one is not evaluated
+		// a constant left operand gets its jump only if the result cannot be computed at compile time
+		Instr *trueJumps=r->known?NULL:addCondJumps(&owner->fn.instr,r,true);
 		Ret right;
 		if(exprAnd(&right)){
 			Type tDst;
@@ -850,7 +890,15 @@ bool exprOrPrim(Ret *r){
                 sprintf(errorMsg, "invalid operand type for || at line %d", iTk->line);
                 tkerr(errorMsg);
             }
-            *r=(Ret){{TB_INT,NULL,-1},false,true};
+            if(r->known&&right.known){
+                convIfNeeded(lastLeft,r,&tDst);
+                convIfNeeded(lastInstr(owner->fn.instr),&right,&tDst);
+                }
+            if(!foldBinary(lastLeft,r,&right,OR,&tDst)){
+                if(r->known)trueJumps=insertCondJump(lastLeft,r,true);
+                addCondValue(&owner->fn.instr,trueJumps,addCondJumps(&owner->fn.instr,&right,false));
+                *r=(Ret){.type={TB_INT,NULL,-1},.lval=false,.ct=true};
+                }
             exprOrPrim(r);
             return true;
 		} else{
@@ -886,11 +934,13 @@ bool exprAssign(Ret *r){
                 if(!canBeScalar(&rDst))tkerr("the assign destination must be scalar");
                 if(!canBeScalar(r))tkerr("the assign source must be scalar");
                 if(!convTo(&r->type,&rDst.type))tkerr("the assign source cannot be converted to destination");
-                r->lval=false;
-                r->ct=true;
 
 				addRVal(&owner->fn.instr, r->lval, &r->type);
-                insertConvIfNeeded(lastInstr(owner->fn.instr), &r->type, &rDst.type);
+                convIfNeeded(lastInstr(owner->fn.instr), r, &rDst.type);
+                r->lval=false;
+                r->ct=true;
+                // the value is still on stack, but it is not anymore a single PUSH
+                r->known=false;
 
 				switch (rDst.type.tb){
                     case TB_INT:
@@ -899,6 +949,9 @@ bool exprAssign(Ret *r){
                     case TB_DOUBLE:
                         addInstr(&owner->fn.instr, OP_STORE_F);
                         break;
+                    case TB_CHAR:
+                        addInstr(&owner->fn.instr, OP_STORE_C);
+                        break;
                     default : break;
                 }
 				return true;
@@ -954,21 +1007,18 @@ bool stm(){
 			if(expr(&rCond)){
 				if(!canBeScalar(&rCond))tkerr("the if condition must be a scalar value");
 				if(consume(RPAR)){
-					addRVal(&owner->fn.instr, rCond.lval, &rCond.type);
-                    Type intType = {TB_INT, NULL, -1};
-                    insertConvIfNeeded(lastInstr(owner->fn.instr), &rCond.type, &intType);
-                    Instr *ifJF = addInstr(&owner->fn.instr, OP_JF);
+                    Instr *ifJF = addCondJumps(&owner->fn.instr, &rCond, false);
 					if(stm()){
 						if(consume(ELSE)){
 							Instr *ifJMP = addInstr(&owner->fn.instr, OP_JMP);
-                            ifJF->arg.instr = addInstr(&owner->fn.instr, OP_NOP);
+                            patchJumps(ifJF, addInstr(&owner->fn.instr, OP_NOP));
 							if (stm()){
                                 ifJMP->arg.instr = addInstr(&owner->fn.instr, OP_NOP);
                             } else{
 								tkerr("you need a statement after else.");
 							}
 						} else{
-                            ifJF->arg.instr = addInstr(&owner->fn.instr, OP_NOP);
+                            patchJumps(ifJF, addInstr(&owner->fn.instr, OP_NOP));
                         }
 						return true;
 					}else{
@@ -991,13 +1041,10 @@ bool stm(){
 				// aici verfic scalar 
 				if(!canBeScalar(&rCond))tkerr("the while condition must be a scalar value");
 				if(consume(RPAR)){
-					addRVal(&owner->fn.instr, rCond.lval, &rCond.type);
-                    Type intType = {TB_INT, NULL, -1};
-                    insertConvIfNeeded(lastInstr(owner->fn.instr), &rCond.type, &intType);
-                    Instr *whileJF = addInstr(&owner->fn.instr, OP_JF);
+                    Instr *whileJF = addCondJumps(&owner->fn.instr, &rCond, false);
 					if(stm()){
 						addInstr(&owner->fn.instr, OP_JMP)->arg.instr = beforeWhileCond->next;
-                        whileJF->arg.instr = addInstr(&owner->fn.instr, OP_NOP);
+                        patchJumps(whileJF, addInstr(&owner->fn.instr, OP_NOP));
 
 						return true;
 					}
@@ -1024,13 +1071,13 @@ bool stm(){
 				tkerr("cannot convert the return expression type to the function return type");
 
 			addRVal(&owner->fn.instr, rExpr.lval, &rExpr.type);
-            insertConvIfNeeded(lastInstr(owner->fn.instr), &rExpr.type, &owner->type);
+            convIfNeeded(lastInstr(owner->fn.instr), &rExpr, &owner->type);
             addInstrWithInt(&owner->fn.instr, OP_RET, symbolsLen(owner->fn.params));
 		} else {
 			if(owner->type.tb!=TB_VOID)
 				tkerr("a non-void function must return a value");
 
-			addInstr(&owner->fn.instr, OP_RET_VOID);
+			addInstrWithInt(&owner->fn.instr, OP_RET_VOID, symbolsLen(owner->fn.params));
 			}
 			if(consume(SEMICOLON)){
 				return true;
@@ -1107,7 +1154,54 @@ bool fnParam(){
 	return false;
 }
 
-// fnDef: (typeBase | VOID) ID LPAR (fnParam (COMMA fnParam)*)? RPAR stmCompound
+// returns the symbol of the function with the given name and return type: a new one, or the one
+// declared before by a prototype, whose parameters are moved in *protoParams, so they can be compared with the new ones
+static Symbol *fnSymbol(Token *tkName,Type *t,Symbol **protoParams){
+	*protoParams=NULL;
+	Symbol *fn=findSymbolInDomain(symTable,tkName->text);
+	if(fn){
+		if(fn->kind!=SK_FN||!fn->fn.imported)tkerr("symbol redefinition: %s",tkName->text);
+		if(!sameType(&fn->type,t))tkerr("the return type of %s is different from its prototype",tkName->text);
+		*protoParams=fn->fn.params;
+		fn->fn.params=NULL;
+		return fn;
+		}
+	fn=newSymbol(tkName->text,SK_FN);
+	fn->type=*t;
+	addSymbolToDomain(symTable,fn);
+	return fn;
+	}
+
+// called after the parameters of fn
+// if the function was declared before, its parameters must be the same as the ones from the prototype
+// if it is followed by SEMICOLON, it is a prototype: the function is defined in another module or later in this one
+// returns true for a prototype
+static bool fnProto(Symbol *fn,Symbol *protoParams){
+	if(protoParams){
+		bool same=sameParams(protoParams,fn->fn.params);
+		for(Symbol *next;protoParams;protoParams=next){
+			next=protoParams->next;
+			freeSymbol(protoParams);
+			}
+		if(!same)tkerr("the parameters of %s are different from its prototype",fn->name);
+		}
+	if(!consume(SEMICOLON)){
+		fn->fn.imported=false;
+		if(!fn->fn.instr)addInstr(&fn->fn.instr,OP_ENTER);
+		return false;
+		}
+	if(!fn->fn.instr){
+		fn->fn.imported=true;
+		Instr *enter=addInstr(&fn->fn.instr,OP_ENTER);
+		enter->arg.i=0;
+		enter->arg2=symbolsLen(fn->fn.params);
+		}
+	dropDomain();
+	owner=NULL;
+	return true;
+	}
+
+// fnDef: (typeBase | VOID) ID LPAR (fnParam (COMMA fnParam)*)? RPAR (stmCompound | SEMICOLON)
 bool fnDef(){
     
     Token *start = iTk;
@@ -1120,11 +1214,8 @@ bool fnDef(){
             Token *tkName = consumedTk;
             if(consume(LPAR))
 			{
-                Symbol *fn=findSymbolInDomain(symTable,tkName->text); 
-                if(fn)tkerr("symbol redefinition: %s",tkName->text); 
-                fn=newSymbol(tkName->text,SK_FN);
-                fn->type=t;
-                addSymbolToDomain(symTable,fn);
+                Symbol *protoParams;
+                Symbol *fn=fnSymbol(tkName,&t,&protoParams);
                 owner=fn;
                 pushDomain();
                 if (fnParam()) {
@@ -1137,12 +1228,14 @@ bool fnDef(){
 				}
                 if(consume(RPAR))
 				{
-					addInstr(&fn->fn.instr, OP_ENTER);
+					if(fnProto(fn,protoParams))return true;
                     if(stmCompound(false))
 					{
-						fn->fn.instr->arg.i=symbolsLen(fn->fn.locals); 
+						fn->fn.instr->arg.i=localsSlots(fn->fn.locals);
+						fn->fn.instr->arg2=symbolsLen(fn->fn.params);
                         if(fn->type.tb==TB_VOID)
                         	addInstrWithInt(&fn->fn.instr,OP_RET_VOID,symbolsLen(fn->fn.params));
+                        optimizeFn(fn);
                         dropDomain();
                         owner=NULL;
                         return true;
@@ -1158,11 +1251,8 @@ bool fnDef(){
             Token *tkName = consumedTk;
             if(consume(LPAR))
 			{
-                Symbol *fn=findSymbolInDomain(symTable,tkName->text); 
-                if(fn)tkerr("symbol redefinition: %s",tkName->text); 
-                fn=newSymbol(tkName->text,SK_FN);
-                fn->type=t;
-                addSymbolToDomain(symTable,fn);
+                Symbol *protoParams;
+                Symbol *fn=fnSymbol(tkName,&t,&protoParams);
                 owner=fn;
                 pushDomain();
                 if (fnParam()) {
@@ -1175,12 +1265,14 @@ bool fnDef(){
 				}
                 if(consume(RPAR))
 				{
-					addInstr(&fn->fn.instr, OP_ENTER);
+					if(fnProto(fn,protoParams))return true;
                     if(stmCompound(false))
 					{
-						fn->fn.instr->arg.i=symbolsLen(fn->fn.locals);
+						fn->fn.instr->arg.i=localsSlots(fn->fn.locals);
+						fn->fn.instr->arg2=symbolsLen(fn->fn.params);
 						if(fn->type.tb==TB_VOID)
 							addInstrWithInt(&fn->fn.instr,OP_RET_VOID,symbolsLen(fn->fn.params));
+						optimizeFn(fn);
                         dropDomain();
                         owner=NULL;
                         return true;
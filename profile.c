@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+#include "opt.h"
+#include "profile.h"
+
+bool profileGen=false;
+bool profileUse=false;
+long long profileTotal=0;
+
+typedef enum{PR_FN,PR_BRANCH,PR_CALL,PR_LOOP}ProfileKind;
+
+typedef struct{		// a record from the profile file
+	ProfileKind kind;
+	char name[64];
+	long long idx;		// for PR_FN the number of instructions
+	long long a,b;		// fn: calls; branch: count, taken; call: count; loop: entries, iterations
+	}ProfileRecord;
+
+static ProfileRecord *records;
+static int nRecords,capRecords;
+
+// the counts are allocated in chunks and they are never freed,
+// because they are shared by the copies of the instructions (inlining, unrolling)
+ProfileData *profileNew(long long count,long long taken,long long entries){
+	enum{CHUNK=256};
+	static ProfileData *chunk;
+	static int nChunk=CHUNK;
+	if(nChunk==CHUNK){
+		chunk=(ProfileData*)safeAlloc(CHUNK*sizeof(ProfileData));
+		nChunk=0;
+		}
+	ProfileData *p=&chunk[nChunk++];
+	p->count=count;
+	p->taken=taken;
+	p->entries=entries;
+	return p;
+	}
+
+void profileCount(Instr *prev,Instr *IP){
+	profileTotal++;
+	if(!IP->prof)IP->prof=profileNew(0,0,0);
+	IP->prof->count++;
+	if(prev&&prev->op!=OP_JMP&&isJump(prev)&&IP==prev->arg.instr&&IP!=prev->next)prev->prof->taken++;
+	}
+
+static long long countOf(Instr *i){
+	return i->prof?i->prof->count:0;
+	}
+
+// the instructions of a function, indexed from ENTER
+// *idx gets their indexes sorted by address, for findIdx
+static Instr **indexFn(Instr *code,int *n,InstrIdx **idx){
+	*n=0;
+	for(Instr *i=code;i;i=i->next)(*n)++;
+	Instr **v=(Instr**)safeAlloc(*n*sizeof(Instr*));
+	*idx=(InstrIdx*)safeAlloc(*n*sizeof(InstrIdx));
+	int k=0;
+	for(Instr *i=code;i;i=i->next){
+		(*idx)[k]=(InstrIdx){i,k};
+		v[k++]=i;
+		}
+	qsort(*idx,*n,sizeof(InstrIdx),cmpInstrIdx);
+	return v;
+	}
+
+void profileWrite(const char *fileName,Domain *d){
+	FILE *fis=fopen(fileName,"w");
+	if(!fis)err("cannot write the profile file %s",fileName);
+	fprintf(fis,"total %lld\n",profileTotal);
+	for(Symbol *s=d->symbols;s;s=s->next){
+		if(s->kind!=SK_FN||s->fn.extFnPtr)continue;
+		int n;
+		InstrIdx *idx;
+		Instr **v=indexFn(s->fn.instr,&n,&idx);
+		fprintf(fis,"fn %s %d %lld\n",s->name,n,countOf(v[0]));
+		for(int k=1;k<n;k++){
+			Instr *i=v[k];
+			if(!countOf(i))continue;
+			if(i->op==OP_CALL){
+				fprintf(fis,"call %s %d %lld\n",s->name,k,i->prof->count);
+				}else if(i->op==OP_JMP){
+				int t=findIdx(idx,n,i->arg.instr);
+				// the loop is entered by the execution of its first instruction which does not come from the back jump
+				if(t>=0&&t<=k)fprintf(fis,"loop %s %d %lld %lld\n",s->name,k,countOf(v[t])-i->prof->count,i->prof->count);
+				}else if(isJump(i)){
+				fprintf(fis,"branch %s %d %lld %lld\n",s->name,k,i->prof->count,i->prof->taken);
+				}
+			}
+		free(v);
+		free(idx);
+		}
+	fclose(fis);
+	}
+
+void profileRead(const char *fileName){
+	FILE *fis=fopen(fileName,"r");
+	if(!fis)err("cannot open the profile file %s",fileName);
+	static const char *kinds[]={"fn","branch","call","loop"};
+	static const int nFields[]={4,5,4,5};		// with the kind
+	char line[256],kind[16];
+	if(!fgets(line,sizeof(line),fis)||sscanf(line,"total %lld",&profileTotal)!=1)err("invalid profile file %s",fileName);
+	while(fgets(line,sizeof(line),fis)){
+		records=(ProfileRecord*)growArray(records,&capRecords,nRecords+1,64,sizeof(ProfileRecord));
+		ProfileRecord *r=&records[nRecords++];
+		r->b=0;
+		int n=sscanf(line,"%15s %63s %lld %lld %lld",kind,r->name,&r->idx,&r->a,&r->b);
+		int k;
+		for(k=0;k<4&&(n<1||strcmp(kind,kinds[k]));k++){}
+		if(k==4||n<nFields[k])err("invalid profile file %s: %s",fileName,line);
+		r->kind=(ProfileKind)k;
+		}
+	fclose(fis);
+	profileUse=true;
+	}
+
+bool profileAttach(Symbol *fn){
+	int k;
+	for(k=0;k<nRecords;k++){
+		if(records[k].kind==PR_FN&&!strcmp(records[k].name,fn->name))break;
+		}
+	int n;
+	InstrIdx *idx;
+	Instr **v=indexFn(fn->fn.instr,&n,&idx);
+	if(k==nRecords||records[k].idx!=n){
+		free(v);
+		free(idx);
+		return false;
+		}
+	v[0]->prof=profileNew(records[k].a,0,0);
+	for(int j=1;j<n;j++){
+		Instr *i=v[j];
+		if(i->op==OP_JMP){
+			int t=findIdx(idx,n,i->arg.instr);
+			if(t<0||t>j)continue;
+			}else if(i->op!=OP_CALL&&!isJump(i))continue;
+		i->prof=profileNew(0,0,0);
+		}
+	// the records of a function follow its fn record
+	for(k++;k<nRecords&&records[k].kind!=PR_FN;k++){
+		ProfileRecord *r=&records[k];
+		if(r->idx<1||r->idx>=n)continue;
+		ProfileData *p=v[r->idx]->prof;
+		if(!p)continue;
+		switch(r->kind){
+			case PR_BRANCH:p->count=r->a;p->taken=r->b;break;
+			case PR_CALL:p->count=r->a;break;
+			case PR_LOOP:p->entries=r->a;p->count=r->b;break;
+			default:break;
+			}
+		}
+	free(v);
+	free(idx);
+	return true;
+	}
+
+bool profileCold(Instr *i){
+	return i->prof&&i->prof->count==0;
+	}
+
+bool profileHot(Instr *i){
+	return i->prof&&i->prof->count*100>=profileTotal&&i->prof->count>0;
+	}
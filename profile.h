@@ -0,0 +1,49 @@
+#pragma once
+
+// profile-guided optimization
+// with atomc -profile-gen=file, the program is compiled without optimizations and the VM counts how many times
+// each instruction is executed; at the end of the run the counts are written in the profile file, one record per line,
+// keyed by the function name and the index of the instruction in the function code (ENTER has the index 0):
+//		total n - the number of instructions executed in the profiled run
+//		fn name nInstr calls - a function with nInstr instructions, called calls times
+//		branch name idx count taken - a conditional jump, executed count times, of which it jumped taken times
+//		call name idx count - a CALL executed count times
+//		loop name idx entries iterations - the backward JMP of a loop, entered entries times, which ran iterations times
+// only the executed instructions have records
+// with atomc -profile-use=file, the counts are attached to the instructions of each function before it is optimized,
+// if the function has the same number of instructions as in the profiled run, and they guide
+// the inlining, the loop unrolling and the code layout (see opt.h)
+
+#include <stdbool.h>
+#include "ad.h"
+
+// if true, the VM counts the executed instructions (atomc -profile-gen)
+extern bool profileGen;
+// true if a profile was read (atomc -profile-use)
+extern bool profileUse;
+// the number of instructions executed in the profiled run
+extern long long profileTotal;
+
+// returns new counts for an instruction
+ProfileData *profileNew(long long count,long long taken,long long entries);
+
+// counts the execution of the instruction IP, which is executed after prev (NULL for the first one)
+void profileCount(Instr *prev,Instr *IP);
+
+// writes the counts of the functions from the domain d in the profile file
+void profileWrite(const char *fileName,Domain *d);
+
+// reads the profile file
+// on error, prints a message and exit the program
+void profileRead(const char *fileName);
+
+// attaches the counts from the profile to the instructions of the function fn, which must not be optimized yet
+// the CALL, the conditional jumps and the backward JMPs without a record get zero counts, because they were not executed
+// returns false if the function is not in the profile or its code is different
+bool profileAttach(Symbol *fn);
+
+// returns true if the instruction was not executed in the profiled run
+bool profileCold(Instr *i);
+
+// returns true if the instruction was executed for at least 1% of the instructions from the profiled run
+bool profileHot(Instr *i);
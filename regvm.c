@@ -0,0 +1,784 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "utils.h"
+#include "opt.h"
+#include "memo.h"
+#include "regvm.h"
+
+bool regVm=false;
+
+// the register code of the whole program
+static RInstr *rcode;
+static int nRCode,capRCode;
+static int nStackInstr;		// the lowered stack instructions
+static int maxFrame;		// the largest number of registers of a frame, checked by TAILCALL
+static long long ropCounts[ROP_COUNT];
+static RInstr memoRet={.op=ROP_MEMO_RET};		// the return address of the memoized calls which were not found
+
+typedef struct{		// a value from the symbolic operand stack
+	bool isConst;
+	int slot;		// if !isConst, the register which holds the value
+	Val k;
+	}Operand;
+
+// the state of the function which is lowered, whose instructions are in codeInstrs
+static int *depths;		// the depth of the operand stack before each instruction, or -1 if it is unreachable
+static int *pos;		// the index in rcode of the lowered instruction
+static bool *labels;		// the jump targets
+static int capInfo;		// the capacity of depths, pos and labels
+static Operand *st;		// the symbolic operand stack
+static int sp;
+static int nLocals;
+static bool aliased;		// the function takes the address of a frame slot, so a store can change any slot
+
+// the temporary register of the depth d of the operand stack
+static int T(int d){
+	return nLocals+1+d;
+	}
+
+static int idxOf(Instr *i){
+	int k=instrIdx(i);
+	if(k<0)err("regLower: the jump target is not in its function");
+	return k;
+	}
+
+// indexes the instructions of the function in codeInstrs (see indexCode) and makes room for their info
+static void indexFn(Instr *enter){
+	indexCode(enter);
+	// depths, pos and labels have the same capacity
+	int c=capInfo;
+	depths=(int*)growArray(depths,&c,nCode,256,sizeof(int));
+	c=capInfo;
+	pos=(int*)growArray(pos,&c,nCode,256,sizeof(int));
+	labels=(bool*)growArray(labels,&capInfo,nCode,256,sizeof(bool));
+	}
+
+// the stack effect of the instructions, including the ones which end the flow
+static void effect(Instr *i,int *pops,int *pushes){
+	switch(i->op){
+		case OP_RET:*pops=1;*pushes=0;return;
+		case OP_RET_VOID:
+		case OP_TAILCALL:
+		case OP_HALT:
+			*pops=0;*pushes=0;return;
+		case OP_CALL_MEMO:
+			*pops=memoTables[i->arg2]->nParams;*pushes=1;return;
+		default:
+			if(!stackEffect(i,pops,pushes))err("regLower: unsupported instruction %s",opName(i->op));
+		}
+	}
+
+// computes the depth of the operand stack before each instruction and the jump targets
+// returns the maximum depth
+static int computeDepths(){
+	int *work=(int*)safeAlloc(nCode*sizeof(int));
+	int nWork=0,maxDepth=0;
+	for(int k=0;k<nCode;k++){
+		depths[k]=-1;
+		labels[k]=false;
+		}
+	for(int k=1;k<nCode;k++){
+		if(isJump(codeInstrs[k]))labels[idxOf(codeInstrs[k]->arg.instr)]=true;
+		}
+	// the ENTER is not lowered: the code starts after it, with an empty stack
+	if(nCode>1){
+		depths[1]=0;
+		work[nWork++]=1;
+		}
+	while(nWork){
+		int k=work[--nWork];
+		int pops,pushes;
+		effect(codeInstrs[k],&pops,&pushes);
+		if(pops>depths[k])err("regLower: stack underflow at %s",opName(codeInstrs[k]->op));
+		int d=depths[k]-pops+pushes;
+		if(d>maxDepth)maxDepth=d;
+		int succ[2],nSucc=0;
+		if(isJump(codeInstrs[k]))succ[nSucc++]=idxOf(codeInstrs[k]->arg.instr);
+		if(!endsFlow(codeInstrs[k])&&k+1<nCode)succ[nSucc++]=k+1;
+		for(int j=0;j<nSucc;j++){
+			if(depths[succ[j]]<0){
+				depths[succ[j]]=d;
+				work[nWork++]=succ[j];
+				}else if(depths[succ[j]]!=d)err("regLower: different stack depths at a jump target");
+			}
+		}
+	free(work);
+	return maxDepth;
+	}
+
+// the returned instruction is valid until the next one is emitted
+static RInstr *emit(ROpcode op,int a,int b,int c){
+	rcode=(RInstr*)growArray(rcode,&capRCode,nRCode+1,1024,sizeof(RInstr));
+	RInstr *r=&rcode[nRCode];
+	r->op=op;
+	r->a=a;
+	r->b=b;
+	r->c=c;
+	r->k.p=NULL;
+	nRCode++;
+	return r;
+	}
+
+// moves the value from the depth k of the symbolic stack in its temporary register
+static void toTemp(int k){
+	if(st[k].isConst)emit(ROP_LOADK,T(k),0,0)->k=st[k].k;
+	else if(st[k].slot!=T(k))emit(ROP_MOV,T(k),st[k].slot,0);
+	else return;
+	st[k].isConst=false;
+	st[k].slot=T(k);
+	}
+
+// moves all the values from the symbolic stack in their temporary registers (the state at the jump targets)
+static void flush(){
+	for(int k=0;k<sp;k++)toTemp(k);
+	}
+
+// before the slot is written, the values from the stack which are still in it are copied in their temporary registers
+static void protect(int slot){
+	for(int k=0;k<sp;k++){
+		if(!st[k].isConst&&st[k].slot==slot)toTemp(k);
+		}
+	}
+
+// returns the register of the value from the depth k, which is loaded in its temporary register if it is a constant
+static int use(int k){
+	if(st[k].isConst)toTemp(k);
+	return st[k].slot;
+	}
+
+static void pushSlot(int slot){
+	st[sp].isConst=false;
+	st[sp].slot=slot;
+	sp++;
+	}
+
+static void pushConst(Val k){
+	st[sp].isConst=true;
+	st[sp].k=k;
+	sp++;
+	}
+
+// the instruction which computed the value from the top of the stack in its temporary register, or -1
+// an FPSTORE after it changes its destination register
+static int producer;
+
+// emits an instruction which computes the new top of the stack
+static RInstr *produce(ROpcode op,int b,int c){
+	RInstr *r=emit(op,T(sp),b,c);
+	pushSlot(T(sp));
+	producer=(int)(r-rcode);
+	return r;
+	}
+
+static void unary(ROpcode op,int c){
+	int b=use(sp-1);
+	sp--;
+	produce(op,b,c);
+	}
+
+static RInstr *binary(ROpcode op){
+	int c=use(sp-1),b=use(sp-2);
+	sp-=2;
+	return produce(op,b,c);
+	}
+
+// an int operation with an immediate form (opK) if one of its operands is a constant
+// the operands of a commutative operation can be swapped
+static void binaryK(ROpcode op,ROpcode opK,bool commutative){
+	if(st[sp-1].isConst){
+		int c=st[sp-1].k.i;
+		sp--;
+		unary(opK,c);
+	}else if(commutative&&st[sp-2].isConst){
+		int c=st[sp-2].k.i,b=use(sp-1);
+		sp-=2;
+		produce(opK,b,c);
+	}else binary(op);
+	}
+
+static void store(int slot,int prevProducer){
+	Operand v=st[--sp];
+	if(!v.isConst&&v.slot==slot)return;
+	int n=nRCode;
+	protect(slot);
+	if(!v.isConst&&v.slot==T(sp)&&prevProducer==n-1&&nRCode==n&&rcode[prevProducer].a==T(sp)){
+		rcode[prevProducer].a=slot;
+	}else if(v.isConst){
+		emit(ROP_LOADK,slot,0,0)->k=v.k;
+	}else emit(ROP_MOV,slot,v.slot,0);
+	}
+
+// the stack index of the target is kept in k.i until all the code is lowered
+static void jump(ROpcode op,int a,int b,Instr *target){
+	emit(op,a,b,0)->k.i=idxOf(target);
+	}
+
+// moves the arguments of a call in consecutive temporary registers and returns the first one
+static int args(int n){
+	for(int k=sp-n;k<sp;k++)toTemp(k);
+	sp-=n;
+	return T(sp);
+	}
+
+static void lowerInstr(Instr *i,int prevProducer){
+	Symbol *fn;
+	int a,b;
+	switch(i->op){
+		case OP_NOP:break;
+		case OP_PUSH_I:
+		case OP_PUSH_D:
+			pushConst(i->arg);
+			break;
+		case OP_FPLOAD:
+			if(aliased)produce(ROP_MOV,i->arg.i,0);
+			else pushSlot(i->arg.i);
+			break;
+		case OP_FPSTORE:store(i->arg.i,prevProducer);break;
+		case OP_DROP:sp--;break;
+		case OP_ADDR:produce(ROP_ADDR,i->arg.i,0);break;
+		case OP_CADDR:produce(ROP_CADDR,i->arg.i,0);break;
+		case OP_FPADDR_I:
+		case OP_FPADDR_F:
+		case OP_FPADDR:
+			produce(ROP_FPADDR,i->arg.i,0);
+			break;
+		case OP_ADD_I:binaryK(ROP_ADD_I,ROP_ADDK_I,true);break;
+		case OP_SUB_I:
+			// x-c is x+(-c), with the same wrapping
+			if(st[sp-1].isConst)st[sp-1].k.i=(int)(0u-(unsigned)st[sp-1].k.i);
+			binaryK(ROP_SUB_I,ROP_ADDK_I,false);
+			break;
+		case OP_MUL_I:binaryK(ROP_MUL_I,ROP_MULK_I,true);break;
+		case OP_DIV_I:binary(ROP_DIV_I);break;
+		case OP_ADD_D:binary(ROP_ADD_F);break;
+		case OP_SUB_F:binary(ROP_SUB_F);break;
+		case OP_MUL_F:binary(ROP_MUL_F);break;
+		case OP_DIV_F:binary(ROP_DIV_F);break;
+		case OP_LESS_I:binary(ROP_LESS_I);break;
+		case OP_LESSEQ_I:binary(ROP_LESSEQ_I);break;
+		case OP_GREATER_I:binary(ROP_GREATER_I);break;
+		case OP_GREATEREQ_I:binary(ROP_GREATEREQ_I);break;
+		case OP_EQUAL_I:binary(ROP_EQUAL_I);break;
+		case OP_NOTEQ_I:binary(ROP_NOTEQ_I);break;
+		case OP_LESS_D:
+		case OP_LESS_F:
+			binary(ROP_LESS_F);
+			break;
+		case OP_LESSEQ_F:binary(ROP_LESSEQ_F);break;
+		case OP_GREATER_F:binary(ROP_GREATER_F);break;
+		case OP_GREATEREQ_F:binary(ROP_GREATEREQ_F);break;
+		case OP_EQUAL_F:binary(ROP_EQUAL_F);break;
+		case OP_NOTEQ_F:binary(ROP_NOTEQ_F);break;
+		case OP_CONV_I_F:unary(ROP_CONV_I_F,0);break;
+		case OP_CONV_F_I:unary(ROP_CONV_F_I,0);break;
+		case OP_ADDC_I:unary(ROP_ADDK_I,i->arg.i);break;
+		case OP_MULC_I:unary(ROP_MULK_I,i->arg.i);break;
+		case OP_SHL_I:unary(ROP_SHL_I,i->arg.i);break;
+		case OP_SHR_I:unary(ROP_SHR_I,i->arg.i);break;
+		case OP_DIVM_I:
+			unary(ROP_DIVM_I,i->arg2);
+			rcode[producer].k.i=i->arg.i;
+			break;
+		case OP_ADDFP_I:produce(ROP_ADD_I,i->arg.i,i->arg2);break;
+		case OP_INCFP_I:
+			protect(i->arg.i);
+			emit(ROP_ADDK_I,i->arg.i,i->arg.i,i->arg2);
+			break;
+		case OP_LOAD_I:unary(ROP_LOAD_I,0);break;
+		case OP_LOAD_F:unary(ROP_LOAD_F,0);break;
+		case OP_LOAD_C:unary(ROP_LOAD_C,0);break;
+		case OP_STORE_I:binary(ROP_STORE_I);break;
+		case OP_STORE_F:binary(ROP_STORE_F);break;
+		case OP_STORE_C:binary(ROP_STORE_C);break;
+		case OP_INDEX:
+			binary(ROP_INDEX)->k.i=i->arg.i;
+			break;
+		case OP_INDEX_CHK:
+			emit(ROP_BOUNDS,use(sp-1),i->arg2,0);
+			binary(ROP_INDEX)->k.i=i->arg.i;
+			break;
+		case OP_OFFSET:unary(ROP_OFFSET,i->arg.i);break;
+		case OP_JMP:
+			flush();
+			jump(ROP_JMP,0,0,i->arg.instr);
+			break;
+		case OP_JF:
+		case OP_JT:
+			a=use(--sp);
+			flush();
+			jump(i->op==OP_JF?ROP_JF:ROP_JT,a,0,i->arg.instr);
+			break;
+		case OP_JLT_I:case OP_JLE_I:case OP_JGT_I:case OP_JGE_I:case OP_JEQ_I:case OP_JNE_I:
+			b=use(sp-1);
+			a=use(sp-2);
+			sp-=2;
+			flush();
+			jump(ROP_JLT_I+(i->op-OP_JLT_I),a,b,i->arg.instr);
+			break;
+		case OP_JLT_D:case OP_JLE_D:case OP_JGT_D:case OP_JGE_D:case OP_JEQ_D:case OP_JNE_D:
+			b=use(sp-1);
+			a=use(sp-2);
+			sp-=2;
+			flush();
+			jump(ROP_JLT_F+(i->op-OP_JLT_D),a,b,i->arg.instr);
+			break;
+		case OP_JLTC_I:case OP_JLEC_I:case OP_JGTC_I:case OP_JGEC_I:case OP_JEQC_I:case OP_JNEC_I:
+			a=use(--sp);
+			flush();
+			jump(ROP_JLTK_I+(i->op-OP_JLTC_I),a,i->arg2,i->arg.instr);
+			break;
+		case OP_CALL:
+			fn=findFn(i);
+			b=symbolsLen(fn->fn.params);
+			// the called function is kept in k.instr until all the functions are lowered
+			emit(ROP_CALL,args(b),b,0)->k.instr=i->arg.instr;
+			if(fn->type.tb!=TB_VOID)pushSlot(T(sp));
+			break;
+		case OP_CALL_EXT:
+			fn=findFn(i);
+			b=symbolsLen(fn->fn.params);
+			a=args(b);
+			emit(ROP_CALL_EXT,a+b-1,0,0)->k.extFnPtr=i->arg.extFnPtr;
+			if(fn->type.tb!=TB_VOID)pushSlot(T(sp));
+			break;
+		case OP_TAILCALL:
+			b=i->arg.instr->arg2;
+			emit(ROP_TAILCALL,args(b),b,i->arg2)->k.instr=i->arg.instr;
+			break;
+		case OP_CALL_MEMO:
+			b=memoTables[i->arg2]->nParams;
+			emit(ROP_CALL_MEMO,args(b),i->arg2,0)->k.instr=i->arg.instr;
+			pushSlot(T(sp));
+			break;
+		case OP_RET:
+			a=use(--sp);
+			emit(ROP_RET,a,i->arg.i,0);
+			break;
+		case OP_RET_VOID:emit(ROP_RET_VOID,0,i->arg.i,0);break;
+		case OP_HALT:emit(ROP_HALT,0,0,0);break;
+		case OP_VADD_F:emit(ROP_VADD_F,args(4),0,0);break;
+		case OP_VMULADD_F:emit(ROP_VMULADD_F,args(5),0,0);break;
+		case OP_VSUM_I:
+			emit(ROP_VSUM_I,args(3),0,0);
+			pushSlot(T(sp));
+			break;
+		default:err("regLower: unsupported instruction %s",opName(i->op));
+		}
+	}
+
+// lowers the code of the function fn at the end of rcode and returns the number of its registers
+static int lowerFn(Symbol *fn){
+	indexFn(fn->fn.instr);
+	nLocals=fn->fn.instr->arg.i;
+	int maxDepth=computeDepths();
+	aliased=false;
+	for(int k=0;k<nCode;k++){
+		if(codeInstrs[k]->op==OP_FPADDR_I||codeInstrs[k]->op==OP_FPADDR_F)aliased=true;
+		}
+	st=(Operand*)safeAlloc((maxDepth+1)*sizeof(Operand));
+	sp=0;
+	producer=-1;
+	int first=nRCode;
+	for(int k=1;k<nCode;k++){
+		if(depths[k]<0)continue;
+		int prevProducer=producer;
+		producer=-1;
+		if(labels[k]){
+			if(!endsFlow(codeInstrs[k-1])&&depths[k-1]>=0)flush();
+			// the values are in their temporary registers at the jump targets
+			sp=depths[k];
+			for(int d=0;d<sp;d++){
+				st[d].isConst=false;
+				st[d].slot=T(d);
+				}
+			prevProducer=-1;
+			}
+		pos[k]=nRCode;
+		lowerInstr(codeInstrs[k],prevProducer);
+		}
+	for(int r=first;r<nRCode;r++){
+		if(rcode[r].op>=ROP_JMP&&rcode[r].op<=ROP_JNEK_I)rcode[r].k.i=pos[rcode[r].k.i];
+		}
+	free(st);
+	nStackInstr+=nCode;
+	return nLocals+1+maxDepth;
+	}
+
+static int cmpFnCode(const void *a,const void *b){
+	uintptr_t x=(uintptr_t)(*(Symbol**)a)->fn.instr,y=(uintptr_t)(*(Symbol**)b)->fn.instr;
+	return x<y?-1:(x>y?1:0);
+	}
+
+RInstr *regLower(Symbol *fnMain){
+	Domain *d=symTable;
+	while(d->parent)d=d->parent;
+	int nFns=0;
+	Symbol **fns=(Symbol**)safeAlloc(symbolsLen(d->symbols)*sizeof(Symbol*));
+	for(Symbol *s=d->symbols;s;s=s->next){
+		if(s->kind==SK_FN&&!s->fn.extFnPtr)fns[nFns++]=s;
+		}
+	// the functions in the order of their code, which is the one from flattenCode
+	qsort(fns,nFns,sizeof(Symbol*),cmpFnCode);
+	int *entries=(int*)safeAlloc(nFns*sizeof(int));
+	int *sizes=(int*)safeAlloc(nFns*sizeof(int));
+	// the entry code has an empty frame, with FP=stack-1, so the frame of fnMain starts like in the stack VM
+	emit(ROP_CALL,1,0,0)->k.instr=fnMain->fn.instr;
+	emit(ROP_HALT,0,0,0);
+	maxFrame=0;
+	for(int k=0;k<nFns;k++){
+		entries[k]=nRCode;
+		sizes[k]=lowerFn(fns[k]);
+		if(sizes[k]>maxFrame)maxFrame=sizes[k];
+		}
+	// the array is not moved anymore, so the indexes and the called functions become pointers
+	for(int r=0;r<nRCode;r++){
+		RInstr *i=&rcode[r];
+		if(i->op>=ROP_JMP&&i->op<=ROP_JNEK_I){
+			i->target=&rcode[i->k.i];
+		}else if(i->op==ROP_CALL||i->op==ROP_TAILCALL||i->op==ROP_CALL_MEMO){
+			Instr *enter=i->k.instr;
+			int lo=0,hi=nFns-1;
+			while(lo<hi){
+				int mid=(lo+hi)/2;
+				if((uintptr_t)fns[mid]->fn.instr<(uintptr_t)enter)lo=mid+1;
+				else hi=mid;
+				}
+			if(fns[lo]->fn.instr!=enter)err("regLower: the called function was not lowered");
+			if(i->op!=ROP_TAILCALL)i->c=sizes[lo];
+			i->target=&rcode[entries[lo]];
+			}
+		}
+	free(entries);
+	free(sizes);
+	free(fns);
+	return rcode;
+	}
+
+const char *regOpName(ROpcode op){
+	static const char *names[ROP_COUNT]={
+		[ROP_HALT]="HALT",[ROP_MOV]="MOV",[ROP_LOADK]="LOADK",[ROP_ADDR]="ADDR",[ROP_CADDR]="CADDR",[ROP_FPADDR]="FPADDR",
+		[ROP_ADD_I]="ADD.i",[ROP_SUB_I]="SUB.i",[ROP_MUL_I]="MUL.i",[ROP_DIV_I]="DIV.i",
+		[ROP_ADDK_I]="ADDK.i",[ROP_MULK_I]="MULK.i",[ROP_SHL_I]="SHL.i",[ROP_SHR_I]="SHR.i",[ROP_DIVM_I]="DIVM.i",
+		[ROP_ADD_F]="ADD.f",[ROP_SUB_F]="SUB.f",[ROP_MUL_F]="MUL.f",[ROP_DIV_F]="DIV.f",
+		[ROP_CONV_I_F]="CONV.i.f",[ROP_CONV_F_I]="CONV.f.i",
+		[ROP_LESS_I]="LESS.i",[ROP_LESSEQ_I]="LESSEQ.i",[ROP_GREATER_I]="GREATER.i",
+		[ROP_GREATEREQ_I]="GREATEREQ.i",[ROP_EQUAL_I]="EQUAL.i",[ROP_NOTEQ_I]="NOTEQ.i",
+		[ROP_LESS_F]="LESS.f",[ROP_LESSEQ_F]="LESSEQ.f",[ROP_GREATER_F]="GREATER.f",
+		[ROP_GREATEREQ_F]="GREATEREQ.f",[ROP_EQUAL_F]="EQUAL.f",[ROP_NOTEQ_F]="NOTEQ.f",
+		[ROP_LOAD_I]="LOAD.i",[ROP_LOAD_F]="LOAD.f",[ROP_LOAD_C]="LOAD.c",
+		[ROP_STORE_I]="STORE.i",[ROP_STORE_F]="STORE.f",[ROP_STORE_C]="STORE.c",
+		[ROP_INDEX]="INDEX",[ROP_OFFSET]="OFFSET",[ROP_BOUNDS]="BOUNDS",
+		[ROP_JMP]="JMP",[ROP_JF]="JF",[ROP_JT]="JT",
+		[ROP_JLT_I]="JLT.i",[ROP_JLE_I]="JLE.i",[ROP_JGT_I]="JGT.i",[ROP_JGE_I]="JGE.i",[ROP_JEQ_I]="JEQ.i",[ROP_JNE_I]="JNE.i",
+		[ROP_JLT_F]="JLT.f",[ROP_JLE_F]="JLE.f",[ROP_JGT_F]="JGT.f",[ROP_JGE_F]="JGE.f",[ROP_JEQ_F]="JEQ.f",[ROP_JNE_F]="JNE.f",
+		[ROP_JLTK_I]="JLTK.i",[ROP_JLEK_I]="JLEK.i",[ROP_JGTK_I]="JGTK.i",
+		[ROP_JGEK_I]="JGEK.i",[ROP_JEQK_I]="JEQK.i",[ROP_JNEK_I]="JNEK.i",
+		[ROP_CALL]="CALL",[ROP_CALL_EXT]="CALL_EXT",[ROP_TAILCALL]="TAILCALL",[ROP_CALL_MEMO]="CALL_MEMO",
+		[ROP_MEMO_RET]="MEMO_RET",[ROP_RET]="RET",[ROP_RET_VOID]="RET_VOID",
+		[ROP_VADD_F]="VADD.f",[ROP_VMULADD_F]="VMULADD.f",[ROP_VSUM_I]="VSUM.i",
+		};
+	return op>=0&&op<ROP_COUNT&&names[op]?names[op]:"?";
+	}
+
+// shows the executed instruction i in the execution trace, with the value v which it computed or returned
+// and, for a conditional jump, if it jumped
+static void showRInstr(RInstr *i,Val v,bool taken){
+	const char *name=regOpName(i->op);
+	// the host function was shown before it was called, because it can print
+	if(i->op==ROP_CALL_EXT){
+		putchar('\n');
+		return;
+		}
+	printf("%p\t",(void*)i);
+	switch(i->op){
+		case ROP_HALT:
+		case ROP_MEMO_RET:
+			printf("%s\t// i:%d, f:%g\n",name,v.i,v.f);
+			break;
+		case ROP_MOV:printf("%s\tr%d, r%d\t// i:%d, f:%g\n",name,i->a,i->b,v.i,v.f);break;
+		case ROP_LOADK:printf("%s\tr%d\t// i:%d, f:%g\n",name,i->a,v.i,v.f);break;
+		case ROP_ADDR:case ROP_CADDR:case ROP_FPADDR:
+			printf("%s\tr%d, %d\t// %p\n",name,i->a,i->b,v.p);
+			break;
+		case ROP_ADD_F:case ROP_SUB_F:case ROP_MUL_F:case ROP_DIV_F:case ROP_STORE_F:
+			printf("%s\tr%d, r%d, r%d\t// %g\n",name,i->a,i->b,i->c,v.f);
+			break;
+		case ROP_CONV_I_F:case ROP_LOAD_F:
+			printf("%s\tr%d, r%d\t// %g\n",name,i->a,i->b,v.f);
+			break;
+		case ROP_CONV_F_I:case ROP_LOAD_I:case ROP_LOAD_C:
+			printf("%s\tr%d, r%d\t// %d\n",name,i->a,i->b,v.i);
+			break;
+		case ROP_DIVM_I:printf("%s\tr%d, r%d, %d, %d\t// %d\n",name,i->a,i->b,i->c,i->k.i,v.i);break;
+		case ROP_INDEX:printf("%s\tr%d, r%d, r%d, %d\t// %p\n",name,i->a,i->b,i->c,i->k.i,v.p);break;
+		case ROP_OFFSET:printf("%s\tr%d, r%d, %d\t// %p\n",name,i->a,i->b,i->c,v.p);break;
+		case ROP_ADDK_I:case ROP_MULK_I:case ROP_SHL_I:case ROP_SHR_I:
+			printf("%s\tr%d, r%d, %d\t// %d\n",name,i->a,i->b,i->c,v.i);
+			break;
+		case ROP_BOUNDS:printf("%s\tr%d, %d\n",name,i->a,i->b);break;
+		case ROP_JMP:printf("%s\t%p\n",name,(void*)i->target);break;
+		case ROP_JF:case ROP_JT:
+			printf("%s\tr%d, %p\t// %d\n",name,i->a,(void*)i->target,taken);
+			break;
+		case ROP_JLTK_I:case ROP_JLEK_I:case ROP_JGTK_I:case ROP_JGEK_I:case ROP_JEQK_I:case ROP_JNEK_I:
+			printf("%s\tr%d, %d, %p\t// %d\n",name,i->a,i->b,(void*)i->target,taken);
+			break;
+		case ROP_CALL:case ROP_TAILCALL:
+			printf("%s\tr%d, %d, %d, %p\n",name,i->a,i->b,i->c,(void*)i->target);
+			break;
+		case ROP_CALL_MEMO:
+			printf("%s\tr%d, %d, %d, %p",name,i->a,i->b,i->c,(void*)i->target);
+			if(!taken)printf("\t// hit -> i:%d, f:%g",v.i,v.f);
+			putchar('\n');
+			break;
+		case ROP_RET:printf("%s\tr%d, %d\t// i:%d, f:%g\n",name,i->a,i->b,v.i,v.f);break;
+		case ROP_RET_VOID:printf("%s\t%d\n",name,i->b);break;
+		case ROP_VADD_F:case ROP_VMULADD_F:case ROP_VSUM_I:
+			printf("%s\tr%d\n",name,i->a);
+			break;
+		default:
+			if(i->op>=ROP_JLT_I&&i->op<=ROP_JNE_F){
+				printf("%s\tr%d, r%d, %p\t// %d\n",name,i->a,i->b,(void*)i->target,taken);
+			}else printf("%s\tr%d, r%d, r%d\t// %d\n",name,i->a,i->b,i->c,v.i);
+		}
+	}
+
+// simulates in the data cache the memory accesses of the instruction i
+static void cacheAccess(RInstr *i,Val *R){
+	Val *ops=R+i->a;
+	switch(i->op){
+		case ROP_LOAD_C:case ROP_STORE_C:vmCacheAccess(R[i->b].p,1);break;
+		case ROP_LOAD_I:case ROP_STORE_I:vmCacheAccess(R[i->b].p,sizeof(int));break;
+		case ROP_LOAD_F:case ROP_STORE_F:vmCacheAccess(R[i->b].p,sizeof(double));break;
+		case ROP_VADD_F:
+		case ROP_VMULADD_F:
+			for(unsigned j=0,n=(unsigned)ops[i->op==ROP_VADD_F?3:4].i;j<n;j++){
+				vmCacheAccess((double*)ops[1].p+j,sizeof(double));
+				vmCacheAccess((double*)ops[2].p+j,sizeof(double));
+				vmCacheAccess((double*)ops[0].p+j,sizeof(double));
+				}
+			break;
+		case ROP_VSUM_I:
+			for(unsigned j=0,n=(unsigned)ops[2].i;j<n;j++)vmCacheAccess((int*)ops[1].p+j,sizeof(int));
+			break;
+		default:break;
+		}
+	}
+
+void runReg(RInstr *IP){
+	Val *R=stack-1;		// the registers of the current function (its FP)
+	Val v,rv={0};		// rv is the last returned value, for MEMO_RET
+	Val *fp;
+	double x,y;
+	int iv;
+	for(;;){
+		RInstr *i=IP;
+		if(vmStats){
+			vmDispatches++;
+			ropCounts[i->op]++;
+			cacheAccess(i,R);
+			}
+		switch(i->op){
+			case ROP_HALT:
+				showRInstr(i,rv,false);
+				return;
+			case ROP_MOV:R[i->a]=R[i->b];IP++;break;
+			case ROP_LOADK:R[i->a]=i->k;IP++;break;
+			case ROP_ADDR:R[i->a].p=DS+i->b;IP++;break;
+			case ROP_CADDR:R[i->a].p=CS+i->b;IP++;break;
+			case ROP_FPADDR:R[i->a].p=&R[i->b];IP++;break;
+			case ROP_ADD_I:R[i->a].i=R[i->b].i+R[i->c].i;IP++;break;
+			case ROP_SUB_I:R[i->a].i=R[i->b].i-R[i->c].i;IP++;break;
+			case ROP_MUL_I:R[i->a].i=R[i->b].i*R[i->c].i;IP++;break;
+			case ROP_DIV_I:
+				if(R[i->c].i==0)err("division by zero");
+				R[i->a].i=R[i->b].i/R[i->c].i;
+				IP++;
+				break;
+			case ROP_ADDK_I:R[i->a].i=R[i->b].i+i->c;IP++;break;
+			case ROP_MULK_I:R[i->a].i=R[i->b].i*i->c;IP++;break;
+			case ROP_SHL_I:R[i->a].i=(int)((unsigned)R[i->b].i<<i->c);IP++;break;
+			case ROP_SHR_I:
+				iv=R[i->b].i;
+				R[i->a].i=(iv<0?iv+((1<<i->c)-1):iv)>>i->c;
+				IP++;
+				break;
+			case ROP_DIVM_I:{
+				int n=R[i->b].i;
+				iv=(int)(((long long)n*i->k.i)>>32);
+				if(i->k.i<0)iv+=n;
+				R[i->a].i=(iv>>i->c)+(int)((unsigned)n>>31);
+				IP++;
+				break;
+				}
+			// the double operands are rounded to float, like by popd
+			case ROP_ADD_F:x=(float)R[i->b].f;y=(float)R[i->c].f;R[i->a].f=x+y;IP++;break;
+			case ROP_SUB_F:x=(float)R[i->b].f;y=(float)R[i->c].f;R[i->a].f=x-y;IP++;break;
+			case ROP_MUL_F:x=(float)R[i->b].f;y=(float)R[i->c].f;R[i->a].f=x*y;IP++;break;
+			case ROP_DIV_F:x=(float)R[i->b].f;y=(float)R[i->c].f;R[i->a].f=x/y;IP++;break;
+			case ROP_CONV_I_F:R[i->a].f=(double)R[i->b].i;IP++;break;
+			case ROP_CONV_F_I:x=(float)R[i->b].f;R[i->a].i=(int)x;IP++;break;
+			case ROP_LESS_I:R[i->a].i=R[i->b].i<R[i->c].i;IP++;break;
+			case ROP_LESSEQ_I:R[i->a].i=R[i->b].i<=R[i->c].i;IP++;break;
+			case ROP_GREATER_I:R[i->a].i=R[i->b].i>R[i->c].i;IP++;break;
+			case ROP_GREATEREQ_I:R[i->a].i=R[i->b].i>=R[i->c].i;IP++;break;
+			case ROP_EQUAL_I:R[i->a].i=R[i->b].i==R[i->c].i;IP++;break;
+			case ROP_NOTEQ_I:R[i->a].i=R[i->b].i!=R[i->c].i;IP++;break;
+			case ROP_LESS_F:x=(float)R[i->b].f;y=(float)R[i->c].f;R[i->a].i=x<y;IP++;break;
+			case ROP_LESSEQ_F:x=(float)R[i->b].f;y=(float)R[i->c].f;R[i->a].i=x<=y;IP++;break;
+			case ROP_GREATER_F:x=(float)R[i->b].f;y=(float)R[i->c].f;R[i->a].i=x>y;IP++;break;
+			case ROP_GREATEREQ_F:x=(float)R[i->b].f;y=(float)R[i->c].f;R[i->a].i=x>=y;IP++;break;
+			case ROP_EQUAL_F:x=(float)R[i->b].f;y=(float)R[i->c].f;R[i->a].i=x==y;IP++;break;
+			case ROP_NOTEQ_F:x=(float)R[i->b].f;y=(float)R[i->c].f;R[i->a].i=x!=y;IP++;break;
+			case ROP_LOAD_I:R[i->a].i=*(int*)R[i->b].p;IP++;break;
+			case ROP_LOAD_F:R[i->a].f=*(double*)R[i->b].p;IP++;break;
+			case ROP_LOAD_C:R[i->a].i=*(char*)R[i->b].p;IP++;break;
+			case ROP_STORE_I:
+				iv=R[i->c].i;
+				*(int*)R[i->b].p=iv;
+				R[i->a].i=iv;
+				IP++;
+				break;
+			case ROP_STORE_F:
+				x=(float)R[i->c].f;
+				*(double*)R[i->b].p=x;
+				R[i->a].f=x;
+				IP++;
+				break;
+			case ROP_STORE_C:
+				iv=(char)R[i->c].i;
+				constStoreCheck(R[i->b].p);
+				*(char*)R[i->b].p=(char)iv;
+				R[i->a].i=iv;
+				IP++;
+				break;
+			case ROP_INDEX:R[i->a].p=(char*)R[i->b].p+(long long)R[i->c].i*i->k.i;IP++;break;
+			case ROP_OFFSET:R[i->a].p=(char*)R[i->b].p+i->c;IP++;break;
+			case ROP_BOUNDS:
+				iv=R[i->a].i;
+				if(iv<0||iv>=i->b)err("index %d out of the bounds of an array with %d elements",iv,i->b);
+				IP++;
+				break;
+			case ROP_JMP:IP=i->target;break;
+			case ROP_JF:IP=R[i->a].i?IP+1:i->target;break;
+			case ROP_JT:IP=R[i->a].i?i->target:IP+1;break;
+			case ROP_JLT_I:IP=R[i->a].i<R[i->b].i?i->target:IP+1;break;
+			case ROP_JLE_I:IP=R[i->a].i<=R[i->b].i?i->target:IP+1;break;
+			case ROP_JGT_I:IP=R[i->a].i>R[i->b].i?i->target:IP+1;break;
+			case ROP_JGE_I:IP=R[i->a].i>=R[i->b].i?i->target:IP+1;break;
+			case ROP_JEQ_I:IP=R[i->a].i==R[i->b].i?i->target:IP+1;break;
+			case ROP_JNE_I:IP=R[i->a].i!=R[i->b].i?i->target:IP+1;break;
+			case ROP_JLT_F:x=(float)R[i->a].f;y=(float)R[i->b].f;IP=!(x>=y)?i->target:IP+1;break;
+			case ROP_JLE_F:x=(float)R[i->a].f;y=(float)R[i->b].f;IP=!(x>y)?i->target:IP+1;break;
+			case ROP_JGT_F:x=(float)R[i->a].f;y=(float)R[i->b].f;IP=!(x<=y)?i->target:IP+1;break;
+			case ROP_JGE_F:x=(float)R[i->a].f;y=(float)R[i->b].f;IP=!(x<y)?i->target:IP+1;break;
+			case ROP_JEQ_F:x=(float)R[i->a].f;y=(float)R[i->b].f;IP=!(x!=y)?i->target:IP+1;break;
+			case ROP_JNE_F:x=(float)R[i->a].f;y=(float)R[i->b].f;IP=!(x==y)?i->target:IP+1;break;
+			case ROP_JLTK_I:IP=R[i->a].i<i->b?i->target:IP+1;break;
+			case ROP_JLEK_I:IP=R[i->a].i<=i->b?i->target:IP+1;break;
+			case ROP_JGTK_I:IP=R[i->a].i>i->b?i->target:IP+1;break;
+			case ROP_JGEK_I:IP=R[i->a].i>=i->b?i->target:IP+1;break;
+			case ROP_JEQK_I:IP=R[i->a].i==i->b?i->target:IP+1;break;
+			case ROP_JNEK_I:IP=R[i->a].i!=i->b?i->target:IP+1;break;
+			case ROP_CALL:
+				// the return address and the old FP are stored after the arguments
+				fp=R+i->a+i->b+1;
+				if(fp+i->c>stack+MAXSTACK)err("trying to push into a full stack");
+				fp[-1].p=IP+1;
+				fp[0].p=R;
+				R=fp;
+				IP=i->target;
+				break;
+			case ROP_CALL_EXT:
+				printf("%p\t%s\tr%d, %p\n",(void*)i,regOpName(i->op),i->a,(void*)i->k.extFnPtr);
+				SP=R+i->a;
+				i->k.extFnPtr();
+				IP++;
+				break;
+			case ROP_TAILCALL:{
+				Val ret=R[-1],old=R[0];
+				fp=R-i->c-1;
+				memmove(fp,R+i->a,i->b*sizeof(Val));
+				fp+=i->b+1;
+				if(fp+maxFrame>stack+MAXSTACK)err("trying to push into a full stack");
+				fp[-1]=ret;
+				fp[0]=old;
+				R=fp;
+				IP=i->target;
+				break;
+				}
+			case ROP_CALL_MEMO:{
+				MemoTable *t=memoTables[i->b];
+				if(memoLookup(t,R+i->a,&v)){
+					R[i->a]=v;
+					IP++;
+				}else{
+					memoPush(t,R+i->a,IP+1);
+					fp=R+i->a+t->nParams+1;
+					if(fp+i->c>stack+MAXSTACK)err("trying to push into a full stack");
+					fp[-1].p=&memoRet;
+					fp[0].p=R;
+					R=fp;
+					IP=i->target;
+					}
+				break;
+				}
+			case ROP_MEMO_RET:IP=memoPop(rv);break;
+			case ROP_RET:
+				// the result replaces the first argument, or the return address if there are no parameters
+				rv=R[i->a];
+				IP=R[-1].p;
+				fp=R-i->b-1;
+				R=R[0].p;
+				*fp=rv;
+				break;
+			case ROP_RET_VOID:
+				IP=R[-1].p;
+				R=R[0].p;
+				break;
+			case ROP_VADD_F:
+				fp=R+i->a;
+				vaddF(fp[0].p,fp[1].p,fp[2].p,(unsigned)fp[3].i);
+				IP++;
+				break;
+			case ROP_VMULADD_F:
+				fp=R+i->a;
+				vmuladdF(fp[0].p,fp[1].p,fp[2].p,(float)fp[3].f,(unsigned)fp[4].i);
+				IP++;
+				break;
+			case ROP_VSUM_I:
+				fp=R+i->a;
+				fp[0].i=vsumI(fp[0].i,fp[1].p,(unsigned)fp[2].i);
+				IP++;
+				break;
+			default:err("runReg: instructiune neimplementata: %d",i->op);
+			}
+		if(i->op>=ROP_MOV&&i->op<=ROP_OFFSET)v=R[i->a];
+		else if(i->op==ROP_CALL_MEMO&&IP==i+1)v=R[i->a];
+		else v=rv;
+		showRInstr(i,v,IP==i->target);
+		}
+	}
+
+void showRegVmStats(int n){
+	printf("\n// executed instructions (dispatches): %lld\n",vmDispatches);
+	printf("// register code: %d instructions, lowered from %d stack instructions\n",nRCode,nStackInstr);
+	if(!vmDispatches)return;
+	printf("// executed calls: %lld (CALL), %lld (TAILCALL), %lld (CALL_EXT), %lld (CALL_MEMO)\n",
+		ropCounts[ROP_CALL],ropCounts[ROP_TAILCALL],ropCounts[ROP_CALL_EXT],ropCounts[ROP_CALL_MEMO]);
+	showCacheStats();
+	printf("// most executed instructions:\n");
+	bool shown[ROP_COUNT]={false};
+	for(int k=0;k<n;k++){
+		int best=-1;
+		for(int op=0;op<ROP_COUNT;op++){
+			if(!shown[op]&&ropCounts[op]&&(best<0||ropCounts[op]>ropCounts[best]))best=op;
+			}
+		if(best<0)break;
+		shown[best]=true;
+		printf("//	%10lld  %5.2f%%	%s\n",ropCounts[best],100.0*ropCounts[best]/vmDispatches,regOpName(best));
+		}
+	}
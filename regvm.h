@@ -0,0 +1,107 @@
+#pragma once
+
+// register based virtual machine (atomc -vm=reg)
+// the code of the stack VM is lowered into three-address instructions, whose operands are frame slots (registers):
+//		ADD.i r3, r1, r2 - FP[3].i=FP[1].i+FP[2].i
+// the registers of a function are its parameters and local variables, with the same FP relative indexes as for
+// the stack VM, followed by a temporary register for each depth of its operand stack: T(d)=nLocals+1+d
+// the lowering keeps a symbolic operand stack, so the values of FPLOAD and PUSH are used directly from their slots
+// or as immediates, without being copied, and the result of an instruction followed by FPSTORE is computed directly
+// in the stored variable; at the jumps, the jump targets and the calls the values are moved in their temporary registers
+// the frames have the same layout as for the stack VM and they are in the same stack: the arguments of a call
+// are in consecutive temporary registers, which become the parameters of the called function, the return address
+// and the old FP are stored after them and RET puts the result in the register of the first argument
+// the double operands are rounded to float like by popd, so both VMs give identical results
+
+#include <stdbool.h>
+#include "vm.h"
+#include "ad.h"
+
+// the instructions of the register VM
+// FORMAT: ROP_<name>.<data_type>    // [operands] effect
+//		rA, rB, rC - the frame slots FP[a], FP[b], FP[c]; b and c are also used as immediates
+//		k - a constant, target - the jump target or the first instruction of the called function
+typedef enum{
+	ROP_HALT,		// ends the code execution
+	ROP_MOV,		// [rA, rB] rA=rB
+	ROP_LOADK,		// [rA, k] rA=k
+	ROP_ADDR,		// [rA, b] rA=DS+b
+	ROP_CADDR,		// [rA, b] rA=CS+b
+	ROP_FPADDR,		// [rA, b] rA=&FP[b]
+	ROP_ADD_I,		// [rA, rB, rC] rA=rB+rC
+	ROP_SUB_I,		// [rA, rB, rC] rA=rB-rC
+	ROP_MUL_I,		// [rA, rB, rC] rA=rB*rC
+	ROP_DIV_I,		// [rA, rB, rC] rA=rB/rC
+	ROP_ADDK_I,		// [rA, rB, c] rA=rB+c
+	ROP_MULK_I,		// [rA, rB, c] rA=rB*c
+	ROP_SHL_I,		// [rA, rB, c] rA=rB*2^c
+	ROP_SHR_I,		// [rA, rB, c] rA=rB/2^c, rounded towards 0
+	ROP_DIVM_I,		// [rA, rB, c, k] rA=rB/d, with the magic number k.i of d and the shift c (see OP_DIVM_I)
+	ROP_ADD_F,		// [rA, rB, rC] rA=rB+rC
+	ROP_SUB_F,		// [rA, rB, rC] rA=rB-rC
+	ROP_MUL_F,		// [rA, rB, rC] rA=rB*rC
+	ROP_DIV_F,		// [rA, rB, rC] rA=rB/rC
+	ROP_CONV_I_F,		// [rA, rB] rA=(double)rB
+	ROP_CONV_F_I,		// [rA, rB] rA=(int)rB
+	// comparisons: [rA, rB, rC] rA=rB<rC, ...
+	ROP_LESS_I,ROP_LESSEQ_I,ROP_GREATER_I,ROP_GREATEREQ_I,ROP_EQUAL_I,ROP_NOTEQ_I,
+	ROP_LESS_F,ROP_LESSEQ_F,ROP_GREATER_F,ROP_GREATEREQ_F,ROP_EQUAL_F,ROP_NOTEQ_F,
+	ROP_LOAD_I,		// [rA, rB] rA=*(int*)rB
+	ROP_LOAD_F,		// [rA, rB] rA=*(double*)rB
+	ROP_LOAD_C,		// [rA, rB] rA=*(char*)rB
+	ROP_STORE_I,		// [rA, rB, rC] *(int*)rB=rC, rA=rC
+	ROP_STORE_F,		// [rA, rB, rC] *(double*)rB=rC rounded to float, rA=the stored value
+	ROP_STORE_C,		// [rA, rB, rC] *(char*)rB=rC, rA=(char)rC
+	ROP_INDEX,		// [rA, rB, rC, k] rA=rB+rC*k.i
+	ROP_OFFSET,		// [rA, rB, c] rA=rB+c
+	// the instructions from MOV to OFFSET compute rA
+	ROP_BOUNDS,		// [rA, b] stops the program if rA is not in [0,b) (the check of INDEX_CHK)
+	ROP_JMP,		// [target] unconditional jump
+	ROP_JF,		// [rA, target] jumps if rA is false
+	ROP_JT,		// [rA, target] jumps if rA is true
+	// compare and branch: [rA, rB, target] jumps if rA<rB, ... (for doubles like OP_JLT_D)
+	ROP_JLT_I,ROP_JLE_I,ROP_JGT_I,ROP_JGE_I,ROP_JEQ_I,ROP_JNE_I,
+	ROP_JLT_F,ROP_JLE_F,ROP_JGT_F,ROP_JGE_F,ROP_JEQ_F,ROP_JNE_F,
+	// compare with an immediate and branch: [rA, b, target] jumps if rA<b, ...
+	ROP_JLTK_I,ROP_JLEK_I,ROP_JGTK_I,ROP_JGEK_I,ROP_JEQK_I,ROP_JNEK_I,
+	ROP_CALL,		// [rA, b, c, target] calls target with the b arguments from rA..., in a frame with c registers
+	ROP_CALL_EXT,		// [rA, extFnPtr] calls a host function, which pops its arguments from the VM stack ending with rA
+	ROP_TAILCALL,		// [rA, b, c, target] calls target with the b arguments from rA..., reusing the frame of the current function, which has c parameters
+	ROP_CALL_MEMO,		// [rA, b, c, target] like CALL, with memoTables[b] (see OP_CALL_MEMO)
+	ROP_MEMO_RET,		// the return address of a CALL_MEMO whose arguments were not found
+	ROP_RET,		// [rA, b] returns rA from a function with b parameters
+	ROP_RET_VOID,		// [b] returns from a function with b parameters
+	// vector instructions, with the operands of OP_VADD_F, ... in consecutive registers from rA
+	ROP_VADD_F,		// [rA] the operands c, a, b, n
+	ROP_VMULADD_F,		// [rA] the operands c, a, b, k, n
+	ROP_VSUM_I,		// [rA] the operands s, a, n and rA=s+a[0]+...+a[n-1]
+	ROP_COUNT		// the number of opcodes (not an instruction)
+	}ROpcode;
+
+typedef struct RInstr RInstr;
+
+struct RInstr{		// an instruction of the register VM
+	ROpcode op;
+	int a,b,c;
+	union{
+		Val k;
+		RInstr *target;
+		};
+	};
+
+// if true, the program runs on the register VM (atomc -vm=reg)
+extern bool regVm;
+
+// lowers the code of all the functions into a single array of register instructions, in the order of their code
+// returns the entry code, which calls fnMain and ends the execution
+RInstr *regLower(Symbol *fnMain);
+
+// returns the name of the opcode, as it is shown in the execution trace
+const char *regOpName(ROpcode op);
+
+// executes the register code starting with the given instruction
+// the executed instructions are counted in vmDispatches if vmStats is true
+void runReg(RInstr *IP);
+
+// shows the number of dispatches, the n most executed instructions and the size of the register code
+void showRegVmStats(int n);
@@ -0,0 +1,1334 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "utils.h"
+#include "opt.h"
+#include "ssa.h"
+
+bool ssaEnabled=false;
+bool ssaDumpEnabled=false;
+
+static SsaVal *newVal(SsaFn *f,IrKind kind,ValType type,int nArgs){
+	SsaVal *v=(SsaVal*)safeAlloc(sizeof(SsaVal));
+	memset(v,0,sizeof(SsaVal));
+	v->id=f->nVals++;
+	v->kind=kind;
+	v->type=type;
+	v->nArgs=nArgs;
+	if(nArgs)v->args=(SsaVal**)safeAlloc(nArgs*sizeof(SsaVal*));
+	return v;
+	}
+
+static void freeVal(SsaVal *v){
+	free(v->args);
+	free(v);
+	}
+
+static SsaBlock *newBlock(SsaFn *f){
+	SsaBlock *b=(SsaBlock*)safeAlloc(sizeof(SsaBlock));
+	memset(b,0,sizeof(SsaBlock));
+	b->id=f->nBlocks++;
+	return b;
+	}
+
+// adds the value to the end of block
+static SsaVal *appendVal(SsaBlock *b,SsaVal *v){
+	v->block=b;
+	v->next=NULL;
+	if(b->last)b->last->next=v;
+	else b->first=v;
+	b->last=v;
+	return v;
+	}
+
+// inserts the value after the phi nodes of block
+static void insertAfterPhis(SsaBlock *b,SsaVal *v){
+	v->block=b;
+	SsaVal *prev=NULL;
+	for(SsaVal *p=b->first;p&&p->kind==IR_PHI;p=p->next)prev=p;
+	if(prev){
+		v->next=prev->next;
+		prev->next=v;
+		}else{
+		v->next=b->first;
+		b->first=v;
+		}
+	if(!v->next)b->last=v;
+	}
+
+// unlinks the value from its block, without freeing it
+static void unlinkVal(SsaVal *v){
+	SsaBlock *b=v->block;
+	SsaVal *prev=NULL;
+	for(SsaVal *p=b->first;p!=v;p=p->next)prev=p;
+	if(prev)prev->next=v->next;
+	else b->first=v->next;
+	if(b->last==v)b->last=prev;
+	}
+
+static bool isConst(SsaVal *v){
+	return v->kind==IR_OP&&(v->op==OP_PUSH_I||v->op==OP_PUSH_D);
+	}
+
+static bool isConstInt(SsaVal *v){
+	return v->kind==IR_OP&&v->op==OP_PUSH_I;
+	}
+
+// returns true if the opcode ends a basic block
+static bool isTermOp(Opcode op){
+	Instr i={.op=op};
+	return isJump(&i)||op==OP_RET||op==OP_RET_VOID||op==OP_TAILCALL||op==OP_HALT;
+	}
+
+// replaces all the uses of the value old with the value v
+static void replaceUses(SsaFn *f,SsaVal *old,SsaVal *v){
+	for(SsaBlock *b=f->blocks;b;b=b->next){
+		for(SsaVal *u=b->first;u;u=u->next){
+			for(int k=0;k<u->nArgs;k++){
+				if(u->args[k]==old)u->args[k]=v;
+				}
+			}
+		}
+	}
+
+// sets consecutive ids for the blocks and the values
+static void renumber(SsaFn *f){
+	f->nBlocks=0;
+	f->nVals=0;
+	for(SsaBlock *b=f->blocks;b;b=b->next){
+		b->id=f->nBlocks++;
+		for(SsaVal *v=b->first;v;v=v->next)v->id=f->nVals++;
+		}
+	}
+
+static ValType typeOf(Type *t){
+	if(t->n>=0||t->tb==TB_STRUCT)return VT_PTR;
+	switch(t->tb){
+		case TB_DOUBLE:return VT_DOUBLE;
+		case TB_VOID:return VT_NONE;
+		default:return VT_INT;
+		}
+	}
+
+// the type of the value produced by a VM instruction
+static ValType resultType(Instr *i){
+	switch(i->op){
+		case OP_PUSH_D:case OP_ADD_D:case OP_SUB_F:case OP_MUL_F:case OP_DIV_F:
+		case OP_CONV_I_F:case OP_LOAD_F:case OP_STORE_F:
+			return VT_DOUBLE;
+		case OP_ADDR:case OP_CADDR:case OP_FPADDR_I:case OP_FPADDR_F:case OP_FPADDR:
+		case OP_INDEX:case OP_INDEX_CHK:case OP_OFFSET:
+			return VT_PTR;
+		case OP_CALL:case OP_CALL_EXT:{
+			Symbol *fn=findFn(i);
+			return fn?typeOf(&fn->type):VT_NONE;
+			}
+		default:{
+			int pops,pushes;
+			return stackEffect(i,&pops,&pushes)&&pushes?VT_INT:VT_NONE;
+			}
+		}
+	}
+
+// the state of the lifting
+static SsaFn *lf;		// the function which is lifted
+static int lNParams;		// the number of parameters
+static int lNVars;		// the number of frame slots: parameters, return address, old FP, locals
+static bool *lPromoted;		// the slots which become virtual registers
+static ValType *lVarType;
+static SsaVal **lCur;		// the current values of the promoted slots
+static SsaVal **lStack;
+static int lDepth;
+static SsaBlock *lBlock;
+
+static int varOf(int idx){
+	return idx+lNParams+1;
+	}
+
+static SsaVal *addOp(Opcode op,Val arg,int arg2,ValType type,int nArgs){
+	SsaVal *v=newVal(lf,IR_OP,type,nArgs);
+	v->op=op;
+	v->arg=arg;
+	v->arg2=arg2;
+	for(int k=0;k<nArgs;k++)v->args[k]=lStack[lDepth-nArgs+k];
+	lDepth-=nArgs;
+	return appendVal(lBlock,v);
+	}
+
+static SsaVal *loadSlot(int idx){
+	int var=varOf(idx);
+	if(lPromoted[var])return lCur[var];
+	return addOp(OP_FPLOAD,(Val){.i=idx},0,lVarType[var],0);
+	}
+
+static void storeSlot(int idx,SsaVal *v){
+	int var=varOf(idx);
+	if(lPromoted[var]){
+		lCur[var]=v;
+		}else{
+		lStack[lDepth++]=v;
+		addOp(OP_FPSTORE,(Val){.i=idx},0,VT_NONE,1);
+		}
+	}
+
+// lifts a VM instruction into the current block, using the simulated stack
+// returns false if the instruction is not known
+static bool liftInstr(Instr *i){
+	SsaVal *v;		// it is not assigned in the same expression with lDepth++, because addOp changes lDepth
+	switch(i->op){
+		case OP_NOP:return true;
+		case OP_DROP:lDepth--;return true;
+		case OP_FPLOAD:
+			v=loadSlot(i->arg.i);
+			lStack[lDepth++]=v;
+			return true;
+		case OP_FPSTORE:
+			lDepth--;
+			storeSlot(i->arg.i,lStack[lDepth]);
+			return true;
+		case OP_INCFP_I:
+			v=loadSlot(i->arg.i);
+			lStack[lDepth++]=v;
+			storeSlot(i->arg.i,addOp(OP_ADDC_I,(Val){.i=i->arg2},0,VT_INT,1));
+			return true;
+		case OP_ADDFP_I:
+			v=loadSlot(i->arg.i);
+			lStack[lDepth++]=v;
+			v=loadSlot(i->arg2);
+			lStack[lDepth++]=v;
+			v=addOp(OP_ADD_I,(Val){.i=0},0,VT_INT,2);
+			lStack[lDepth++]=v;
+			return true;
+		case OP_RET:
+			addOp(i->op,i->arg,i->arg2,VT_NONE,1);
+			return true;
+		case OP_RET_VOID:
+		case OP_HALT:
+			addOp(i->op,i->arg,i->arg2,VT_NONE,0);
+			return true;
+		case OP_TAILCALL:{
+			Symbol *fn=findFn(i);
+			addOp(i->op,i->arg,i->arg2,VT_NONE,symbolsLen(fn->fn.params));
+			return true;
+			}
+		default:{
+			int pops,pushes;
+			if(!stackEffect(i,&pops,&pushes)||pops>lDepth)return false;
+			Val arg=isJump(i)?(Val){.instr=NULL}:i->arg;
+			v=addOp(i->op,arg,i->arg2,pushes?resultType(i):VT_NONE,pops);
+			if(pushes)lStack[lDepth++]=v;
+			return true;
+			}
+		}
+	}
+
+// the stack depth after the instruction, or -1 if it is not known
+static int depthAfter(Instr *i,int depth){
+	int pops,pushes;
+	switch(i->op){
+		case OP_RET:pops=1;pushes=0;break;
+		case OP_RET_VOID:case OP_HALT:pops=0;pushes=0;break;
+		case OP_TAILCALL:pops=symbolsLen(findFn(i)->fn.params);pushes=0;break;
+		default:
+			if(!stackEffect(i,&pops,&pushes))return -1;
+		}
+	if(pops>depth)return -1;
+	return depth-pops+pushes;
+	}
+
+// removes the phi nodes which have the same value on all the edges (or themselves)
+static bool removeTrivialPhis(SsaFn *f){
+	bool changed=false,again;
+	do{
+		again=false;
+		for(SsaBlock *b=f->blocks;b;b=b->next){
+			for(SsaVal *p=b->first,*next;p&&p->kind==IR_PHI;p=next){
+				next=p->next;
+				SsaVal *same=NULL;
+				int k;
+				for(k=0;k<p->nArgs;k++){
+					SsaVal *a=p->args[k];
+					if(a==p||a==same)continue;
+					if(same)break;
+					same=a;
+					}
+				if(k<p->nArgs||!same)continue;
+				replaceUses(f,p,same);
+				unlinkVal(p);
+				freeVal(p);
+				changed=again=true;
+				}
+			}
+		}while(again);
+	return changed;
+	}
+
+SsaFn *ssaBuild(Symbol *fn){
+	Instr *enter=fn->fn.instr;
+	int n=0;
+	for(Instr *i=enter;i;i=i->next)n++;
+	if(n<2)return NULL;
+	Instr **code=(Instr**)safeAlloc(n*sizeof(Instr*));
+	InstrIdx *idx=(InstrIdx*)safeAlloc(n*sizeof(InstrIdx));
+	n=0;
+	for(Instr *i=enter;i;i=i->next){
+		idx[n]=(InstrIdx){i,n};
+		code[n++]=i;
+		}
+	qsort(idx,n,sizeof(InstrIdx),cmpInstrIdx);
+	SsaFn *f=(SsaFn*)safeAlloc(sizeof(SsaFn));
+	memset(f,0,sizeof(SsaFn));
+	f->fn=fn;
+	// the basic blocks start at the jump targets and after the jumps
+	SsaBlock **blockAt=(SsaBlock**)safeAlloc(n*sizeof(SsaBlock*));
+	int *depthIn=(int*)safeAlloc((n+1)*sizeof(int));
+	SsaBlock **blocks=(SsaBlock**)safeAlloc((n+1)*sizeof(SsaBlock*));
+	SsaVal ***outVars=(SsaVal***)safeAlloc((n+1)*sizeof(SsaVal**));
+	SsaVal ***outStack=(SsaVal***)safeAlloc((n+1)*sizeof(SsaVal**));
+	int *start=(int*)safeAlloc((n+1)*sizeof(int));
+	memset(blockAt,0,n*sizeof(SsaBlock*));
+	memset(outVars,0,(n+1)*sizeof(SsaVal**));
+	memset(outStack,0,(n+1)*sizeof(SsaVal**));
+	lf=f;
+	lNParams=enter->arg2;
+	lNVars=lNParams+2+enter->arg.i;
+	lPromoted=(bool*)safeAlloc(lNVars*sizeof(bool));
+	lVarType=(ValType*)safeAlloc(lNVars*sizeof(ValType));
+	lCur=(SsaVal**)safeAlloc(lNVars*sizeof(SsaVal*));
+	lStack=NULL;
+	bool ok=true;
+	bool *leader=(bool*)safeAlloc(n*sizeof(bool));
+	memset(leader,0,n*sizeof(bool));
+	leader[1]=true;
+	int maxDepth=0,depth=0;
+	for(int k=1;k<n&&ok;k++){
+		Instr *i=code[k];
+		if(isJump(i)){
+			int t=findIdx(idx,n,i->arg.instr);
+			if(t<1)ok=false;
+			else leader[t]=true;
+			}
+		if(isTermOp(i->op)&&k+1<n)leader[k+1]=true;
+		// an upper bound for the stack depth, used for the simulated stack
+		int pops,pushes;
+		if(stackEffect(i,&pops,&pushes))depth+=pushes;
+		if(maxDepth<depth)maxDepth=depth;
+		}
+	Instr *lastI=code[n-1];
+	if(!isTermOp(lastI->op)||(isJump(lastI)&&lastI->op!=OP_JMP))ok=false;		// the code must not continue after its end
+	for(int var=0;var<lNVars;var++){
+		lPromoted[var]=var!=lNParams&&var!=lNParams+1;		// FP[-1] and FP[0] are not variables
+		lVarType[var]=VT_INT;
+		}
+	int k=0;
+	for(Symbol *s=fn->fn.params;s;s=s->next,k++)lVarType[k]=typeOf(&s->type);
+	k=lNParams+2;
+	for(Symbol *s=fn->fn.locals;s&&k+s->varIdx<lNVars;s=s->next)lVarType[k+s->varIdx]=typeOf(&s->type);
+	for(int j=1;j<n&&ok;j++){
+		Instr *i=code[j];
+		int slots[2],nSlots=0;
+		switch(i->op){
+			case OP_FPADDR_I:
+			case OP_FPADDR_F:
+				if(i->arg.i<-lNParams-1||i->arg.i>enter->arg.i){ok=false;break;}
+				lPromoted[varOf(i->arg.i)]=false;
+				lVarType[varOf(i->arg.i)]=i->op==OP_FPADDR_F?VT_DOUBLE:VT_INT;
+				break;
+			case OP_FPADDR:
+				// the slots of a local array or struct hold its bytes
+				if(i->arg.i<1||i->arg.i+i->arg2-1>enter->arg.i){ok=false;break;}
+				for(int s=0;s<i->arg2;s++)lPromoted[varOf(i->arg.i+s)]=false;
+				break;
+			case OP_ADDFP_I:slots[nSlots++]=i->arg2;		// FALLTHROUGH
+			case OP_FPLOAD:case OP_FPSTORE:case OP_INCFP_I:slots[nSlots++]=i->arg.i;break;
+			default:break;
+			}
+		for(int s=0;s<nSlots;s++){
+			if(slots[s]<-lNParams-1||slots[s]>enter->arg.i||slots[s]==-1||slots[s]==0)ok=false;
+			}
+		}
+	// the entry block defines the parameters and the initial values of the local variables
+	SsaBlock *entry=newBlock(f);
+	f->blocks=entry;
+	int nBlocks=0;
+	SsaBlock *lastB=entry;
+	for(int j=1;j<n&&ok;j++){
+		if(!leader[j])continue;
+		SsaBlock *b=newBlock(f);
+		lastB->next=b;
+		lastB=b;
+		start[nBlocks]=j;
+		blocks[nBlocks++]=b;
+		blockAt[j]=b;
+		}
+	start[nBlocks]=n;
+	// the successors and the predecessors
+	entry->succ[0]=blocks[0];
+	entry->nSucc=1;
+	for(int b=0;b<nBlocks&&ok;b++){
+		Instr *i=code[start[b+1]-1];
+		SsaBlock *bl=blocks[b];
+		if(isJump(i))bl->succ[bl->nSucc++]=blockAt[findIdx(idx,n,i->arg.instr)];
+		if(!isTermOp(i->op)||(isJump(i)&&i->op!=OP_JMP)){
+			if(b+1==nBlocks)ok=false;
+			else bl->succ[bl->nSucc++]=blocks[b+1];
+			}
+		}
+	for(SsaBlock *b=f->blocks;b&&ok;b=b->next){
+		for(int s=0;s<b->nSucc;s++)b->succ[s]->nPreds++;
+		}
+	for(SsaBlock *b=f->blocks;b&&ok;b=b->next){
+		if(b->nPreds)b->preds=(SsaBlock**)safeAlloc(b->nPreds*sizeof(SsaBlock*));
+		b->nPreds=0;
+		}
+	for(SsaBlock *b=f->blocks;b&&ok;b=b->next){
+		for(int s=0;s<b->nSucc;s++)b->succ[s]->preds[b->succ[s]->nPreds++]=b;
+		}
+	// the stack depth at the beginning of each block, which must be the same from all the predecessors
+	for(int b=0;b<nBlocks;b++)depthIn[b]=-1;
+	if(ok&&nBlocks)depthIn[0]=0;
+	for(bool again=ok;again&&ok;){
+		again=false;
+		for(int b=0;b<nBlocks&&ok;b++){
+			if(depthIn[b]<0)continue;
+			int d=depthIn[b];
+			for(int j=start[b];j<start[b+1]&&d>=0;j++)d=depthAfter(code[j],d);
+			if(d<0){ok=false;break;}
+			for(int s=0;s<blocks[b]->nSucc;s++){
+				int t;
+				for(t=0;blocks[t]!=blocks[b]->succ[s];t++){}
+				if(depthIn[t]<0){
+					depthIn[t]=d;
+					again=true;
+					}else if(depthIn[t]!=d)ok=false;
+				}
+			}
+		}
+	for(int b=0;b<nBlocks&&ok;b++){
+		if(depthIn[b]<0)ok=false;		// unreachable code
+		}
+	if(ok){
+		lStack=(SsaVal**)safeAlloc((maxDepth+2)*sizeof(SsaVal*));
+		for(int var=0;var<lNVars;var++){
+			if(!lPromoted[var])continue;
+			SsaVal *v;
+			if(var<lNParams){
+				v=newVal(f,IR_PARAM,lVarType[var],0);
+				v->arg.i=var-lNParams-1;
+				}else{
+				v=newVal(f,IR_UNDEF,lVarType[var],0);
+				}
+			lCur[var]=appendVal(entry,v);
+			}
+		lBlock=entry;
+		lDepth=0;
+		addOp(OP_JMP,(Val){.instr=NULL},0,VT_NONE,0);
+		outVars[nBlocks]=(SsaVal**)safeAlloc(lNVars*sizeof(SsaVal*));
+		memcpy(outVars[nBlocks],lCur,lNVars*sizeof(SsaVal*));
+		}
+	// lifts each block, starting with phi nodes for all the promoted slots and for the values from stack
+	for(int b=0;b<nBlocks&&ok;b++){
+		lBlock=blocks[b];
+		lDepth=0;
+		for(int var=0;var<lNVars;var++){
+			if(!lPromoted[var])continue;
+			SsaVal *p=newVal(f,IR_PHI,VT_NONE,lBlock->nPreds);
+			p->arg.i=var;
+			lCur[var]=appendVal(lBlock,p);
+			}
+		for(int d=0;d<depthIn[b];d++){
+			SsaVal *p=newVal(f,IR_PHI,VT_NONE,lBlock->nPreds);
+			p->arg.i=-1-d;		// the stack position, for the filling of the operands
+			lStack[lDepth++]=appendVal(lBlock,p);
+			}
+		for(int j=start[b];j<start[b+1]&&ok;j++)ok=liftInstr(code[j]);
+		SsaVal *last=lBlock->last;
+		if(ok&&(!last||last->kind!=IR_OP||!isTermOp(last->op))){
+			addOp(OP_JMP,(Val){.instr=NULL},0,VT_NONE,0);
+			}
+		outVars[b]=(SsaVal**)safeAlloc(lNVars*sizeof(SsaVal*));
+		memcpy(outVars[b],lCur,lNVars*sizeof(SsaVal*));
+		outStack[b]=(SsaVal**)safeAlloc((lDepth+1)*sizeof(SsaVal*));
+		memcpy(outStack[b],lStack,lDepth*sizeof(SsaVal*));
+		}
+	// the operands of the phi nodes, from the values at the end of the predecessors
+	for(int b=0;b<nBlocks&&ok;b++){
+		SsaBlock *bl=blocks[b];
+		for(SsaVal *p=bl->first;p&&p->kind==IR_PHI;p=p->next){
+			for(int k=0;k<bl->nPreds;k++){
+				int pb;
+				if(bl->preds[k]==entry)pb=nBlocks;
+				else for(pb=0;blocks[pb]!=bl->preds[k];pb++){}
+				p->args[k]=p->arg.i>=0?outVars[pb][p->arg.i]:outStack[pb][-1-p->arg.i];
+				}
+			}
+		}
+	if(ok){
+		removeTrivialPhis(f);
+		// the types of the phi nodes, from their operands
+		for(bool again=true;again;){
+			again=false;
+			for(SsaBlock *b=f->blocks;b;b=b->next){
+				for(SsaVal *p=b->first;p&&p->kind==IR_PHI;p=p->next){
+					if(p->type!=VT_NONE)continue;
+					for(int k=0;k<p->nArgs;k++){
+						SsaVal *a=p->args[k];
+						if(a->type!=VT_NONE&&a->kind!=IR_UNDEF){
+							p->type=a->type;
+							again=true;
+							break;
+							}
+						}
+					}
+				}
+			}
+		for(SsaBlock *b=f->blocks;b;b=b->next){
+			for(SsaVal *p=b->first;p&&p->kind==IR_PHI;p=p->next){
+				if(p->type==VT_NONE)p->type=p->args[0]->type;		// only undefined values
+				p->arg.i=0;
+				}
+			}
+		renumber(f);
+		}
+	for(int b=0;b<=nBlocks;b++){
+		free(outVars[b]);
+		free(outStack[b]);
+		}
+	free(outVars);free(outStack);free(start);free(blocks);free(depthIn);free(blockAt);
+	free(leader);free(code);free(idx);
+	free(lPromoted);free(lVarType);free(lCur);free(lStack);
+	if(!ok){
+		ssaFree(f);
+		return NULL;
+		}
+	return f;
+	}
+
+void ssaFree(SsaFn *f){
+	for(SsaBlock *b=f->blocks,*nextB;b;b=nextB){
+		nextB=b->next;
+		for(SsaVal *v=b->first,*next;v;v=next){
+			next=v->next;
+			freeVal(v);
+			}
+		free(b->preds);
+		free(b);
+		}
+	free(f);
+	}
+
+static const char *typeName(ValType t){
+	switch(t){
+		case VT_INT:return "int";
+		case VT_DOUBLE:return "double";
+		case VT_PTR:return "ptr";
+		default:return "void";
+		}
+	}
+
+void ssaDump(SsaFn *f,const char *title){
+	renumber(f);
+	printf("// ssa %s: %s\n",f->fn->name,title);
+	for(SsaBlock *b=f->blocks;b;b=b->next){
+		printf("b%d:\t// preds:",b->id);
+		for(int k=0;k<b->nPreds;k++)printf(" b%d",b->preds[k]->id);
+		printf("\n");
+		for(SsaVal *v=b->first;v;v=v->next){
+			printf("\t");
+			if(v->type!=VT_NONE)printf("%%%d:%s = ",v->id,typeName(v->type));
+			switch(v->kind){
+				case IR_PHI:
+					printf("phi");
+					for(int k=0;k<v->nArgs;k++)printf(" [%%%d, b%d]",v->args[k]->id,b->preds[k]->id);
+					break;
+				case IR_PARAM:printf("param %d",v->arg.i);break;
+				case IR_UNDEF:printf("undef");break;
+				default:
+					printf("%s",opName(v->op));
+					switch(v->op){
+						case OP_PUSH_I:case OP_FPLOAD:case OP_FPSTORE:case OP_FPADDR_I:case OP_FPADDR_F:
+						case OP_ADDC_I:case OP_INCFP_I:case OP_RET:case OP_RET_VOID:
+						case OP_MULC_I:case OP_SHL_I:case OP_SHR_I:
+						case OP_INDEX:case OP_OFFSET:
+							printf(" %d",v->arg.i);
+							break;
+						case OP_PUSH_D:printf(" %g",v->arg.f);break;
+						case OP_DIVM_I:case OP_INDEX_CHK:case OP_FPADDR:printf(" %d, %d",v->arg.i,v->arg2);break;
+						case OP_CALL:case OP_TAILCALL:case OP_CALL_EXT:{
+							Instr i={.op=v->op,.arg=v->arg};
+							Symbol *fn=findFn(&i);
+							printf(" %s",fn?fn->name:"?");
+							}break;
+						default:break;
+						}
+					if(v->op>=OP_JLTC_I&&v->op<=OP_JNEC_I)printf(" %d",v->arg2);
+					for(int k=0;k<v->nArgs;k++)printf("%s%%%d",k?", ":" ",v->args[k]->id);
+					for(int s=0;v==b->last&&s<b->nSucc;s++)printf("%sb%d",s?", ":" -> ",b->succ[s]->id);
+				}
+			printf("\n");
+			}
+		}
+	}
+
+// the type expected for the operand k of an operation, or VT_NONE if any type is accepted
+static ValType operandType(SsaVal *v,int k){
+	switch(v->op){
+		case OP_ADD_I:case OP_SUB_I:case OP_MUL_I:case OP_DIV_I:case OP_ADDC_I:case OP_CONV_I_F:
+		case OP_MULC_I:case OP_SHL_I:case OP_SHR_I:case OP_DIVM_I:
+		case OP_LESS_I:case OP_LESSEQ_I:case OP_GREATER_I:case OP_GREATEREQ_I:case OP_EQUAL_I:case OP_NOTEQ_I:
+		case OP_JF:case OP_JT:
+		case OP_JLT_I:case OP_JLE_I:case OP_JGT_I:case OP_JGE_I:case OP_JEQ_I:case OP_JNE_I:
+		case OP_JLTC_I:case OP_JLEC_I:case OP_JGTC_I:case OP_JGEC_I:case OP_JEQC_I:case OP_JNEC_I:
+			return VT_INT;
+		case OP_ADD_D:case OP_SUB_F:case OP_MUL_F:case OP_DIV_F:case OP_CONV_F_I:
+		case OP_LESS_D:case OP_LESS_F:case OP_LESSEQ_F:case OP_GREATER_F:case OP_GREATEREQ_F:case OP_EQUAL_F:case OP_NOTEQ_F:
+		case OP_JLT_D:case OP_JLE_D:case OP_JGT_D:case OP_JGE_D:case OP_JEQ_D:case OP_JNE_D:
+			return VT_DOUBLE;
+		case OP_LOAD_I:case OP_LOAD_F:case OP_LOAD_C:case OP_OFFSET:
+			return VT_PTR;
+		case OP_INDEX:case OP_INDEX_CHK:
+		case OP_STORE_I:case OP_STORE_C:return k?VT_INT:VT_PTR;
+		case OP_STORE_F:return k?VT_DOUBLE:VT_PTR;
+		case OP_VADD_F:return k<3?VT_PTR:VT_INT;
+		case OP_VMULADD_F:return k<3?VT_PTR:k==3?VT_DOUBLE:VT_INT;
+		case OP_VSUM_I:return k==1?VT_PTR:VT_INT;
+		default:return VT_NONE;
+		}
+	}
+
+// the dominators of each block, as a matrix: dom[b*nBlocks+d] is true if d dominates b
+static bool *dominators(SsaFn *f){
+	int nb=f->nBlocks;
+	bool *dom=(bool*)safeAlloc(nb*nb*sizeof(bool));
+	for(int b=0;b<nb;b++){
+		for(int d=0;d<nb;d++)dom[b*nb+d]=b?true:d==0;
+		}
+	bool *tmp=(bool*)safeAlloc(nb*sizeof(bool));
+	for(bool again=true;again;){
+		again=false;
+		for(SsaBlock *b=f->blocks->next;b;b=b->next){
+			for(int d=0;d<nb;d++)tmp[d]=b->nPreds>0;
+			for(int k=0;k<b->nPreds;k++){
+				for(int d=0;d<nb;d++)tmp[d]=tmp[d]&&dom[b->preds[k]->id*nb+d];
+				}
+			tmp[b->id]=true;
+			if(memcmp(tmp,&dom[b->id*nb],nb*sizeof(bool))){
+				memcpy(&dom[b->id*nb],tmp,nb*sizeof(bool));
+				again=true;
+				}
+			}
+		}
+	free(tmp);
+	return dom;
+	}
+
+void ssaVerify(SsaFn *f,const char *passName){
+	renumber(f);
+	int nb=f->nBlocks;
+	SsaVal **vals=(SsaVal**)safeAlloc((f->nVals+1)*sizeof(SsaVal*));
+	int *pos=(int*)safeAlloc((f->nVals+1)*sizeof(int));
+	for(SsaBlock *b=f->blocks;b;b=b->next){
+		int p=0;
+		for(SsaVal *v=b->first;v;v=v->next){
+			vals[v->id]=v;
+			pos[v->id]=p++;
+			if(v->block!=b)err("SSA verifier (%s): %%%d is not in its block",passName,v->id);
+			}
+		}
+	bool *dom=dominators(f);
+	if(f->blocks->nPreds)err("SSA verifier (%s): the entry block has predecessors",passName);
+	for(SsaBlock *b=f->blocks;b;b=b->next){
+		if(!b->last||b->last->kind!=IR_OP||!isTermOp(b->last->op))err("SSA verifier (%s): b%d does not end with a terminator",passName,b->id);
+		int nSucc=b->last->op==OP_JMP?1:isJump(&(Instr){.op=b->last->op})?2:0;
+		if(nSucc!=b->nSucc)err("SSA verifier (%s): b%d has %d successors instead of %d",passName,b->id,b->nSucc,nSucc);
+		if(b!=f->blocks&&!b->nPreds)err("SSA verifier (%s): b%d is unreachable",passName,b->id);
+		for(int s=0;s<b->nSucc;s++){
+			int n1=0,n2=0;
+			for(int k=0;k<b->nSucc;k++)n1+=b->succ[k]==b->succ[s];
+			for(int k=0;k<b->succ[s]->nPreds;k++)n2+=b->succ[s]->preds[k]==b;
+			if(n1!=n2)err("SSA verifier (%s): the edge b%d -> b%d is not in the predecessors",passName,b->id,b->succ[s]->id);
+			}
+		for(int k=0;k<b->nPreds;k++){
+			SsaBlock *p=b->preds[k];
+			if(p->succ[0]!=b&&(p->nSucc<2||p->succ[1]!=b))err("SSA verifier (%s): b%d is not a successor of b%d",passName,b->id,p->id);
+			}
+		bool phis=true;
+		for(SsaVal *v=b->first;v;v=v->next){
+			if(v->kind==IR_PHI){
+				if(!phis)err("SSA verifier (%s): the phi %%%d is after other instructions",passName,v->id);
+				if(v->nArgs!=b->nPreds)err("SSA verifier (%s): the phi %%%d has %d operands for %d predecessors",passName,v->id,v->nArgs,b->nPreds);
+				}else phis=false;
+			if(v!=b->last&&v->kind==IR_OP&&isTermOp(v->op))err("SSA verifier (%s): the terminator %%%d is not at the end of b%d",passName,v->id,b->id);
+			for(int k=0;k<v->nArgs;k++){
+				SsaVal *a=v->args[k];
+				if(a->id>=f->nVals||vals[a->id]!=a)err("SSA verifier (%s): the operand %d of %%%d is not defined",passName,k,v->id);
+				if(a->type==VT_NONE)err("SSA verifier (%s): the operand %%%d of %%%d has no value",passName,a->id,v->id);
+				// the definition must dominate the use (for phi nodes, the end of the predecessor)
+				SsaBlock *useB=v->kind==IR_PHI?b->preds[k]:b;
+				if(a->block==useB&&v->kind!=IR_PHI){
+					if(pos[a->id]>=pos[v->id])err("SSA verifier (%s): %%%d is used by %%%d before its definition",passName,a->id,v->id);
+					}else if(!dom[useB->id*nb+a->block->id]){
+					err("SSA verifier (%s): the definition of %%%d does not dominate its use in %%%d",passName,a->id,v->id);
+					}
+				ValType t=v->kind==IR_PHI?v->type:v->kind==IR_OP?operandType(v,k):VT_NONE;
+				if(t!=VT_NONE&&a->kind!=IR_UNDEF&&a->type!=t){
+					err("SSA verifier (%s): the operand %%%d of %%%d is %s instead of %s",passName,a->id,v->id,typeName(a->type),typeName(t));
+					}
+				}
+			}
+		}
+	free(dom);
+	free(vals);
+	free(pos);
+	}
+
+void ssaRunPasses(SsaFn *f,const SsaPass *passes,int nPasses){
+	for(bool changed=true;changed;){
+		changed=false;
+		for(int k=0;k<nPasses;k++){
+			if(!passes[k].run(f))continue;
+			changed=true;
+			ssaVerify(f,passes[k].name);
+			if(ssaDumpEnabled)ssaDump(f,passes[k].name);
+			}
+		}
+	}
+
+// removes the edge from -> to, with the corresponding operands of the phi nodes from to
+static void removeEdge(SsaBlock *from,SsaBlock *to){
+	int k;
+	for(k=0;to->preds[k]!=from;k++){}
+	for(int j=k;j+1<to->nPreds;j++)to->preds[j]=to->preds[j+1];
+	to->nPreds--;
+	for(SsaVal *p=to->first;p&&p->kind==IR_PHI;p=p->next){
+		for(int j=k;j+1<p->nArgs;j++)p->args[j]=p->args[j+1];
+		p->nArgs--;
+		}
+	}
+
+// returns the result of an int operation with constant operands in *r
+// returns false if the operation cannot be folded
+static bool foldInt(SsaVal *v,int *r){
+	if(v->kind!=IR_OP||v->type!=VT_INT)return false;
+	for(int k=0;k<v->nArgs;k++){
+		if(!isConstInt(v->args[k]))return false;
+		}
+	int a=v->nArgs>0?v->args[0]->arg.i:0;
+	int b=v->nArgs>1?v->args[1]->arg.i:0;
+	switch(v->op){
+		// the arithmetic is done on unsigned, to wrap around like the VM
+		case OP_ADD_I:*r=(int)((unsigned)a+(unsigned)b);return true;
+		case OP_SUB_I:*r=(int)((unsigned)a-(unsigned)b);return true;
+		case OP_MUL_I:*r=(int)((unsigned)a*(unsigned)b);return true;
+		case OP_ADDC_I:*r=(int)((unsigned)a+(unsigned)v->arg.i);return true;
+		case OP_MULC_I:*r=(int)((unsigned)a*(unsigned)v->arg.i);return true;
+		case OP_SHL_I:*r=(int)((unsigned)a<<v->arg.i);return true;
+		case OP_SHR_I:*r=a/(1<<v->arg.i);return true;
+		case OP_DIV_I:
+			if(b==0||(a==INT_MIN&&b==-1))return false;		// it remains a runtime error
+			*r=a/b;
+			return true;
+		case OP_LESS_I:*r=a<b;return true;
+		case OP_LESSEQ_I:*r=a<=b;return true;
+		case OP_GREATER_I:*r=a>b;return true;
+		case OP_GREATEREQ_I:*r=a>=b;return true;
+		case OP_EQUAL_I:*r=a==b;return true;
+		case OP_NOTEQ_I:*r=a!=b;return true;
+		default:return false;
+		}
+	}
+
+// returns 1 if the conditional jump is always taken, 0 if it is never taken or -1 if it is not known
+static int foldJump(SsaVal *t){
+	for(int k=0;k<t->nArgs;k++){
+		if(!isConstInt(t->args[k]))return -1;
+		}
+	int a=t->nArgs>0?t->args[0]->arg.i:0;
+	int b=t->nArgs>1?t->args[1]->arg.i:t->arg2;
+	switch(t->op){
+		case OP_JF:return a==0;
+		case OP_JT:return a!=0;
+		case OP_JLT_I:case OP_JLTC_I:return a<b;
+		case OP_JLE_I:case OP_JLEC_I:return a<=b;
+		case OP_JGT_I:case OP_JGTC_I:return a>b;
+		case OP_JGE_I:case OP_JGEC_I:return a>=b;
+		case OP_JEQ_I:case OP_JEQC_I:return a==b;
+		case OP_JNE_I:case OP_JNEC_I:return a!=b;
+		default:return -1;
+		}
+	}
+
+static bool sameConst(SsaVal *a,SsaVal *b){
+	if(!isConst(a)||!isConst(b)||a->op!=b->op)return false;
+	return a->op==OP_PUSH_I?a->arg.i==b->arg.i:!memcmp(&a->arg.f,&b->arg.f,sizeof(double));
+	}
+
+// removes the blocks which cannot be reached from the entry
+static bool removeUnreachable(SsaFn *f){
+	renumber(f);
+	bool *reached=(bool*)safeAlloc(f->nBlocks*sizeof(bool));
+	SsaBlock **work=(SsaBlock**)safeAlloc(f->nBlocks*sizeof(SsaBlock*));
+	memset(reached,0,f->nBlocks*sizeof(bool));
+	int nWork=0;
+	reached[0]=true;
+	work[nWork++]=f->blocks;
+	while(nWork){
+		SsaBlock *b=work[--nWork];
+		for(int s=0;s<b->nSucc;s++){
+			if(!reached[b->succ[s]->id]){
+				reached[b->succ[s]->id]=true;
+				work[nWork++]=b->succ[s];
+				}
+			}
+		}
+	bool changed=false;
+	for(SsaBlock *b=f->blocks;b;b=b->next){
+		if(reached[b->id])continue;
+		for(int s=0;s<b->nSucc;s++)removeEdge(b,b->succ[s]);
+		b->nSucc=0;
+		changed=true;
+		}
+	for(SsaBlock *prev=f->blocks,*b=prev->next;b;b=prev->next){
+		if(reached[b->id]){
+			prev=b;
+			continue;
+			}
+		prev->next=b->next;
+		for(SsaVal *v=b->first,*next;v;v=next){
+			next=v->next;
+			freeVal(v);
+			}
+		free(b->preds);
+		free(b);
+		}
+	free(reached);
+	free(work);
+	return changed;
+	}
+
+bool ssaConstProp(SsaFn *f){
+	bool changed=false;
+	for(bool again=true;again;){
+		again=false;
+		for(SsaBlock *b=f->blocks;b;b=b->next){
+			for(SsaVal *v=b->first,*next;v;v=next){
+				next=v->next;
+				int r;
+				if(v->kind==IR_PHI){
+					int k;
+					for(k=1;k<v->nArgs&&sameConst(v->args[0],v->args[k]);k++){}
+					if(!v->nArgs||k<v->nArgs||!isConst(v->args[0]))continue;
+					// the phi becomes the constant, after the phi nodes
+					SsaVal *c=v->args[0];
+					unlinkVal(v);
+					v->kind=IR_OP;
+					v->op=c->op;
+					v->arg=c->arg;
+					v->nArgs=0;
+					insertAfterPhis(b,v);
+					}else if(foldInt(v,&r)){
+					v->op=OP_PUSH_I;
+					v->arg.i=r;
+					v->arg2=0;
+					v->nArgs=0;
+					}else if(v==b->last&&b->nSucc==2){
+					int taken=foldJump(v);
+					if(taken<0)continue;
+					SsaBlock *keep=b->succ[taken?0:1],*drop=b->succ[taken?1:0];
+					removeEdge(b,drop);
+					v->op=OP_JMP;
+					v->nArgs=0;
+					v->arg2=0;
+					b->succ[0]=keep;
+					b->nSucc=1;
+					}else continue;
+				optStats.ssaFolded++;
+				changed=again=true;
+				}
+			}
+		if(removeUnreachable(f))again=true;
+		if(removeTrivialPhis(f))again=true;
+		}
+	return changed;
+	}
+
+// returns true if the value must be kept even if it is not used
+static bool hasSideEffects(SsaVal *v){
+	if(v->kind!=IR_OP)return false;
+	if(isTermOp(v->op))return true;
+	switch(v->op){
+		case OP_STORE_I:case OP_STORE_F:case OP_STORE_C:case OP_FPSTORE:case OP_INCFP_I:
+		case OP_VADD_F:case OP_VMULADD_F:
+		case OP_CALL:case OP_CALL_EXT:
+		case OP_INDEX_CHK:		// it can trap
+			return true;
+		case OP_DIV_I:{		// it can trap
+			SsaVal *d=v->args[1];
+			return !isConstInt(d)||d->arg.i==0||d->arg.i==-1;
+			}
+		default:return false;
+		}
+	}
+
+bool ssaDeadValues(SsaFn *f){
+	renumber(f);
+	bool *live=(bool*)safeAlloc(f->nVals*sizeof(bool));
+	SsaVal **work=(SsaVal**)safeAlloc(f->nVals*sizeof(SsaVal*));
+	memset(live,0,f->nVals*sizeof(bool));
+	int nWork=0;
+	for(SsaBlock *b=f->blocks;b;b=b->next){
+		for(SsaVal *v=b->first;v;v=v->next){
+			if(hasSideEffects(v)){
+				live[v->id]=true;
+				work[nWork++]=v;
+				}
+			}
+		}
+	while(nWork){
+		SsaVal *v=work[--nWork];
+		for(int k=0;k<v->nArgs;k++){
+			SsaVal *a=v->args[k];
+			if(!live[a->id]){
+				live[a->id]=true;
+				work[nWork++]=a;
+				}
+			}
+		}
+	bool changed=false;
+	for(SsaBlock *b=f->blocks;b;b=b->next){
+		for(SsaVal *v=b->first,*next;v;v=next){
+			next=v->next;
+			if(live[v->id])continue;
+			unlinkVal(v);
+			freeVal(v);
+			optStats.ssaDead++;
+			changed=true;
+			}
+		}
+	free(live);
+	free(work);
+	return changed;
+	}
+
+// the state of the lowering
+static SsaFn *wf;
+static int wN;		// the number of values
+static SsaVal **wVals;		// the values, by id
+static int *wUses;		// the number of uses of each value
+static char *wLoc;		// where each value is kept, LOC_*
+static int *wClass;		// union-find of the values which share the same frame slot
+static int *wSlot;		// the FP index of each class representative, or INT_MIN
+static bool *wInter;		// the interference matrix
+static SsaVal **wPending;		// the values which are on the VM stack
+static SsaVal **wPendingUser;		// the value which will use each pending value
+static int wNPending;
+typedef struct{
+	SsaVal *v,*user;
+	}Preload;
+static Preload **wPre;		// the operands loaded in advance, before the evaluation of each value
+static int *wNPre;
+static int wMaxSlot;
+static Instr *wTail;		// the last generated instruction
+
+enum{
+	LOC_NONE,		// nothing to keep: no result, constant or undefined value (rematerialized at each use)
+	LOC_STACK,		// it remains on the VM stack for its only use, from the same block
+	LOC_SLOT,		// it is kept in a frame slot
+	LOC_SPILLED		// it was on the VM stack, but it was moved into a frame slot
+	};
+
+static int classOf(int x){
+	while(wClass[x]!=x)x=wClass[x]=wClass[wClass[x]];
+	return x;
+	}
+
+// returns true if a value from the class a interferes with a value from the class b
+static bool classesInterfere(int a,int b){
+	for(int x=0;x<wN;x++){
+		if(wLoc[x]!=LOC_SLOT||classOf(x)!=a)continue;
+		for(int y=0;y<wN;y++){
+			if(wLoc[y]==LOC_SLOT&&wInter[x*wN+y]&&classOf(y)==b)return true;
+			}
+		}
+	return false;
+	}
+
+static Instr *emit(Opcode op){
+	wTail=insertInstr(wTail,op);
+	wTail->arg.i=0;
+	wTail->arg2=0;
+	return wTail;
+	}
+
+// puts on stack a value which is not already on stack
+static void materialize(SsaVal *v){
+	if(isConst(v)){
+		emit(v->op)->arg=v->arg;
+		}else if(v->kind==IR_UNDEF){
+		emit(OP_PUSH_I);
+		}else{
+		emit(OP_FPLOAD)->arg.i=wSlot[classOf(v->id)];
+		}
+	}
+
+static void pushPending(SsaVal *v,SsaVal *user){
+	wPending[wNPending]=v;
+	wPendingUser[wNPending++]=user;
+	}
+
+// puts on stack the operands of v
+// the operands which are already on stack must be on its top, in the right order, else they are spilled
+// (the operands loaded in advance are only dropped, because they can be loaded again)
+static void pushOperands(SsaVal *v){
+	int k;
+	for(;;){
+		for(k=v->nArgs<wNPending?v->nArgs:wNPending;k>=0;k--){
+			int j;
+			for(j=0;j<k&&wPending[wNPending-k+j]==v->args[j]&&wPendingUser[wNPending-k+j]==v;j++){}
+			if(j<k)continue;
+			for(j=k;j<v->nArgs&&wLoc[v->args[j]->id]!=LOC_STACK;j++){}
+			if(j<v->nArgs)continue;
+			for(j=0;j<wNPending-k&&wPendingUser[j]!=v;j++){}
+			if(j==wNPending-k)break;
+			}
+		if(k>=0)break;
+		SsaVal *top=wPending[--wNPending];
+		if(wLoc[top->id]!=LOC_STACK){
+			emit(OP_DROP);
+			continue;
+			}
+		wLoc[top->id]=LOC_SPILLED;
+		wSlot[classOf(top->id)]=++wMaxSlot;
+		emit(OP_FPSTORE)->arg.i=wMaxSlot;
+		}
+	wNPending-=k;
+	for(int j=k;j<v->nArgs;j++)materialize(v->args[j]);
+	}
+
+// the operands of user which are before its operand a on stack, but are not computed by instructions
+// (slots, constants), are loaded before the first instruction of the evaluation of a,
+// so a can remain on stack, as in the original stack code
+static void addPreloads(SsaVal *start,SsaVal *user,int from,int to){
+	int n=to-from;
+	if(n<=0)return;
+	wPre[start->id]=(Preload*)realloc(wPre[start->id],(wNPre[start->id]+n)*sizeof(Preload));
+	if(!wPre[start->id])err("not enough memory");
+	// the operands of the outer expressions are loaded first
+	memmove(wPre[start->id]+n,wPre[start->id],wNPre[start->id]*sizeof(Preload));
+	for(int j=0;j<n;j++)wPre[start->id][j]=(Preload){user->args[from+j],user};
+	wNPre[start->id]+=n;
+	}
+
+// returns the index of from in the predecessors of to
+static int predIdx(SsaBlock *from,SsaBlock *to){
+	int k;
+	for(k=0;to->preds[k]!=from;k++){}
+	return k;
+	}
+
+// returns true if the phi needs a copy of its operand from the predecessor with the index k
+static bool needsCopy(SsaVal *p,int k){
+	SsaVal *a=p->args[k];
+	if(a->kind==IR_UNDEF)return false;
+	return isConst(a)||wSlot[classOf(a->id)]!=wSlot[classOf(p->id)];
+	}
+
+static bool edgeNeedsCopies(SsaBlock *from,SsaBlock *to){
+	int k=predIdx(from,to);
+	for(SsaVal *p=to->first;p&&p->kind==IR_PHI;p=p->next){
+		if(needsCopy(p,k))return true;
+		}
+	return false;
+	}
+
+// the copies into the phi nodes of to, for the edge from -> to
+// all the values are put on stack before the stores, so the phi nodes can use each other
+static void emitCopies(SsaBlock *from,SsaBlock *to){
+	int k=predIdx(from,to);
+	int n=0;
+	for(SsaVal *p=to->first;p&&p->kind==IR_PHI;p=p->next){
+		if(needsCopy(p,k)){
+			materialize(p->args[k]);
+			wPending[wNPending+n++]=p;
+			}
+		}
+	while(n)emit(OP_FPSTORE)->arg.i=wSlot[classOf(wPending[wNPending+--n]->id)];
+	}
+
+// the jumps to blocks, which are set after all the blocks are generated
+typedef struct{
+	Instr *jump;
+	SsaBlock *from,*to;		// if from!=NULL, the jump goes to the copies for the edge from -> to
+	}Fixup;
+
+void ssaLower(SsaFn *f){
+	renumber(f);
+	wf=f;
+	wN=f->nVals;
+	int nb=f->nBlocks;
+	wVals=(SsaVal**)safeAlloc((wN+1)*sizeof(SsaVal*));
+	wUses=(int*)safeAlloc((wN+1)*sizeof(int));
+	wLoc=(char*)safeAlloc(wN+1);
+	wClass=(int*)safeAlloc((wN+1)*sizeof(int));
+	wSlot=(int*)safeAlloc((wN+1)*sizeof(int));
+	wInter=(bool*)safeAlloc((size_t)wN*wN+1);
+	wPending=(SsaVal**)safeAlloc((wN+1)*sizeof(SsaVal*));
+	wPendingUser=(SsaVal**)safeAlloc((wN+1)*sizeof(SsaVal*));
+	wPre=(Preload**)safeAlloc((wN+1)*sizeof(Preload*));
+	wNPre=(int*)safeAlloc((wN+1)*sizeof(int));
+	SsaVal **start=(SsaVal**)safeAlloc((wN+1)*sizeof(SsaVal*));
+	SsaVal **user=(SsaVal**)safeAlloc((wN+1)*sizeof(SsaVal*));
+	memset(wUses,0,wN*sizeof(int));
+	memset(wInter,0,(size_t)wN*wN);
+	SsaBlock **blocks=(SsaBlock**)safeAlloc(nb*sizeof(SsaBlock*));
+	int maxLen=0;
+	for(SsaBlock *b=f->blocks;b;b=b->next){
+		blocks[b->id]=b;
+		int len=0;
+		for(SsaVal *v=b->first;v;v=v->next){
+			wVals[v->id]=v;
+			len++;
+			for(int k=0;k<v->nArgs;k++){
+				wUses[v->args[k]->id]++;
+				user[v->args[k]->id]=v;
+				}
+			}
+		if(maxLen<len)maxLen=len;
+		}
+	// where each value is kept
+	for(int x=0;x<wN;x++){
+		SsaVal *v=wVals[x];
+		wClass[x]=x;
+		wSlot[x]=v->kind==IR_PARAM?v->arg.i:INT_MIN;
+		if(v->type==VT_NONE||isConst(v)||v->kind==IR_UNDEF||!wUses[x])wLoc[x]=LOC_NONE;
+		else if(v->kind==IR_OP&&wUses[x]==1&&user[x]->block==v->block&&user[x]->kind!=IR_PHI)wLoc[x]=LOC_STACK;
+		else wLoc[x]=LOC_SLOT;
+		}
+	// liveness of the values kept in slots
+	// the phi nodes are live at the beginning of their block and their operands at the end of the predecessors
+	bool *liveIn=(bool*)safeAlloc((size_t)nb*wN+1);
+	bool *liveOut=(bool*)safeAlloc((size_t)nb*wN+1);
+	bool *live=(bool*)safeAlloc(wN+1);
+	SsaVal **blockVals=(SsaVal**)safeAlloc((maxLen+1)*sizeof(SsaVal*));
+	memset(liveIn,0,(size_t)nb*wN);
+	memset(liveOut,0,(size_t)nb*wN);
+	for(bool again=true;again;){
+		again=false;
+		for(int bi=nb-1;bi>=0;bi--){
+			SsaBlock *b=blocks[bi];
+			bool *out=&liveOut[bi*wN];
+			for(int s=0;s<b->nSucc;s++){
+				SsaBlock *sb=b->succ[s];
+				for(int x=0;x<wN;x++){
+					if(liveIn[sb->id*wN+x]&&!(wVals[x]->kind==IR_PHI&&wVals[x]->block==sb))out[x]=true;
+					}
+				int k=predIdx(b,sb);
+				for(SsaVal *p=sb->first;p&&p->kind==IR_PHI;p=p->next){
+					if(wLoc[p->args[k]->id]==LOC_SLOT)out[p->args[k]->id]=true;
+					}
+				}
+			memcpy(live,out,wN*sizeof(bool));
+			int n=0;
+			for(SsaVal *v=b->first;v;v=v->next)blockVals[n++]=v;
+			while(n--){
+				SsaVal *v=blockVals[n];
+				if(v->kind==IR_PHI){
+					live[v->id]=wLoc[v->id]==LOC_SLOT;
+					continue;
+					}
+				live[v->id]=false;
+				for(int k=0;k<v->nArgs;k++){
+					if(wLoc[v->args[k]->id]==LOC_SLOT)live[v->args[k]->id]=true;
+					}
+				}
+			if(memcmp(live,&liveIn[bi*wN],wN*sizeof(bool))){
+				memcpy(&liveIn[bi*wN],live,wN*sizeof(bool));
+				again=true;
+				}
+			}
+		}
+	// the interferences: a value interferes with the values which are live where it is defined
+	for(int bi=0;bi<nb;bi++){
+		SsaBlock *b=blocks[bi];
+		memcpy(live,&liveOut[bi*wN],wN*sizeof(bool));
+		int n=0;
+		for(SsaVal *v=b->first;v;v=v->next)blockVals[n++]=v;
+		int nPhis=0;
+		while(n--){
+			SsaVal *v=blockVals[n];
+			if(v->kind==IR_PHI){
+				nPhis++;
+				continue;
+				}
+			if(wLoc[v->id]==LOC_SLOT){
+				live[v->id]=false;
+				for(int x=0;x<wN;x++){
+					if(live[x])wInter[v->id*wN+x]=wInter[x*wN+v->id]=true;
+					}
+				}
+			for(int k=0;k<v->nArgs;k++){
+				if(wLoc[v->args[k]->id]==LOC_SLOT)live[v->args[k]->id]=true;
+				}
+			}
+		for(int j=0;j<nPhis;j++){
+			SsaVal *p=blockVals[j];
+			if(wLoc[p->id]!=LOC_SLOT)continue;
+			for(int x=0;x<wN;x++){
+				bool phi=wVals[x]->kind==IR_PHI&&wVals[x]->block==b&&wLoc[x]==LOC_SLOT;
+				if((live[x]||phi)&&x!=p->id)wInter[p->id*wN+x]=wInter[x*wN+p->id]=true;
+				}
+			}
+		}
+	// the phi nodes share the slot with their operands, if they do not interfere
+	for(int x=0;x<wN;x++){
+		SsaVal *p=wVals[x];
+		if(p->kind!=IR_PHI||wLoc[x]!=LOC_SLOT)continue;
+		for(int k=0;k<p->nArgs;k++){
+			int a=p->args[k]->id;
+			if(wLoc[a]!=LOC_SLOT)continue;
+			int ca=classOf(x),cb=classOf(a);
+			if(ca==cb)continue;
+			if(wSlot[ca]!=INT_MIN&&wSlot[cb]!=INT_MIN)continue;		// 2 parameters
+			if(classesInterfere(ca,cb))continue;
+			wClass[cb]=ca;
+			if(wSlot[ca]==INT_MIN)wSlot[ca]=wSlot[cb];
+			}
+		}
+	// the slots: the slots which are still used directly (their address is taken) are kept
+	Instr *enter=f->fn->fn.instr;
+	bool *reserved=(bool*)safeAlloc(enter->arg.i+2);
+	memset(reserved,0,enter->arg.i+2);
+	for(int x=0;x<wN;x++){
+		SsaVal *v=wVals[x];
+		if(v->kind!=IR_OP)continue;
+		switch(v->op){
+			case OP_FPLOAD:case OP_FPSTORE:case OP_INCFP_I:case OP_FPADDR_I:case OP_FPADDR_F:
+				if(v->arg.i>0)reserved[v->arg.i]=true;
+				break;
+			case OP_FPADDR:
+				for(int s=0;s<v->arg2;s++)reserved[v->arg.i+s]=true;
+				break;
+			default:break;
+			}
+		}
+	wMaxSlot=0;
+	for(int s=1;s<=enter->arg.i;s++){
+		if(reserved[s])wMaxSlot=s;
+		}
+	for(int x=0;x<wN;x++){
+		if(wLoc[x]!=LOC_SLOT||classOf(x)!=x||wSlot[x]!=INT_MIN)continue;
+		for(int s=1;;s++){
+			if(s<=enter->arg.i&&reserved[s])continue;
+			int y;
+			for(y=0;y<x;y++){
+				if(wLoc[y]==LOC_SLOT&&classOf(y)==y&&wSlot[y]==s&&classesInterfere(x,y))break;
+				}
+			if(y<x)continue;
+			wSlot[x]=s;
+			if(wMaxSlot<s)wMaxSlot=s;
+			break;
+			}
+		}
+	// the operands loaded in advance
+	// start[x] is the first value evaluated for the expression of x (x or the start of its first operand kept on stack)
+	for(int x=0;x<wN;x++){
+		SsaVal *v=wVals[x];
+		wPre[x]=NULL;
+		wNPre[x]=0;
+		start[x]=v;
+		if(v->kind!=IR_OP)continue;
+		int last=0;
+		for(int k=0;k<v->nArgs;k++){
+			SsaVal *a=v->args[k];
+			if(wLoc[a->id]!=LOC_STACK)continue;
+			if(start[x]==v)start[x]=start[a->id];
+			addPreloads(start[a->id],v,last,k);
+			last=k+1;
+			}
+		}
+	// the bytecode, in the order of the blocks
+	delInstrAfter(enter);
+	wTail=enter;
+	wNPending=0;
+	Instr **labels=(Instr**)safeAlloc(nb*sizeof(Instr*));
+	Fixup *fixups=(Fixup*)safeAlloc((2*nb+1)*sizeof(Fixup));
+	int nFixups=0;
+	for(int bi=0;bi<nb;bi++){
+		SsaBlock *b=blocks[bi];
+		labels[bi]=emit(OP_NOP);
+		for(SsaVal *v=b->first;v;v=v->next){
+			if(v->kind!=IR_OP||isConst(v))continue;
+			for(int j=0;j<wNPre[v->id];j++){
+				materialize(wPre[v->id][j].v);
+				pushPending(wPre[v->id][j].v,wPre[v->id][j].user);
+				}
+			pushOperands(v);
+			if(v!=b->last){
+				Instr *i=emit(v->op);
+				i->arg=v->arg;
+				i->arg2=v->arg2;
+				if(v->type==VT_NONE)continue;
+				switch(wLoc[v->id]){
+					case LOC_NONE:emit(OP_DROP);break;
+					case LOC_STACK:pushPending(v,user[v->id]);break;
+					default:emit(OP_FPSTORE)->arg.i=wSlot[classOf(v->id)];
+					}
+				continue;
+				}
+			if(wNPending)err("SSA lowering: values left on stack at the end of b%d",b->id);
+			if(v->op==OP_JMP){
+				emitCopies(b,b->succ[0]);
+				fixups[nFixups++]=(Fixup){emit(OP_JMP),NULL,b->succ[0]};
+				}else if(b->nSucc==2){
+				Instr *i=emit(v->op);
+				i->arg2=v->arg2;
+				bool stub=edgeNeedsCopies(b,b->succ[0]);
+				fixups[nFixups++]=(Fixup){i,stub?b:NULL,b->succ[0]};
+				emitCopies(b,b->succ[1]);
+				fixups[nFixups++]=(Fixup){emit(OP_JMP),NULL,b->succ[1]};
+				}else{
+				Instr *i=emit(v->op);
+				i->arg=v->arg;
+				i->arg2=v->arg2;
+				}
+			}
+		}
+	// the copies for the jumps to blocks with phi nodes, from blocks with 2 successors
+	for(int j=0;j<nFixups;j++){
+		Fixup *fx=&fixups[j];
+		if(fx->from){
+			fx->jump->arg.instr=emit(OP_NOP);
+			emitCopies(fx->from,fx->to);
+			emit(OP_JMP)->arg.instr=labels[fx->to->id];
+			}else{
+			fx->jump->arg.instr=labels[fx->to->id];
+			}
+		}
+	enter->arg.i=wMaxSlot;
+	optStats.ssaFns++;
+	free(labels);free(fixups);free(reserved);
+	free(liveIn);free(liveOut);free(live);free(blockVals);free(blocks);
+	for(int x=0;x<wN;x++)free(wPre[x]);
+	free(wPre);free(wNPre);free(start);free(wPendingUser);
+	free(wVals);free(wUses);free(wLoc);free(wClass);free(wSlot);free(wInter);free(wPending);free(user);
+	}
+
+static const SsaPass ssaPasses[]={
+	{"constprop",ssaConstProp},
+	{"deadvalues",ssaDeadValues},
+	};
+
+void ssaOptimize(Symbol *fn){
+	SsaFn *f=ssaBuild(fn);
+	if(!f){
+		optStats.ssaSkipped++;
+		return;
+		}
+	ssaVerify(f,"lifting");
+	if(ssaDumpEnabled)ssaDump(f,"lifted");
+	ssaRunPasses(f,ssaPasses,sizeof(ssaPasses)/sizeof(ssaPasses[0]));
+	ssaLower(f);
+	ssaFree(f);
+	}
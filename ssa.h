@@ -0,0 +1,102 @@
+#pragma once
+
+// SSA intermediate representation
+// the stack bytecode of a function is lifted into basic blocks of SSA values (virtual registers),
+// it is optimized with passes and then it is lowered back into stack bytecode
+// the local variables and the parameters whose address is never taken become virtual registers,
+// with phi nodes where the control flow joins
+
+#include <stdbool.h>
+#include "ad.h"
+
+typedef enum{		// the type of a virtual register
+	VT_NONE,		// no value (ex: the result of STORE or of a call of a void function)
+	VT_INT,		// int and char
+	VT_DOUBLE,
+	VT_PTR
+	}ValType;
+
+typedef enum{		// the kind of an SSA value
+	IR_OP,		// a VM instruction: op, arg, arg2 are the ones from the VM instruction and args are its operands from stack
+	IR_PHI,		// phi node: args[k] is the value which comes from block->preds[k]
+	IR_PARAM,		// the value of a parameter at the function entry: arg.i is its FP index
+	IR_UNDEF		// the value of a local variable which was not initialised
+	}IrKind;
+
+typedef struct SsaBlock SsaBlock;
+typedef struct SsaVal SsaVal;
+
+struct SsaVal{		// an SSA instruction and the virtual register defined by it
+	int id;		// %id in dumps
+	IrKind kind;
+	ValType type;		// VT_NONE if it has no result
+	Opcode op;		// for IR_OP
+	Val arg;		// for IR_OP the arguments of the VM instruction, except the jump targets, which are in block->succ
+	int arg2;
+	SsaVal **args;		// the operands
+	int nArgs;
+	SsaBlock *block;		// the block which contains this value
+	SsaVal *next;		// the next value from block
+	};
+
+struct SsaBlock{		// a basic block
+	int id;		// bid in dumps
+	SsaVal *first,*last;		// the phi nodes are the first, the last value is the terminator (a jump, RET, ...)
+	SsaBlock **preds;		// the blocks which jump or continue into this block
+	int nPreds;
+	SsaBlock *succ[2];		// for conditional jumps, succ[0] is the jump target and succ[1] is the next block
+	int nSucc;
+	SsaBlock *next;		// the next block in the code layout
+	};
+
+typedef struct{		// a function in SSA form
+	Symbol *fn;
+	SsaBlock *blocks;		// the first block is the entry, which defines the parameters
+	int nBlocks;
+	int nVals;
+	}SsaFn;
+
+// a transformation of a function in SSA form
+// returns true if the function was changed
+typedef struct{
+	const char *name;
+	bool (*run)(SsaFn *f);
+	}SsaPass;
+
+// if true, optimizeFn uses the SSA passes (atomc -ssa)
+extern bool ssaEnabled;
+// if true, the SSA form of each function is shown after each pass which changed it (atomc -dump-ssa)
+extern bool ssaDumpEnabled;
+
+// lifts the code of the function fn into SSA form
+// returns NULL if the code cannot be lifted (ex: the stack is not balanced at the joins)
+SsaFn *ssaBuild(Symbol *fn);
+
+// replaces the code of the function with the stack bytecode generated from its SSA form
+void ssaLower(SsaFn *f);
+
+// frees the SSA form of a function
+void ssaFree(SsaFn *f);
+
+// checks that the SSA form is valid: the blocks end with terminators, the phi nodes match the predecessors,
+// each value is defined before its uses (its block dominates them) and the operands have the expected types
+// on error, it calls err with the name of the pass which produced the invalid form
+void ssaVerify(SsaFn *f,const char *passName);
+
+// shows the SSA form of a function
+void ssaDump(SsaFn *f,const char *title);
+
+// runs the passes in order, until none of them changes the function
+// the function is verified after each pass which changed it
+void ssaRunPasses(SsaFn *f,const SsaPass *passes,int nPasses);
+
+// constant propagation: folds the int operations with constant operands,
+// the phi nodes with the same constant on all the edges and the conditional jumps with a known result,
+// and removes the blocks which become unreachable
+bool ssaConstProp(SsaFn *f);
+
+// dead value elimination: removes the values which are not used by an instruction with side effects
+bool ssaDeadValues(SsaFn *f);
+
+// lifts the function fn into SSA form, optimizes it and lowers it back into bytecode
+void ssaOptimize(Symbol *fn);
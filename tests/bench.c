@@ -0,0 +1,82 @@
+// program de test pentru masurarea performantelor VM
+// se ruleaza cu: atomc -stats tests/bench.c
+
+int fib(int n){
+	if(n<2)return n;
+	return fib(n-1)+fib(n-2);
+	}
+
+int sum(int n){
+	int s;
+	int i;
+	s=0;
+	i=0;
+	while(i<n){
+		s=s+i*2;
+		i=i+1;
+		}
+	return s;
+	}
+
+int triangle(int n){
+	int t;
+	int i;
+	int j;
+	t=0;
+	i=0;
+	while(i<n){
+		j=0;
+		while(j<i){
+			t=t+j;
+			j=j+1;
+			}
+		i=i+1;
+		}
+	return t;
+	}
+
+double series(int n){
+	double s;
+	double x;
+	int i;
+	s=0.0;
+	x=1.0;
+	i=0;
+	while(i<n){
+		s=s+x/2.0;
+		x=x*0.5;
+		i=i+1;
+		}
+	return s;
+	}
+
+// functii mici, apelate des: sunt inlocuite cu codul lor la -O2
+int absi(int x){
+	if(x<0)return 0-x;
+	return x;
+	}
+
+int maxi(int a,int b){
+	if(a<b)return b;
+	return a;
+	}
+
+int helpers(int n){
+	int s;
+	int i;
+	s=0;
+	i=0;
+	while(i<n){
+		s=s+maxi(absi(i-n/2),i/4);
+		i=i+1;
+		}
+	return s;
+	}
+
+void main(){
+	put_i(fib(12));		// se afiseaza 144
+	put_i(sum(200));		// se afiseaza 39800
+	put_i(triangle(40));		// se afiseaza 9880
+	put_d(series(20));		// se afiseaza 0.999999
+	put_i(helpers(100));		// se afiseaza 2657
+	}
@@ -0,0 +1,59 @@
+// program de test pentru memorarea vectorilor de structuri ca un vector pentru fiecare camp
+// se ruleaza cu: atomc -stats tests/benchsoa.c si atomc -soa -stats tests/benchsoa.c
+
+struct S{
+	int n;
+	char text[16];
+	double x;
+	};
+
+// 2000*28 octeti = 56 KB, mai mult decat cache-ul de date de 32 KB
+struct S v[2000];
+
+// initializarea scrie toate campurile
+void init(int n){
+	int i;
+	i=0;
+	while(i<n){
+		v[i].n=i;
+		v[i].text[0]='a'+i-i/26*26;
+		v[i].x=i*0.5;
+		i=i+1;
+		}
+	}
+
+// se citeste doar campul n: cu -soa, cei 8000 de octeti ai lui raman in cache intre treceri
+int sumaN(int n,int treceri){
+	int s;
+	int i;
+	s=0;
+	while(treceri>0){
+		i=0;
+		while(i<n){
+			s=s+v[i].n;
+			i=i+1;
+			}
+		treceri=treceri-1;
+		}
+	return s;
+	}
+
+// se citeste doar campul x
+double sumaX(int n){
+	double s;
+	int i;
+	s=0.0;
+	i=0;
+	while(i<n){
+		s=s+v[i].x;
+		i=i+1;
+		}
+	return s;
+	}
+
+void main(){
+	init(2000);
+	put_i(sumaN(2000,4));		// se afiseaza 7996000
+	put_d(sumaX(2000));		// se afiseaza 999500.000000
+	put_i(v[25].text[0]);		// se afiseaza 122
+	}
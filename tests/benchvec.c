@@ -0,0 +1,61 @@
+// program de test pentru vectorizarea buclelor
+// se ruleaza cu: atomc -stats tests/benchvec.c si atomc -vectorize=0 -stats tests/benchvec.c
+
+double a[1000];
+double b[1000];
+double c[1000];
+int v[1000];
+
+// initializarea nu se vectorizeaza: valorile depind de i
+void init(int n){
+	int i;
+	i=0;
+	while(i<n){
+		a[i]=i*0.5;
+		b[i]=n-i;
+		v[i]=i*3;
+		i=i+1;
+		}
+	}
+
+// c[i]=a[i]+b[i] -> VADD.f
+void aduna(double x[],double y[],double z[],int n){
+	int i;
+	i=0;
+	while(i<n){
+		z[i]=x[i]+y[i];
+		i=i+1;
+		}
+	}
+
+// c[i]=a[i]+b[i]*k -> VMULADD.f
+void axpy(double x[],double y[],double k,int n){
+	int i;
+	i=0;
+	while(i<n){
+		c[i]=x[i]+y[i]*k;
+		i=i+1;
+		}
+	}
+
+// s=s+v[i] -> VSUM.i
+int suma(int t[],int n){
+	int s;
+	int i;
+	s=0;
+	i=0;
+	while(i<n){
+		s=s+t[i];
+		i=i+1;
+		}
+	return s;
+	}
+
+void main(){
+	init(1000);
+	aduna(a,b,c,1000);
+	put_d(c[999]);		// se afiseaza 500.500000
+	axpy(a,b,0.25,1000);
+	put_d(c[10]);		// se afiseaza 252.500000
+	put_i(suma(v,1000));		// se afiseaza 1498500
+	}
@@ -4,6 +4,46 @@ int fact(int n){
 	return n*fact(n-1);
 	}
 
+// ordinea apelurilor este memorata in cifrele lui n
+int n;
+int urma(int x){
+	n=n*10+x;
+	return x;
+	}
+
+// vectorii si structurile globale, vectorii ca parametri
+struct Punct{
+	int x;
+	double y;
+	char nume[6];
+	};
+struct Punct puncte[4];
+int patrate[10];
+
+int suma(int v[],int n){
+	int i;
+	int s;
+	i=0;
+	s=0;
+	while(i<n){
+		s=s+v[i];
+		i=i+1;
+		}
+	return s;
+	}
+
+void scrie(char text[],int i,char ch){
+	text[i]=ch;
+	}
+
+// sirurile de caractere constante sunt pastrate o singura data, in zona de constante
+int lungime(char s[]){
+	int n;
+	n=0;
+	while(s[n])n=n+1;
+	return n;
+	}
+
 void main(){
 	put_i(4.9);		// se afiseaza 4
 	
@@ -19,4 +59,47 @@ void main(){
 		i=i+1;
 		}
 	put_i(r);		// se afiseaza 24
+
+	// && si || evalueaza operandul drept doar daca rezultatul nu este cunoscut din cel stang
+	n=0;
+	put_i(urma(0)&&urma(1));		// se afiseaza 0
+	put_i(urma(2)||urma(3));		// se afiseaza 1
+	put_i(urma(0)||urma(4)&&urma(5)||urma(6));		// se afiseaza 1
+	put_i(n);		// se afiseaza 2045
+	n=0;
+	if(urma(1)&&(urma(0)||urma(7))&&!urma(0))put_i(n);		// se afiseaza 1070
+	i=0;
+	while(i<10&&urma(i)<3||i==5)i=i+1;
+	put_i(i);		// se afiseaza 3
+	put_i(!(i<3)+!0.5+!!i);		// se afiseaza 2
+	// operanzi care nu sunt comparatii: saltul JT/JF adaugat se leaga in lista celorlalte salturi
+	double x;
+	char c;
+	x=0.0;
+	c='a';
+	put_i(c&&x||i&&c||x);		// se afiseaza 1
+	put_i(x||c&&!i||!c);		// se afiseaza 0
+	// un char citit la executie este convertit in double
+	char t[4];
+	t[1]=3;
+	x=t[1];
+	put_d(x);		// se afiseaza 3.000000
+	put_d(t[1]+0.5);		// se afiseaza 3.500000
+
+	i=0;
+	while(i<10){
+		patrate[i]=i*i;
+		i=i+1;
+		}
+	put_i(suma(patrate,10));		// se afiseaza 285
+	puncte[2].x=7;
+	puncte[2].y=2.5;
+	puncte[3].nume[1]='a';
+	scrie(puncte[3].nume,2,'b');
+	put_i(puncte[2].x+puncte[3].nume[1]+puncte[3].nume[2]);		// se afiseaza 202
+	put_d(puncte[2].y);		// se afiseaza 2.5
+	puncte[0].nume[0]=300;
+	put_i(puncte[0].nume[0]);		// se afiseaza 44, char
+
+	put_i(lungime("atomc")+lungime("")+lungime("atomc"));		// se afiseaza 10
 	}
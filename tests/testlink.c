@@ -0,0 +1,36 @@
+// programul principal, legat cu modulul tests/testlinklib.c
+struct Punct{
+	int x;
+	int y;
+	};
+struct Punct origine;
+int apeluri;
+
+// nu este scrisa in niciun modul, deci la legare devine constanta 0
+int depanare;
+
+// prototipurile functiilor din tests/testlinklib.c
+int patrat(int x);
+int numara();
+int distanta2();
+int impar(int n);
+int lungime(char s[]);
+int nume();
+
+int par(int n){
+	if(n==0)return 1;
+	return impar(n-1);
+	}
+
+void main(){
+	put_i(patrat(7));		// se afiseaza 49, apelul este inlocuit la legare cu corpul functiei
+	numara();
+	numara();
+	put_i(apeluri);		// se afiseaza 2
+	origine.x=3;
+	origine.y=4;
+	put_i(distanta2());		// se afiseaza 25
+	put_i(lungime("atomc")+nume());		// se afiseaza 10, "atomc" este o singura data in zona de constante
+	if(depanare)put_i(-1);		// nu se afiseaza nimic, testul este eliminat
+	put_i(par(7));		// se afiseaza 0, recursivitate intre module
+	}
@@ -0,0 +1,44 @@
+// modulul cu functiile folosite de tests/testlink.c, compilat separat:
+//		atomc -c tests/testlinklib.c
+//		atomc tests/testlink.c tests/testlinklib.ao
+// sau legat direct din sursa: atomc tests/testlink.c tests/testlinklib.c
+
+// structurile si variabilele globale cu acelasi nume sunt aceleasi in toate modulele
+struct Punct{
+	int x;
+	int y;
+	};
+struct Punct origine;
+int apeluri;
+
+// functia definita in tests/testlink.c
+int par(int n);
+
+int patrat(int x){
+	return x*x;
+	}
+
+int numara(){
+	apeluri=apeluri+1;
+	return apeluri;
+	}
+
+int distanta2(){
+	return patrat(origine.x)+patrat(origine.y);
+	}
+
+int impar(int n){
+	if(n==0)return 0;
+	return par(n-1);
+	}
+
+int lungime(char s[]){
+	int n;
+	n=0;
+	while(s[n])n=n+1;
+	return n;
+	}
+
+int nume(){
+	return lungime("atomc");
+	}
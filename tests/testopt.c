@@ -0,0 +1,248 @@
+// program de testare a optimizarilor
+// se ruleaza cu: atomc tests/testopt.c
+int sgn(int x){
+	if(x<0)return -1;
+	else if(0<x)return 1;
+	else return 0;
+	}
+
+// functii care nu sunt apelate din main: sunt eliminate la -O2
+int nefolosita2(int x){
+	return x+1;
+	}
+int nefolosita(int x){
+	return x*nefolosita2(x);
+	}
+
+// recursivitate la coada: apelul devine TAILCALL si refoloseste cadrul functiei,
+// altfel cele 5000 de apeluri ar depasi stiva VM (la -O0)
+int sumTo(int n,int acc){
+	if(n<1)return acc;
+	return sumTo(n-1,acc+n);
+	}
+
+// TAILCALL catre o functie cu mai multi parametri: argumentele noi acopera adresa de revenire si vechiul FP
+int adunaTrei(int n,int acc,int pas){
+	if(n<1)return acc;
+	return adunaTrei(n-1,acc+pas,pas);
+	}
+int unu(int n){
+	if(n>=0)return adunaTrei(n,0,2);
+	return unu(0-n);
+	}
+
+// expresiile invariante din bucle (n*2, g*3, (n-1)*(m+1)) sunt calculate o singura data, inaintea buclei
+int g;
+void setG(int x){
+	g=x;
+	}
+int invariante(int n,int m){
+	int i;
+	int j;
+	int s;
+	s=0;
+	i=0;
+	while(i<n*2){
+		j=0;
+		while(j<m){
+			s=s+g*3+(n-1)*(m+1);
+			j=j+1;
+			}
+		i=i+1;
+		}
+	// g se modifica in bucla prin apelul lui setG, deci g*2 nu este invariant
+	i=0;
+	while(i<n){
+		s=s+g*2;
+		setG(g+1);
+		i=i+1;
+		}
+	return s;
+	}
+
+// bucle cu contor: bucla cu 3 iteratii este inlocuita cu 3 copii ale corpului,
+// iar celelalte contin cate 4 copii ale corpului, urmate de bucla initiala pentru iteratiile ramase
+int desfasurate(int n){
+	int i;
+	int s;
+	s=0;
+	i=0;
+	while(i<3){
+		s=s+i;
+		i=i+1;
+		}
+	i=0;
+	while(i<n){
+		s=s+i*i;
+		i=i+1;
+		}
+	i=n;
+	while(i>=0){
+		s=s+1;
+		i=i-3;
+		}
+	return s;
+	}
+
+// inmultirile si impartirile cu constante devin SHL, SHR, MULC si DIVM, cu aceleasi rezultate
+// ca MUL si DIV si pentru valori negative (impartirea se rotunjeste spre 0)
+// i*3 din bucla este inlocuit cu o variabila care creste cu 3 la fiecare iteratie
+int constante(int x){
+	int i;
+	int s;
+	s=x*8+x/4+x/10-x*3;
+	i=0;
+	while(i<5){
+		s=s+i*3;
+		i=i+1;
+		}
+	return s;
+	}
+
+// subexpresiile comune sunt calculate o singura data
+// g*g este calculat din nou dupa atribuirea lui g
+int comune(int x,int y){
+	int a;
+	int b;
+	a=(x+y)*(x+y);
+	b=x*y+g*g;
+	g=g+1;
+	return a+b+g*g+x*y;
+	}
+
+// cu -bounds-check, i, i-1 si i+1 sunt in limitele lui t in toate iteratiile,
+// deci indexarile din bucla nu mai sunt verificate
+int t[8];
+int limite(){
+	int i;
+	t[0]=0;
+	i=1;
+	while(i<7){
+		t[i]=t[i-1]+i;
+		t[i+1]=t[i];
+		i=i+1;
+		}
+	return t[7];
+	}
+
+// instructiunile de dupa return sunt eliminate
+int dublu(int x){
+	return x+x;
+	put_i(x);
+	}
+
+// functie pura: acceseaza doar cadrul ei, deci cu -memo rezultatele apelurilor sunt pastrate intr-o tabela
+// si comb(10,5) se calculeaza din 51 de apeluri, in loc de 503
+int comb(int n,int k){
+	if(k==0||k==n)return 1;
+	return comb(n-1,k-1)+comb(n-1,k);
+	}
+
+// citeste variabila globala g, deci nu este pura si rezultatele ei nu sunt pastrate
+int plusG(int x){
+	return x+g;
+	}
+
+// apelurile cu argumentul mod constant sunt redirectate la copii ale functiei specializate pentru mod,
+// in care conditiile cu mod sunt calculate la compilare si ramurile lor nefolosite sunt eliminate
+int aplica(int n,int mod){
+	int i;
+	int s;
+	s=0;
+	i=0;
+	while(i<n){
+		if(mod==1)s=s+i;
+		else if(mod==2)s=s+i*i;
+		else s=s-i;
+		i=i+1;
+		}
+	return s;
+	}
+
+// argumentul ga[3]&&34 se termina cu PUSH.i 0, la care sare si ramura cu valoarea 1: nu este o constanta
+int ga[5];
+int alege(int p){
+	int s;
+	int k;
+	s=0;
+	k=0;
+	while(k<5){
+		s=s+k*k;
+		k=k+1;
+		}
+	if(p==1)return 10+s;
+	return 20+s;
+	}
+
+struct Punct{
+	int x;
+	char nume[3];
+	double d;
+	};
+
+// vectorii si structurile locale sunt memorate in cadrul functiei, in sloturi consecutive,
+// asa ca fiecare apel recursiv are propria lor copie
+int cadru(int n){
+	int t[3];
+	struct Punct p;
+	t[0]=n;
+	t[2]=n*3;
+	p.x=n*2;
+	p.nume[1]='a';
+	if(n>0)return cadru(n-1)+t[0]+t[2]+p.x;
+	return p.nume[1];
+	}
+
+// minus unar pe valori necunoscute la compilare
+int negatii(int x){
+	char c;
+	c='a';
+	return -x*10+-(x+1)+-c;
+	}
+
+double negatieD(double d){
+	return -d*2.0;
+	}
+
+void main(){
+	put_i(60*60*24);		// se afiseaza 86400, calculat la compilare
+	put_d(1.0/3.0);		// se afiseaza 0.333333
+	put_i((int)4.9+'a');	// se afiseaza 101
+
+	int i;
+	int a;
+	int b;
+	i=0;
+	5;		// valoare eliminata
+	a=b=3;
+	put_i(a+b);		// se afiseaza 6
+	while(i<6){
+		if(i<2){
+			if(i<1)put_i(100);
+			else put_i(101);
+			}
+		else put_i(sgn(i-4));
+		i=i+1;
+		}
+	put_i(dublu(21));		// se afiseaza 42
+	put_i(sumTo(5000,0));		// se afiseaza 12502500
+	put_i(unu(0-4000));		// se afiseaza 8000
+	g=2;
+	put_i(invariante(3,4));		// se afiseaza 402
+	put_i(desfasurate(10));		// se afiseaza 292
+	put_i(constante(0-27));		// se afiseaza -113
+	put_i(comune(2,3));		// se afiseaza 98
+	put_i(limite());		// se afiseaza 21
+	put_i(comb(10,5));		// se afiseaza 252
+	g=1;
+	put_i(plusG(1));		// se afiseaza 2
+	g=5;
+	put_i(plusG(1));		// se afiseaza 6
+	put_i(aplica(i,1));		// se afiseaza 15
+	put_i(aplica(i,2));		// se afiseaza 55
+	ga[3]=1;
+	put_i(alege(ga[3]&&34));		// se afiseaza 40
+	put_i(cadru(3));		// se afiseaza 133
+	put_i(negatii(3));		// se afiseaza -131
+	put_d(negatieD(1.25));		// se afiseaza -2.5
+	}
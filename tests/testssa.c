@@ -0,0 +1,61 @@
+// program de testare a formei SSA
+// se ruleaza cu: atomc -ssa tests/testssa.c
+// formele SSA ale functiilor, dupa fiecare pas care le modifica, se afiseaza cu: atomc -ssa -dump-ssa tests/testssa.c
+
+// y este 10 pe ambele ramuri, deci conditia y==10 este cunoscuta la compilare,
+// return 0 este eliminat si functia returneaza direct 15
+int constanta(int n){
+	int x;
+	int y;
+	x=5;
+	if(n<0)y=x*2;
+	else y=10;
+	if(y==10)return y+x;
+	return 0;
+	}
+
+// a si b se interschimba la fiecare iteratie: nodurile phi ale buclei se folosesc reciproc
+int fibo(int n){
+	int a;
+	int b;
+	int t;
+	a=0;
+	b=1;
+	while(n>0){
+		t=a+b;
+		a=b;
+		b=t;
+		n=n-1;
+		}
+	return a;
+	}
+
+// valori care raman pe stiva intre instructiuni si valori care sunt pastrate in cadrul functiei
+int combinatii(int n,int k){
+	int i;
+	int r;
+	r=1;
+	i=1;
+	while(i<=k){
+		r=r*(n-k+i)/i;
+		i=i+1;
+		}
+	return r;
+	}
+
+void main(){
+	put_i(constanta(3));		// se afiseaza 15
+	put_i(constanta(-3));		// se afiseaza 15
+	put_i(fibo(20));		// se afiseaza 6765
+	put_i(combinatii(10,3));		// se afiseaza 120
+	int i;
+	int s;
+	s=0;
+	i=0;
+	while(i<10){
+		if(i<5)s=s+i;
+		else s=s-1;
+		i=i+1;
+		}
+	put_i(s);		// se afiseaza 5
+	}
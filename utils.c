@@ -20,6 +20,16 @@ void *safeAlloc(size_t nBytes){
 	return p;
 	}
 
+void *growArray(void *v,int *cap,int n,int minCap,size_t elemSize){
+	if(n<=*cap)return v;
+	int c=*cap?*cap:minCap;
+	while(c<n)c*=2;
+	void *p=realloc(v,(size_t)c*elemSize);
+	if(!p)err("not enough memory");
+	*cap=c;
+	return p;
+	}
+
 char *loadFile(const char *fileName){
 	FILE *fis=fopen(fileName,"rb");
 	if(!fis)err("unable to open %s",fileName);
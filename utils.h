@@ -13,6 +13,11 @@ noreturn void err(const char *fmt,...);
 // if succeeds, it returns the allocated memory, else it prints an error message and exit the program
 void *safeAlloc(size_t nBytes);
 
+// makes room for n elements of elemSize bytes in the array v, which can hold *cap elements
+// the capacity is doubled, starting from minCap, until n elements fit and the old elements are kept
+// returns the array, which can be moved; on error, prints a message and exit the program
+void *growArray(void *v,int *cap,int n,int minCap,size_t elemSize);
+
 // loads a text file in a dynamically allocated memory and returns it
 // on error, prints a message and exit the program
 char *loadFile(const char *fileName);
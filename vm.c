@@ -1,15 +1,31 @@
+// for MAP_ANONYMOUS with -std=c11
+#define _DEFAULT_SOURCE
 #include <stdio.h>
 #include<stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 #include "utils.h"
 #include "ad.h"
-
-#define MAXSTACK 10000
+#include "profile.h"
+#include "memo.h"
 
 Instr *addInstr(Instr **list, Opcode op) {
 	Instr *i = (Instr*)safeAlloc(sizeof(Instr));
 	i->op = op;
+	i->arg2 = 0;
+	i->arg.p = NULL;
 	i->next = NULL;
+	i->prof = NULL;
 	if (*list) {
 		Instr *p = *list;
 		while(p->next)p = p->next;
@@ -36,6 +52,9 @@ Instr *addInstrWithDouble(Instr **list, Opcode op, double argVal) {
 Instr *insertInstr(Instr *before,int op){
 	Instr *i=(Instr*)safeAlloc(sizeof(Instr));
 	i->op=op;
+	i->arg2=0;
+	i->arg.p=NULL;
+	i->prof=NULL;
 	i->next=before->next;
 	before->next=i;
 	return i;
@@ -57,12 +76,126 @@ Instr *lastInstr(Instr *list){
 	return list;
 }
 
-Val stack[10000];		// the stack
+Val stack[MAXSTACK];		// the stack
 Val *SP = stack-1;		// Stack pointer - the stack's top - points to the value from the top of the stack
 Val *FP = NULL;		// the initial value doesn't matter
+char *DS = NULL;		// Data segment - the base of the global variables
+int dataSize = 0;
+
+int dataAlloc(int size, int align) {
+	int offset = (dataSize + align - 1) / align * align;
+	dataSize = offset + size;
+	return offset;
+}
+
+void dataInit() {
+	size_t n = ((size_t)dataSize + 63) / 64 * 64;
+	DS = (char*)aligned_alloc(64, n ? n : 64);
+	if (!DS) err("not enough memory for the data segment");
+	memset(DS, 0, n);
+}
+
+void dataFree() {
+	free(DS);
+	DS = NULL;
+}
+
+char *CS = NULL;		// Constant segment - the base of the constant pool
+int constSize = 0;
+int constStrings = 0;
+static char *constPool;		// the constant pool built by the compiler, copied in CS by constInit
+static int constCap;
+static int *constHash;		// open addressing hash table with the offsets+1 of the interned strings (0 is free)
+static int constHashCap;
+static size_t constMapped;
+
+// FNV-1a
+static unsigned constHashOf(const char *s) {
+	unsigned h = 2166136261u;
+	for (; *s; s++) {
+		h ^= (unsigned char)*s;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+int constIntern(const char *s) {
+	if ((constStrings + 1) * 2 > constHashCap) {
+		int cap = constHashCap ? constHashCap * 2 : 64;
+		int *v = (int*)safeAlloc(cap * sizeof(int));
+		memset(v, 0, cap * sizeof(int));
+		for (int k = 0; k < constHashCap; k++) {
+			if (!constHash[k]) continue;
+			unsigned h = constHashOf(constPool + constHash[k] - 1) & (cap - 1);
+			while (v[h]) h = (h + 1) & (cap - 1);
+			v[h] = constHash[k];
+		}
+		free(constHash);
+		constHash = v;
+		constHashCap = cap;
+	}
+	unsigned h = constHashOf(s) & (constHashCap - 1);
+	for (; constHash[h]; h = (h + 1) & (constHashCap - 1)) {
+		if (!strcmp(constPool + constHash[h] - 1, s)) return constHash[h] - 1;
+	}
+	int len = (int)strlen(s) + 1;
+	constPool = (char*)growArray(constPool, &constCap, constSize + len, 256, 1);
+	int offset = constSize;
+	memcpy(constPool + offset, s, len);
+	constSize += len;
+	constHash[h] = offset + 1;
+	constStrings++;
+	return offset;
+}
+
+const char *constString(int offset) {
+	return constPool + offset;
+}
+
+void constStoreCheck(void *p) {
+	if ((uintptr_t)p - (uintptr_t)CS >= constMapped) return;
+	char *a = (char*)p;
+	while (a > CS && a[-1]) a--;		// the start of the literal
+	err("cannot write into the string literal \"%s\"", a);
+}
+
+void constInit() {
+	// whole pages, so the pool can be protected (or mapped from a file)
+	constMapped = ((size_t)constSize + 4095) / 4096 * 4096;
+	if (!constMapped) constMapped = 4096;
+#if defined(__unix__) || defined(__APPLE__)
+	CS = (char*)mmap(NULL, constMapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (CS == MAP_FAILED) err("cannot map the constant pool");
+	if (constSize) memcpy(CS, constPool, constSize);
+	// the stores check the pool (constStoreCheck), this only stops the writes which bypass the VM
+	mprotect(CS, constMapped, PROT_READ);
+#else
+	CS = (char*)aligned_alloc(4096, constMapped);
+	if (!CS) err("not enough memory for the constant pool");
+	if (constSize) memcpy(CS, constPool, constSize);
+#endif
+}
+
+void constFree() {
+	// the pool of a module is emptied before it is mapped (see moduleCompile in link.h)
+	if (CS) {
+#if defined(__unix__) || defined(__APPLE__)
+		munmap(CS, constMapped);
+#else
+		free(CS);
+#endif
+	}
+	CS = NULL;
+	constMapped = 0;
+	free(constPool);
+	free(constHash);
+	constPool = NULL;
+	constHash = NULL;
+	constSize = constCap = constHashCap = constStrings = 0;
+}
 
 void pushv(Val v){
-	if (SP + 1 == stack + 10000) {
+	if (SP + 1 == stack + MAXSTACK) {
 		err("trying to push into a full stack");
 	}
 	*++SP = v;
@@ -76,7 +209,7 @@ Val popv(){
 }
 
 void pushi(int i){
-	if (SP + 1 == stack + 10000) {
+	if (SP + 1 == stack + MAXSTACK) {
 		err("trying to push into a full stack");
 	}
 	(++SP)->i = i;
@@ -90,7 +223,7 @@ int popi(){
 }
 
 void pushd(double f){
-	if (SP + 1 == stack + 10000) {
+	if (SP + 1 == stack + MAXSTACK) {
 		err("trying to push into a full stack");
 	}
 	(++SP)->f = f;
@@ -104,7 +237,7 @@ float popd(){
 }
 
 void pushp(void *p){
-	if (SP + 1 == stack + 10000) {
+	if (SP + 1 == stack + MAXSTACK) {
 		err("trying to push into a full stack");
 	}
 	(++SP)->p = p;
@@ -132,13 +265,327 @@ void vmInit() {
 	addFnParam(fnn, "f", (Type){TB_DOUBLE, NULL, -1});
 }
 
+const char *opName(Opcode op) {
+	static const char *names[OP_COUNT] = {
+		[OP_HALT] = "HALT",
+		[OP_PUSH_I] = "PUSH.i",
+		[OP_CALL] = "CALL",
+		[OP_CALL_EXT] = "CALL_EXT",
+		[OP_TAILCALL] = "TAILCALL",
+		[OP_ENTER] = "ENTER",
+		[OP_RET] = "RET",
+		[OP_RET_VOID] = "RET_VOID",
+		[OP_CONV_I_F] = "CONV.i.f",
+		[OP_JMP] = "JMP",
+		[OP_JF] = "JF",
+		[OP_JT] = "JT",
+		[OP_FPLOAD] = "FPLOAD",
+		[OP_FPSTORE] = "FPSTORE",
+		[OP_ADD_I] = "ADD.i",
+		[OP_PUSH_D] = "PUSH.f",
+		[OP_LESS_I] = "LESS.i",
+		[OP_ADD_D] = "ADD.f",
+		[OP_LESS_D] = "LESS.f",
+		[OP_NOP] = "NOP",
+		[OP_DROP] = "DROP",
+		[OP_LESS_F] = "LESS.f",
+		[OP_STORE_I] = "STORE.i",
+		[OP_STORE_F] = "STORE.f",
+		[OP_SUB_I] = "SUB.i",
+		[OP_SUB_F] = "SUB.f",
+		[OP_MUL_I] = "MUL.i",
+		[OP_MUL_F] = "MUL.f",
+		[OP_DIV_I] = "DIV.i",
+		[OP_DIV_F] = "DIV.f",
+		[OP_ADDR] = "ADDR",
+		[OP_FPADDR_I] = "FPADDR.i",
+		[OP_FPADDR_F] = "FPADDR.f",
+		[OP_CONV_F_I] = "CONV.f.i",
+		[OP_LOAD_I] = "LOAD.i",
+		[OP_LOAD_F] = "LOAD.f",
+		[OP_ADDC_I] = "ADDC.i",
+		[OP_ADDFP_I] = "ADDFP.i",
+		[OP_INCFP_I] = "INCFP.i",
+		[OP_LESSEQ_I] = "LESSEQ.i",
+		[OP_LESSEQ_F] = "LESSEQ.f",
+		[OP_GREATER_I] = "GREATER.i",
+		[OP_GREATER_F] = "GREATER.f",
+		[OP_GREATEREQ_I] = "GREATEREQ.i",
+		[OP_GREATEREQ_F] = "GREATEREQ.f",
+		[OP_EQUAL_I] = "EQUAL.i",
+		[OP_EQUAL_F] = "EQUAL.f",
+		[OP_NOTEQ_I] = "NOTEQ.i",
+		[OP_NOTEQ_F] = "NOTEQ.f",
+		[OP_JLT_I] = "JLT.i",
+		[OP_JLE_I] = "JLE.i",
+		[OP_JGT_I] = "JGT.i",
+		[OP_JGE_I] = "JGE.i",
+		[OP_JEQ_I] = "JEQ.i",
+		[OP_JNE_I] = "JNE.i",
+		[OP_JLT_D] = "JLT.f",
+		[OP_JLE_D] = "JLE.f",
+		[OP_JGT_D] = "JGT.f",
+		[OP_JGE_D] = "JGE.f",
+		[OP_JEQ_D] = "JEQ.f",
+		[OP_JNE_D] = "JNE.f",
+		[OP_JLTC_I] = "JLTC.i",
+		[OP_JLEC_I] = "JLEC.i",
+		[OP_JGTC_I] = "JGTC.i",
+		[OP_JGEC_I] = "JGEC.i",
+		[OP_JEQC_I] = "JEQC.i",
+		[OP_JNEC_I] = "JNEC.i",
+		[OP_MULC_I] = "MULC.i",
+		[OP_SHL_I] = "SHL.i",
+		[OP_SHR_I] = "SHR.i",
+		[OP_DIVM_I] = "DIVM.i",
+		[OP_INDEX] = "INDEX",
+		[OP_INDEX_CHK] = "INDEX_CHK",
+		[OP_OFFSET] = "OFFSET",
+		[OP_LOAD_C] = "LOAD.c",
+		[OP_STORE_C] = "STORE.c",
+		[OP_VADD_F] = "VADD.f",
+		[OP_VMULADD_F] = "VMULADD.f",
+		[OP_VSUM_I] = "VSUM.i",
+		[OP_CALL_MEMO] = "CALL_MEMO",
+		[OP_MEMO_RET] = "MEMO_RET",
+		[OP_CADDR] = "CADDR",
+		[OP_FPADDR] = "FPADDR",
+	};
+	return op >= 0 && op < OP_COUNT && names[op] ? names[op] : "?";
+}
+
+bool vmStats = false;
+long long vmDispatches = 0;
+static long long opCounts[OP_COUNT];
+static long long pairCounts[OP_COUNT][OP_COUNT];
+static long long (*tripleCounts)[OP_COUNT][OP_COUNT];		// dynamically allocated, because it is large
+
+// the model of the data cache: 32 KB, 4-way set associative with LRU replacement and lines of 64 bytes
+#define CACHE_LINE 64
+#define CACHE_SETS 128
+#define CACHE_WAYS 4
+static uintptr_t cacheTags[CACHE_SETS][CACHE_WAYS];		// line+1 (0 - empty), from the most recently used
+static long long cacheAccesses, cacheMisses;
+
+void vmCacheAccess(const void *p, int size) {
+	cacheAccesses++;
+	uintptr_t first = (uintptr_t)p / CACHE_LINE, last = ((uintptr_t)p + size - 1) / CACHE_LINE;
+	for (uintptr_t line = first; line <= last; line++) {
+		uintptr_t *set = cacheTags[line % CACHE_SETS];
+		int w;
+		for (w = 0; w < CACHE_WAYS - 1 && set[w] != line + 1; w++) {}
+		if (set[w] != line + 1) cacheMisses++;
+		memmove(set + 1, set, w * sizeof(uintptr_t));
+		set[0] = line + 1;
+	}
+}
+
+void showCacheStats() {
+	printf("// data cache (32 KB, 64 B lines): %lld loads and stores, %lld misses (%.2f%%), %lld bytes read from memory\n",
+		cacheAccesses, cacheMisses, cacheAccesses ? 100.0 * cacheMisses / cacheAccesses : 0.0, cacheMisses * CACHE_LINE);
+}
+
+// the accesses of the vector instruction IP, whose operands are on stack
+static void cacheVector(Instr *IP) {
+	unsigned n = (unsigned)SP->i;
+	switch (IP->op) {
+		case OP_VADD_F:
+		case OP_VMULADD_F: {
+			Val *ops = IP->op == OP_VADD_F ? SP - 3 : SP - 4;		// c, a, b
+			for (unsigned j = 0; j < n; j++) {
+				vmCacheAccess((double*)ops[1].p + j, sizeof(double));
+				vmCacheAccess((double*)ops[2].p + j, sizeof(double));
+				vmCacheAccess((double*)ops[0].p + j, sizeof(double));
+			}
+			break;
+		}
+		case OP_VSUM_I:
+			for (unsigned j = 0; j < n; j++) vmCacheAccess((int*)SP[-1].p + j, sizeof(int));
+			break;
+		default:break;
+	}
+}
+
+// counts the instruction IP, which is executed after prev, which was executed after prev2
+// only the instructions which are adjacent in code are counted as a sequence (not the ones after a jump or call)
+// its accesses of the memory are simulated in the data cache
+static void countInstr(Instr *prev2, Instr *prev, Instr *IP) {
+	vmDispatches++;
+	opCounts[IP->op]++;
+	switch (IP->op) {
+		case OP_LOAD_C: vmCacheAccess(SP->p, 1); break;
+		case OP_LOAD_I: vmCacheAccess(SP->p, sizeof(int)); break;
+		case OP_LOAD_F: vmCacheAccess(SP->p, sizeof(double)); break;
+		case OP_STORE_C: vmCacheAccess(SP[-1].p, 1); break;
+		case OP_STORE_I: vmCacheAccess(SP[-1].p, sizeof(int)); break;
+		case OP_STORE_F: vmCacheAccess(SP[-1].p, sizeof(double)); break;
+		case OP_VADD_F:
+		case OP_VMULADD_F:
+		case OP_VSUM_I: cacheVector(IP); break;
+		default:break;
+	}
+	if (!prev || prev->next != IP) return;
+	pairCounts[prev->op][IP->op]++;
+	if (!prev2 || prev2->next != prev) return;
+	if (!tripleCounts) {
+		tripleCounts = safeAlloc(sizeof(long long[OP_COUNT][OP_COUNT][OP_COUNT]));
+		memset(tripleCounts, 0, sizeof(long long[OP_COUNT][OP_COUNT][OP_COUNT]));
+	}
+	tripleCounts[prev2->op][prev->op][IP->op]++;
+}
+
+typedef struct {
+	long long count;
+	Opcode ops[3];
+} OpSeq;
+
+static int cmpOpSeq(const void *a, const void *b) {
+	long long ca = ((const OpSeq*)a)->count, cb = ((const OpSeq*)b)->count;
+	return ca < cb ? 1 : (ca > cb ? -1 : 0);
+}
+
+// shows the n most frequent sequences of len instructions from seqs
+static void showOpSeqs(OpSeq *seqs, int nSeqs, int len, int n) {
+	qsort(seqs, nSeqs, sizeof(OpSeq), cmpOpSeq);
+	for (int k = 0; k < n && k < nSeqs && seqs[k].count; k++) {
+		printf("//	%10lld  %5.2f%%	", seqs[k].count, 100.0 * seqs[k].count / vmDispatches);
+		for (int j = 0; j < len; j++) printf("%s%s", j ? "; " : "", opName(seqs[k].ops[j]));
+		putchar('\n');
+	}
+}
+
+void showVmStats(int n) {
+	printf("\n// executed instructions (dispatches): %lld\n", vmDispatches);
+	if (!vmDispatches) return;
+	printf("// executed calls: %lld (CALL), %lld (TAILCALL), %lld (CALL_EXT), %lld (CALL_MEMO)\n", opCounts[OP_CALL], opCounts[OP_TAILCALL], opCounts[OP_CALL_EXT], opCounts[OP_CALL_MEMO]);
+	showCacheStats();
+	OpSeq *seqs = safeAlloc(OP_COUNT * OP_COUNT * OP_COUNT * sizeof(OpSeq));
+	int nSeqs = 0;
+	for (int a = 0; a < OP_COUNT; a++) {
+		if (opCounts[a]) seqs[nSeqs++] = (OpSeq){opCounts[a], {a}};
+	}
+	printf("// most executed instructions:\n");
+	showOpSeqs(seqs, nSeqs, 1, n);
+	nSeqs = 0;
+	for (int a = 0; a < OP_COUNT; a++) {
+		for (int b = 0; b < OP_COUNT; b++) {
+			if (pairCounts[a][b]) seqs[nSeqs++] = (OpSeq){pairCounts[a][b], {a, b}};
+		}
+	}
+	printf("// most executed pairs:\n");
+	showOpSeqs(seqs, nSeqs, 2, n);
+	nSeqs = 0;
+	for (int a = 0; tripleCounts && a < OP_COUNT; a++) {
+		for (int b = 0; b < OP_COUNT; b++) {
+			for (int c = 0; c < OP_COUNT; c++) {
+				if (tripleCounts[a][b][c]) seqs[nSeqs++] = (OpSeq){tripleCounts[a][b][c], {a, b, c}};
+			}
+		}
+	}
+	printf("// most executed triples:\n");
+	showOpSeqs(seqs, nSeqs, 3, n);
+	free(seqs);
+}
+
+// the kernels of the vector instructions
+// the scalar instructions round to float the popped double values (popd) and compute in double,
+// so the kernels round the same way: the results are identical to the ones of the scalar loops
+// with SSE2 (x86-64) the kernels process 2 doubles or 4 ints at once and with AVX2 (gcc -mavx2) 4 doubles or 8 ints
+
+static double roundF(double x) {
+	return (float)x;
+}
+
+#if defined(__AVX2__)
+static __m256d roundF4(__m256d x) {
+	return _mm256_cvtps_pd(_mm256_cvtpd_ps(x));
+}
+#elif defined(__SSE2__)
+static __m128d roundF2(__m128d x) {
+	return _mm_cvtps_pd(_mm_cvtpd_ps(x));
+}
+#endif
+
+// returns true if the arrays of the given size from x and y overlap, but they do not start at the same address
+// in this case a loop must run in order, because an iteration can read the result of a previous one
+static bool partialOverlap(const void *x, const void *y, size_t size) {
+	const char *a = (const char*)x, *b = (const char*)y;
+	return a != b && a < b + size && b < a + size;
+}
+
+void vaddF(double *c, const double *a, const double *b, unsigned n) {
+	unsigned j = 0;
+	size_t size = (size_t)n * sizeof(double);
+	if (!partialOverlap(c, a, size) && !partialOverlap(c, b, size)) {
+#if defined(__AVX2__)
+		for (; j + 4 <= n; j += 4) {
+			__m256d x = roundF4(_mm256_loadu_pd(a + j)), y = roundF4(_mm256_loadu_pd(b + j));
+			_mm256_storeu_pd(c + j, roundF4(_mm256_add_pd(x, y)));
+		}
+#elif defined(__SSE2__)
+		for (; j + 2 <= n; j += 2) {
+			__m128d x = roundF2(_mm_loadu_pd(a + j)), y = roundF2(_mm_loadu_pd(b + j));
+			_mm_storeu_pd(c + j, roundF2(_mm_add_pd(x, y)));
+		}
+#endif
+	}
+	// the scalar epilogue, or the whole loop for partially overlapping arrays
+	for (; j < n; j++) c[j] = roundF(roundF(a[j]) + roundF(b[j]));
+}
+
+void vmuladdF(double *c, const double *a, const double *b, double k, unsigned n) {
+	unsigned j = 0;
+	size_t size = (size_t)n * sizeof(double);
+	k = roundF(k);
+	if (!partialOverlap(c, a, size) && !partialOverlap(c, b, size)) {
+#if defined(__AVX2__)
+		__m256d k4 = _mm256_set1_pd(k);
+		for (; j + 4 <= n; j += 4) {
+			__m256d x = roundF4(_mm256_loadu_pd(a + j)), y = roundF4(_mm256_loadu_pd(b + j));
+			_mm256_storeu_pd(c + j, roundF4(_mm256_add_pd(x, roundF4(_mm256_mul_pd(y, k4)))));
+		}
+#elif defined(__SSE2__)
+		__m128d k2 = _mm_set1_pd(k);
+		for (; j + 2 <= n; j += 2) {
+			__m128d x = roundF2(_mm_loadu_pd(a + j)), y = roundF2(_mm_loadu_pd(b + j));
+			_mm_storeu_pd(c + j, roundF2(_mm_add_pd(x, roundF2(_mm_mul_pd(y, k2)))));
+		}
+#endif
+	}
+	for (; j < n; j++) c[j] = roundF(roundF(a[j]) + roundF(roundF(b[j]) * k));
+}
+
+// the int additions wrap around, so they can be done in any order
+int vsumI(int s, const int *a, unsigned n) {
+	unsigned j = 0, sum = (unsigned)s, lanes[8];
+#if defined(__AVX2__)
+	__m256i acc = _mm256_setzero_si256();
+	for (; j + 8 <= n; j += 8) acc = _mm256_add_epi32(acc, _mm256_loadu_si256((const __m256i*)(a + j)));
+	_mm256_storeu_si256((__m256i*)lanes, acc);
+	for (int l = 0; l < 8; l++) sum += lanes[l];
+#elif defined(__SSE2__)
+	__m128i acc = _mm_setzero_si128();
+	for (; j + 4 <= n; j += 4) acc = _mm_add_epi32(acc, _mm_loadu_si128((const __m128i*)(a + j)));
+	_mm_storeu_si128((__m128i*)lanes, acc);
+	for (int l = 0; l < 4; l++) sum += lanes[l];
+#endif
+	(void)lanes;
+	for (; j < n; j++) sum += (unsigned)a[j];
+	return (int)sum;
+}
+
 void run(Instr *IP) {
 	Val v;
 	int iArg, iTop, iBefore;
 	double fTop, fBefore;
 	void *pTop;
 	void(*extFnPtr)();
+	Instr *prev = NULL, *prev2 = NULL;		// the previous executed instructions, for vmStats and profileGen
 	for(;;) {
+		if (vmStats) countInstr(prev2, prev, IP);
+		if (profileGen) profileCount(prev, IP);
+		prev2 = prev;
+		prev = IP;
 		// shows the index of the current instruction and the number of values from stack
 		printf("%p/%d\t", IP, (int)(SP - stack + 1));
 		switch(IP->op) {
@@ -164,6 +611,28 @@ void run(Instr *IP) {
 				IP = IP->arg.instr;
 				break;
 			}
+			case OP_CALL_MEMO: {
+				MemoTable *t = memoTables[IP->arg2];
+				Val *args = SP - t->nParams + 1;
+				printf("CALL_MEMO\t%p, %d", IP->arg.instr, IP->arg2);
+				if (memoLookup(t, args, &v)) {
+					SP = args - 1;
+					pushv(v);
+					printf("\t// hit -> i:%d, f:%g", v.i, v.f);
+					IP = IP->next;
+				} else {
+					memoPush(t, args, IP->next);
+					pushp(&t->ret);
+					IP = IP->arg.instr;
+				}
+				break;
+			}
+			case OP_MEMO_RET: {
+				v = SP[0];
+				printf("MEMO_RET\t// i:%d, f:%g", v.i, v.f);
+				IP = memoPop(v);
+				break;
+			}
 			case OP_CALL_EXT: {
 				extFnPtr = IP->arg.extFnPtr;
 				printf("CALL_EXT\t%p\n", extFnPtr);
@@ -174,11 +643,31 @@ void run(Instr *IP) {
 			case OP_ENTER: {
 				pushp(FP);
 				FP = SP;
+				// the frame, with its inline local arrays and structs, must fit in the stack
+				if (SP + IP->arg.i >= stack + MAXSTACK) err("trying to push into a full stack");
 				SP += IP->arg.i;
 				printf("ENTER\t%d", IP->arg.i);
 				IP = IP->next;
 				break;
 			}
+			case OP_TAILCALL: {
+				// the new arguments are moved over the parameters of the current function
+				// and the called function returns directly where the current one should have returned
+				iArg = IP->arg2;
+				iTop = IP->arg.instr->arg2;		// the number of parameters of the called function, from its ENTER
+				// the return address and the old FP are read first, because if the called function
+				// has more parameters than the current one, its arguments are moved over them
+				pTop = FP[-1].p;
+				Val *oldFP = FP[0].p;
+				Val *args = FP - iArg - 1;
+				memmove(args, SP - iTop + 1, iTop * sizeof(Val));
+				SP = args + iTop - 1;
+				FP = oldFP;
+				pushp(pTop);
+				printf("TAILCALL\t%p, %d", IP->arg.instr, iArg);
+				IP = IP->arg.instr;
+				break;
+			}
 			case OP_RET_VOID: {
 				iArg = IP->arg.i;
 				printf("RET_VOID\t%d", iArg);
@@ -334,7 +823,479 @@ void run(Instr *IP) {
 				IP=IP->next;
 				break;
 			}
+
+			case OP_JT: {
+				iTop = popi();
+				printf("JT\t%p\t// %d", IP->arg.instr, iTop);
+				IP = iTop ? IP->arg.instr : IP->next;
+				break;
+			}
+
+			case OP_CONV_I_F: {
+				iTop = popi();
+				pushd((double)iTop);
+				printf("CONV.i.f\t// %d -> %g", iTop, (double)iTop);
+				IP = IP->next;
+				break;
+			}
+
+			case OP_SUB_F: {
+				fTop = popd();
+				fBefore = popd();
+				pushd(fBefore - fTop);
+				printf("SUB.f\t// %g-%g -> %g", fBefore, fTop, fBefore - fTop);
+				IP = IP->next;
+				break;
+			}
+
+			case OP_MUL_F: {
+				fTop = popd();
+				fBefore = popd();
+				pushd(fBefore * fTop);
+				printf("MUL.f\t// %g*%g -> %g", fBefore, fTop, fBefore * fTop);
+				IP = IP->next;
+				break;
+			}
+
+			case OP_DIV_I: {
+				iTop = popi();
+				iBefore = popi();
+				if (iTop == 0) err("division by zero");
+				pushi(iBefore / iTop);
+				printf("DIV.i\t// %d/%d -> %d", iBefore, iTop, iBefore / iTop);
+				IP = IP->next;
+				break;
+			}
+
+			case OP_DIV_F: {
+				fTop = popd();
+				fBefore = popd();
+				pushd(fBefore / fTop);
+				printf("DIV.f\t// %g/%g -> %g", fBefore, fTop, fBefore / fTop);
+				IP = IP->next;
+				break;
+			}
+
+			case OP_ADDR: {
+				pTop = DS + IP->arg.i;
+				pushp(pTop);
+				printf("ADDR\t%d\t// %p", IP->arg.i, pTop);
+				IP = IP->next;
+				break;
+			}
+
+			case OP_CADDR: {
+				pTop = CS + IP->arg.i;
+				pushp(pTop);
+				printf("CADDR\t%d\t// %p", IP->arg.i, pTop);
+				IP = IP->next;
+				break;
+			}
+
+			case OP_FPADDR_F: {
+				pTop = &FP[IP->arg.i].f;
+				pushp(pTop);
+				printf("FPADDR\t%d\t// %p", IP->arg.i, pTop);
+				IP = IP->next;
+				break;
+			}
+
+			case OP_FPADDR: {
+				pTop = &FP[IP->arg.i];
+				pushp(pTop);
+				printf("FPADDR\t%d, %d\t// %p", IP->arg.i, IP->arg2, pTop);
+				IP = IP->next;
+				break;
+			}
+
+			case OP_LOAD_F: {
+				pTop = popp();
+				pushd(*(double*)pTop);
+				printf("LOAD.f\t// *(double*)%p -> %g", pTop, *(double*)pTop);
+				IP = IP->next;
+				break;
+			}
+
+			case OP_STORE_F: {
+				fTop = popd();
+				v = popv();
+				*(double*)v.p = fTop;
+				pushd(fTop);
+				printf("STORE.f\t// *(double*)%p=%g", v.p, fTop);
+				IP = IP->next;
+				break;
+			}
 				
+			case OP_ADDC_I: {
+				iTop = popi();
+				pushi(iTop + IP->arg.i);
+				printf("ADDC.i\t%d\t// %d+%d -> %d", IP->arg.i, iTop, IP->arg.i, iTop + IP->arg.i);
+				IP = IP->next;
+				break;
+			}
+
+			case OP_ADDFP_I: {
+				iBefore = FP[IP->arg.i].i;
+				iTop = FP[IP->arg2].i;
+				pushi(iBefore + iTop);
+				printf("ADDFP.i\t%d, %d\t// %d+%d -> %d", IP->arg.i, IP->arg2, iBefore, iTop, iBefore + iTop);
+				IP = IP->next;
+				break;
+			}
+
+			case OP_INCFP_I: {
+				iBefore = FP[IP->arg.i].i;
+				FP[IP->arg.i].i = iBefore + IP->arg2;
+				printf("INCFP.i\t%d, %d\t// %d -> %d", IP->arg.i, IP->arg2, iBefore, iBefore + IP->arg2);
+				IP = IP->next;
+				break;
+			}
+
+			case OP_LESSEQ_I: {
+				iTop = popi();
+				iBefore = popi();
+				pushi(iBefore <= iTop);
+				printf("LESSEQ.i\t// %d<=%d -> %d", iBefore, iTop, iBefore <= iTop);
+				IP = IP->next;
+				break;
+			}
+
+			case OP_LESSEQ_F: {
+				fTop = popd();
+				fBefore = popd();
+				pushi(fBefore <= fTop);
+				printf("LESSEQ.f\t// %g<=%g -> %d", fBefore, fTop, fBefore <= fTop);
+				IP = IP->next;
+				break;
+			}
+
+			case OP_GREATER_I: {
+				iTop = popi();
+				iBefore = popi();
+				pushi(iBefore > iTop);
+				printf("GREATER.i\t// %d>%d -> %d", iBefore, iTop, iBefore > iTop);
+				IP = IP->next;
+				break;
+			}
+
+			case OP_GREATER_F: {
+				fTop = popd();
+				fBefore = popd();
+				pushi(fBefore > fTop);
+				printf("GREATER.f\t// %g>%g -> %d", fBefore, fTop, fBefore > fTop);
+				IP = IP->next;
+				break;
+			}
+
+			case OP_GREATEREQ_I: {
+				iTop = popi();
+				iBefore = popi();
+				pushi(iBefore >= iTop);
+				printf("GREATEREQ.i\t// %d>=%d -> %d", iBefore, iTop, iBefore >= iTop);
+				IP = IP->next;
+				break;
+			}
+
+			case OP_GREATEREQ_F: {
+				fTop = popd();
+				fBefore = popd();
+				pushi(fBefore >= fTop);
+				printf("GREATEREQ.f\t// %g>=%g -> %d", fBefore, fTop, fBefore >= fTop);
+				IP = IP->next;
+				break;
+			}
+
+			case OP_EQUAL_I: {
+				iTop = popi();
+				iBefore = popi();
+				pushi(iBefore == iTop);
+				printf("EQUAL.i\t// %d==%d -> %d", iBefore, iTop, iBefore == iTop);
+				IP = IP->next;
+				break;
+			}
+
+			case OP_EQUAL_F: {
+				fTop = popd();
+				fBefore = popd();
+				pushi(fBefore == fTop);
+				printf("EQUAL.f\t// %g==%g -> %d", fBefore, fTop, fBefore == fTop);
+				IP = IP->next;
+				break;
+			}
+
+			case OP_NOTEQ_I: {
+				iTop = popi();
+				iBefore = popi();
+				pushi(iBefore != iTop);
+				printf("NOTEQ.i\t// %d!=%d -> %d", iBefore, iTop, iBefore != iTop);
+				IP = IP->next;
+				break;
+			}
+
+			case OP_NOTEQ_F: {
+				fTop = popd();
+				fBefore = popd();
+				pushi(fBefore != fTop);
+				printf("NOTEQ.f\t// %g!=%g -> %d", fBefore, fTop, fBefore != fTop);
+				IP = IP->next;
+				break;
+			}
+
+			case OP_JLT_I: {
+				iTop = popi();
+				iBefore = popi();
+				printf("JLT.i\t%p\t// %d<%d -> %d", IP->arg.instr, iBefore, iTop, iBefore < iTop);
+				IP = iBefore < iTop ? IP->arg.instr : IP->next;
+				break;
+			}
+
+			case OP_JLE_I: {
+				iTop = popi();
+				iBefore = popi();
+				printf("JLE.i\t%p\t// %d<=%d -> %d", IP->arg.instr, iBefore, iTop, iBefore <= iTop);
+				IP = iBefore <= iTop ? IP->arg.instr : IP->next;
+				break;
+			}
+
+			case OP_JGT_I: {
+				iTop = popi();
+				iBefore = popi();
+				printf("JGT.i\t%p\t// %d>%d -> %d", IP->arg.instr, iBefore, iTop, iBefore > iTop);
+				IP = iBefore > iTop ? IP->arg.instr : IP->next;
+				break;
+			}
+
+			case OP_JGE_I: {
+				iTop = popi();
+				iBefore = popi();
+				printf("JGE.i\t%p\t// %d>=%d -> %d", IP->arg.instr, iBefore, iTop, iBefore >= iTop);
+				IP = iBefore >= iTop ? IP->arg.instr : IP->next;
+				break;
+			}
+
+			case OP_JEQ_I: {
+				iTop = popi();
+				iBefore = popi();
+				printf("JEQ.i\t%p\t// %d==%d -> %d", IP->arg.instr, iBefore, iTop, iBefore == iTop);
+				IP = iBefore == iTop ? IP->arg.instr : IP->next;
+				break;
+			}
+
+			case OP_JNE_I: {
+				iTop = popi();
+				iBefore = popi();
+				printf("JNE.i\t%p\t// %d!=%d -> %d", IP->arg.instr, iBefore, iTop, iBefore != iTop);
+				IP = iBefore != iTop ? IP->arg.instr : IP->next;
+				break;
+			}
+
+			case OP_JLT_D: {
+				fTop = popd();
+				fBefore = popd();
+				printf("JLT.f\t%p\t// %g<%g -> %d", IP->arg.instr, fBefore, fTop, !(fBefore >= fTop));
+				IP = !(fBefore >= fTop) ? IP->arg.instr : IP->next;
+				break;
+			}
+
+			case OP_JLE_D: {
+				fTop = popd();
+				fBefore = popd();
+				printf("JLE.f\t%p\t// %g<=%g -> %d", IP->arg.instr, fBefore, fTop, !(fBefore > fTop));
+				IP = !(fBefore > fTop) ? IP->arg.instr : IP->next;
+				break;
+			}
+
+			case OP_JGT_D: {
+				fTop = popd();
+				fBefore = popd();
+				printf("JGT.f\t%p\t// %g>%g -> %d", IP->arg.instr, fBefore, fTop, !(fBefore <= fTop));
+				IP = !(fBefore <= fTop) ? IP->arg.instr : IP->next;
+				break;
+			}
+
+			case OP_JGE_D: {
+				fTop = popd();
+				fBefore = popd();
+				printf("JGE.f\t%p\t// %g>=%g -> %d", IP->arg.instr, fBefore, fTop, !(fBefore < fTop));
+				IP = !(fBefore < fTop) ? IP->arg.instr : IP->next;
+				break;
+			}
+
+			case OP_JEQ_D: {
+				fTop = popd();
+				fBefore = popd();
+				printf("JEQ.f\t%p\t// %g==%g -> %d", IP->arg.instr, fBefore, fTop, !(fBefore != fTop));
+				IP = !(fBefore != fTop) ? IP->arg.instr : IP->next;
+				break;
+			}
+
+			case OP_JNE_D: {
+				fTop = popd();
+				fBefore = popd();
+				printf("JNE.f\t%p\t// %g!=%g -> %d", IP->arg.instr, fBefore, fTop, !(fBefore == fTop));
+				IP = !(fBefore == fTop) ? IP->arg.instr : IP->next;
+				break;
+			}
+
+			case OP_JLTC_I: {
+				iTop = popi();
+				printf("JLTC.i\t%p, %d\t// %d<%d -> %d", IP->arg.instr, IP->arg2, iTop, IP->arg2, iTop < IP->arg2);
+				IP = iTop < IP->arg2 ? IP->arg.instr : IP->next;
+				break;
+			}
+
+			case OP_JLEC_I: {
+				iTop = popi();
+				printf("JLEC.i\t%p, %d\t// %d<=%d -> %d", IP->arg.instr, IP->arg2, iTop, IP->arg2, iTop <= IP->arg2);
+				IP = iTop <= IP->arg2 ? IP->arg.instr : IP->next;
+				break;
+			}
+
+			case OP_JGTC_I: {
+				iTop = popi();
+				printf("JGTC.i\t%p, %d\t// %d>%d -> %d", IP->arg.instr, IP->arg2, iTop, IP->arg2, iTop > IP->arg2);
+				IP = iTop > IP->arg2 ? IP->arg.instr : IP->next;
+				break;
+			}
+
+			case OP_JGEC_I: {
+				iTop = popi();
+				printf("JGEC.i\t%p, %d\t// %d>=%d -> %d", IP->arg.instr, IP->arg2, iTop, IP->arg2, iTop >= IP->arg2);
+				IP = iTop >= IP->arg2 ? IP->arg.instr : IP->next;
+				break;
+			}
+
+			case OP_JEQC_I: {
+				iTop = popi();
+				printf("JEQC.i\t%p, %d\t// %d==%d -> %d", IP->arg.instr, IP->arg2, iTop, IP->arg2, iTop == IP->arg2);
+				IP = iTop == IP->arg2 ? IP->arg.instr : IP->next;
+				break;
+			}
+
+			case OP_JNEC_I: {
+				iTop = popi();
+				printf("JNEC.i\t%p, %d\t// %d!=%d -> %d", IP->arg.instr, IP->arg2, iTop, IP->arg2, iTop != IP->arg2);
+				IP = iTop != IP->arg2 ? IP->arg.instr : IP->next;
+				break;
+			}
+
+			case OP_MULC_I: {
+				iTop = popi();
+				pushi(iTop * IP->arg.i);
+				printf("MULC.i\t%d\t// %d*%d -> %d", IP->arg.i, iTop, IP->arg.i, iTop * IP->arg.i);
+				IP = IP->next;
+				break;
+			}
+
+			case OP_SHL_I: {
+				iTop = popi();
+				iBefore = (int)((unsigned)iTop << IP->arg.i);
+				pushi(iBefore);
+				printf("SHL.i\t%d\t// %d<<%d -> %d", IP->arg.i, iTop, IP->arg.i, iBefore);
+				IP = IP->next;
+				break;
+			}
+
+			case OP_SHR_I: {
+				iTop = popi();
+				// the negative values are rounded towards 0, so 2^k-1 is added before the arithmetic shift
+				iBefore = (iTop < 0 ? iTop + ((1 << IP->arg.i) - 1) : iTop) >> IP->arg.i;
+				pushi(iBefore);
+				printf("SHR.i\t%d\t// %d/%d -> %d", IP->arg.i, iTop, 1 << IP->arg.i, iBefore);
+				IP = IP->next;
+				break;
+			}
+
+			case OP_DIVM_I: {
+				// the high 32 bits of iTop*magic, corrected (Hacker's Delight, 10-4)
+				iTop = popi();
+				iBefore = (int)(((long long)iTop * IP->arg.i) >> 32);
+				if (IP->arg.i < 0) iBefore += iTop;
+				iBefore = (iBefore >> IP->arg2) + (int)((unsigned)iTop >> 31);
+				pushi(iBefore);
+				printf("DIVM.i\t%d, %d\t// %d -> %d", IP->arg.i, IP->arg2, iTop, iBefore);
+				IP = IP->next;
+				break;
+			}
+
+			case OP_INDEX: {
+				iTop = popi();
+				pTop = popp();
+				pushp((char*)pTop + (long long)iTop * IP->arg.i);
+				printf("INDEX\t%d\t// %p[%d] -> %p", IP->arg.i, pTop, iTop, SP->p);
+				IP = IP->next;
+				break;
+			}
+
+			case OP_INDEX_CHK: {
+				iTop = popi();
+				pTop = popp();
+				if (iTop < 0 || iTop >= IP->arg2) {
+					err("index %d out of the bounds of an array with %d elements", iTop, IP->arg2);
+				}
+				pushp((char*)pTop + (long long)iTop * IP->arg.i);
+				printf("INDEX_CHK\t%d, %d\t// %p[%d] -> %p", IP->arg.i, IP->arg2, pTop, iTop, SP->p);
+				IP = IP->next;
+				break;
+			}
+
+			case OP_OFFSET: {
+				pTop = popp();
+				pushp((char*)pTop + IP->arg.i);
+				printf("OFFSET\t%d\t// %p -> %p", IP->arg.i, pTop, SP->p);
+				IP = IP->next;
+				break;
+			}
+
+			case OP_VADD_F: {
+				unsigned n = (unsigned)popi();
+				double *b = (double*)popp(), *a = (double*)popp(), *c = (double*)popp();
+				vaddF(c, a, b, n);
+				printf("VADD.f\t// %p[0..%u)=%p[..]+%p[..]", (void*)c, n, (void*)a, (void*)b);
+				IP = IP->next;
+				break;
+			}
+
+			case OP_VMULADD_F: {
+				unsigned n = (unsigned)popi();
+				fTop = popd();
+				double *b = (double*)popp(), *a = (double*)popp(), *c = (double*)popp();
+				vmuladdF(c, a, b, fTop, n);
+				printf("VMULADD.f\t// %p[0..%u)=%p[..]+%p[..]*%g", (void*)c, n, (void*)a, (void*)b, fTop);
+				IP = IP->next;
+				break;
+			}
+
+			case OP_VSUM_I: {
+				unsigned n = (unsigned)popi();
+				pTop = popp();
+				iTop = popi();
+				iBefore = vsumI(iTop, (int*)pTop, n);
+				pushi(iBefore);
+				printf("VSUM.i\t// %d+sum(%p[0..%u)) -> %d", iTop, pTop, n, iBefore);
+				IP = IP->next;
+				break;
+			}
+
+			case OP_LOAD_C: {
+				pTop = popp();
+				pushi(*(char*)pTop);
+				printf("LOAD.c\t// *(char*)%p -> %d", pTop, *(char*)pTop);
+				IP = IP->next;
+				break;
+			}
+
+			case OP_STORE_C: {
+				iTop = popi();
+				v = popv();
+				constStoreCheck(v.p);
+				*(char*)v.p = (char)iTop;
+				pushi((char)iTop);
+				printf("STORE.c\t// *(char*)%p=%d", v.p, (char)iTop);
+				IP = IP->next;
+				break;
+			}
+
 			default:
 		    {
 				err("run: instructiune neimplementata: %d", IP->op);
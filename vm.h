@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stdbool.h>
+
 // stack based virtual machine
 
 // the instructions of the virtual machine
@@ -18,9 +20,10 @@ typedef enum {
 	OP_PUSH_I,		// [ct.i] puts on stack the constant ct.i
 	OP_CALL,		// [instr] calls a VM function which starts with the given instruction
 	OP_CALL_EXT,	// [native_addr] calls a host function (machine code) at the given address
-	OP_ENTER,		// [nb_locals] creates a function frame with the given number of local variables
+	OP_ENTER,		// [nb_locals, nb_params] creates a function frame with the given number of local variables
 	OP_RET,			// [nb_params] returns from a function which has the given number of parameters and returns a value
 	OP_RET_VOID,	// [nb_params] returns from a function which has the given number of parameters without returning a value
+	OP_TAILCALL,	// [instr, nb_params] CALL+RET: calls instr reusing the frame of the current function, which has nb_params parameters
 	OP_CONV_I_F,	// converts the value from stack from int to double
 	OP_JMP,			// [instr] unconditional jump to the specified instruction
 	OP_JF,			// [instr] jumps to the specified instruction if the value from stack is false
@@ -44,12 +47,70 @@ typedef enum {
 	OP_MUL_F,
 	OP_DIV_I,
 	OP_DIV_F,
-	OP_ADDR,
+	OP_ADDR,		// [offset] puts on stack the address of the global data at the given offset in the data segment: DS+offset
 	OP_FPADDR_I,
 	OP_FPADDR_F,
 	OP_CONV_F_I,
 	OP_LOAD_I,
-	OP_LOAD_F
+	OP_LOAD_F,
+	OP_LESSEQ_I,		// compares 2 int values from stack (<=) and puts the result on stack as int
+	OP_LESSEQ_F,		// compares 2 double values from stack (<=) and puts the result on stack as int
+	OP_GREATER_I,		// compares 2 int values from stack (>) and puts the result on stack as int
+	OP_GREATER_F,		// compares 2 double values from stack (>) and puts the result on stack as int
+	OP_GREATEREQ_I,		// compares 2 int values from stack (>=) and puts the result on stack as int
+	OP_GREATEREQ_F,		// compares 2 double values from stack (>=) and puts the result on stack as int
+	OP_EQUAL_I,		// compares 2 int values from stack (==) and puts the result on stack as int
+	OP_EQUAL_F,		// compares 2 double values from stack (==) and puts the result on stack as int
+	OP_NOTEQ_I,		// compares 2 int values from stack (!=) and puts the result on stack as int
+	OP_NOTEQ_F,		// compares 2 double values from stack (!=) and puts the result on stack as int
+	// superinstructions, which replace frequent sequences of instructions
+	OP_ADDC_I,		// [ct.i] adds ct.i to the int value from stack (PUSH_I ct; ADD_I)
+	OP_ADDFP_I,		// [idx, idx2] puts on stack FP[idx].i+FP[idx2].i (FPLOAD idx; FPLOAD idx2; ADD_I)
+	OP_INCFP_I,		// [idx, ct.i] adds ct.i to FP[idx].i (FPLOAD idx; PUSH_I ct; ADD_I; FPSTORE idx)
+	// compare and branch: [instr] compares 2 values from stack and jumps to instr if the condition is true
+	// for doubles, the condition is the negation of the opposite comparison (JGE_D jumps if !(a<b)),
+	// so they behave exactly like JF after the opposite comparison, even for NaN
+	OP_JLT_I,		// [instr] jumps if the int values from stack are a<b
+	OP_JLE_I,		// [instr] jumps if the int values from stack are a<=b
+	OP_JGT_I,		// [instr] jumps if the int values from stack are a>b
+	OP_JGE_I,		// [instr] jumps if the int values from stack are a>=b
+	OP_JEQ_I,		// [instr] jumps if the int values from stack are a==b
+	OP_JNE_I,		// [instr] jumps if the int values from stack are a!=b
+	OP_JLT_D,		// [instr] jumps if the double values from stack are a<b
+	OP_JLE_D,		// [instr] jumps if the double values from stack are a<=b
+	OP_JGT_D,		// [instr] jumps if the double values from stack are a>b
+	OP_JGE_D,		// [instr] jumps if the double values from stack are a>=b
+	OP_JEQ_D,		// [instr] jumps if the double values from stack are a==b
+	OP_JNE_D,		// [instr] jumps if the double values from stack are a!=b
+	// compare with an immediate and branch: [instr, ct.i] compares the int value from stack with ct.i
+	OP_JLTC_I,		// [instr, ct.i] jumps if the int value from stack is a<ct.i
+	OP_JLEC_I,		// [instr, ct.i] jumps if the int value from stack is a<=ct.i
+	OP_JGTC_I,		// [instr, ct.i] jumps if the int value from stack is a>ct.i
+	OP_JGEC_I,		// [instr, ct.i] jumps if the int value from stack is a>=ct.i
+	OP_JEQC_I,		// [instr, ct.i] jumps if the int value from stack is a==ct.i
+	OP_JNEC_I,		// [instr, ct.i] jumps if the int value from stack is a!=ct.i
+	// multiplications and divisions by constants (strength reduction), with the same results as MUL_I and DIV_I
+	OP_MULC_I,		// [ct.i] multiplies the int value from stack with ct.i (PUSH_I ct; MUL_I)
+	OP_SHL_I,		// [k] shifts left the int value from stack with k bits: multiplication with 2^k (PUSH_I 2^k; MUL_I)
+	OP_SHR_I,		// [k] divides the int value from stack by 2^k, rounding towards 0 like DIV_I (PUSH_I 2^k; DIV_I)
+	OP_DIVM_I,		// [magic, shift] divides the int value from stack by a constant d>=2 (PUSH_I d; DIV_I) using the magic number of d
+	// arrays and structs
+	OP_INDEX,		// [size] pops an int index and an address and puts on stack the address of the element: address+index*size
+	OP_INDEX_CHK,		// [size, n] like INDEX, but stops the program if the index is not in [0,n) (atomc -bounds-check)
+	OP_OFFSET,		// [offset] adds offset bytes to the address from stack (a struct field or a constant index)
+	OP_LOAD_C,		// puts on stack as int the char from the address from stack
+	OP_STORE_C,		// stores the int value from stack as char at the address below it and puts on stack the stored char
+	// vector instructions (auto-vectorization), which run a whole loop in a single dispatch
+	// n is an unsigned count and the double values are rounded like by ADD_D and MUL_F
+	OP_VADD_F,		// pops the addresses c, a, b (double) and n: c[j]=a[j]+b[j] for j in [0,n)
+	OP_VMULADD_F,		// pops the addresses c, a, b (double), the double k and n: c[j]=a[j]+b[j]*k for j in [0,n)
+	OP_VSUM_I,		// pops the int s, the address a (int) and n and puts on stack s+a[0]+...+a[n-1]
+	// memoization of the pure functions (atomc -memo, see memo.h)
+	OP_CALL_MEMO,		// [instr, table] like CALL, but if the arguments are found in memoTables[table], they are replaced by the saved result
+	OP_MEMO_RET,		// the return address of a CALL_MEMO whose arguments were not found: saves the result and returns to the caller
+	OP_CADDR,		// [offset] puts on stack the address of the constant at the given offset in the constant pool: CS+offset
+	OP_FPADDR,		// [idx, n] puts on stack the address of the local array or struct stored inline in the n slots from FP[idx]
+	OP_COUNT		// the number of opcodes (not an instruction)
 } Opcode;
 
 typedef struct Instr Instr;
@@ -63,11 +124,20 @@ typedef union {
 	Instr *instr;			// pointer to an instruction
 } Val;
 
+// the execution counts of an instruction in a profiled run (see profile.h)
+typedef struct {
+	long long count;		// how many times the instruction was executed
+	long long taken;		// for a conditional jump: how many times it jumped
+	long long entries;		// for the backward JMP of a loop: how many times the loop was entered
+} ProfileData;
+
 // a VM instruction
 struct Instr {
 	Opcode op;			// opcode: OP_*
+	int arg2;			// the second argument of a superinstruction (it uses the padding after op)
 	Val arg;
 	Instr *next;		// the link to the next instruction in list
+	ProfileData *prof;		// the counts from the profile, or NULL if they are not known
 };
 
 // adds a new instruction to the end of list and sets its "op" field
@@ -93,9 +163,86 @@ Instr *addInstrWithDouble(Instr **list, Opcode op, double argVal);
 // MV initialisation
 void vmInit();
 
+#define MAXSTACK 10000
+
+// the stack, with the frames of the functions and the values of the stack VM
+extern Val stack[MAXSTACK];
+// the top of the stack and the frame of the current function
+// the extern (host) functions pop their arguments from SP and push their result
+extern Val *SP,*FP;
+
+// the data segment, a single memory block with all the global variables
+// the compiler allocates each global at an offset in the segment and ADDR has this offset as argument,
+// so the code does not contain host addresses; the VM resolves the offsets against its base pointer DS
+extern char *DS;
+// the size of the data segment in bytes
+extern int dataSize;
+
+// allocates size bytes aligned to align in the data segment and returns their offset
+int dataAlloc(int size,int align);
+
+// allocates the data segment of the VM, zero initialized and aligned to 64 bytes (a cache line)
+// it must be called after the whole program was compiled, before run
+void dataInit();
+
+// frees the data segment, with all the global variables
+void dataFree();
+
+// the constant pool, a read-only segment with the string literals
+// each literal is stored once (the literals with the same content are interned) and CADDR has its offset as argument,
+// so the pool does not depend on the addresses where it is placed and it can be mapped as it is from a file
+extern char *CS;
+// the size of the constant pool in bytes
+extern int constSize;
+// the number of the different string literals
+extern int constStrings;
+
+// adds the string s (with its terminator) to the constant pool if it is not already there and returns its offset
+int constIntern(const char *s);
+
+// returns the string at the given offset in the constant pool built by the compiler (before constInit)
+const char *constString(int offset);
+
+// maps the constant pool of the VM in memory, read-only if the system allows it
+// it must be called after the whole program was compiled, before run
+void constInit();
+
+// stops the program with an error if p is in the constant pool
+// only a char store can get there, through a char[] parameter which received a string literal
+void constStoreCheck(void *p);
+
+// unmaps the constant pool and empties it
+void constFree();
+
+// returns the name of the opcode, as it is shown in the execution trace
+const char *opName(Opcode op);
+
+// if true, run counts the executed instructions (dispatches) and
+// the sequences of 2 and 3 adjacent instructions executed one after another
+extern bool vmStats;
+
+// the number of executed instructions, if vmStats is true
+extern long long vmDispatches;
+
+// shows the number of dispatches, the accesses of the data cache and the n most frequent sequences of 2 and 3 instructions
+void showVmStats(int n);
+
+// simulates a load or a store of size bytes at p in a model of the data cache, if vmStats is true
+// both VMs call it for their loads, stores and vector instructions, so their memory traffic can be compared
+void vmCacheAccess(const void *p,int size);
+
+// shows the number of accesses and misses of the data cache
+void showCacheStats();
+
 // executes the code starting with the given instruction (IP - Instruction Pointer)
 void run(Instr *IP);
 
+// the kernels of the vector instructions, shared with the register VM (see regvm.h)
+// the double values are rounded to float like by popd, so they give the same results as the scalar loops
+void vaddF(double *c,const double *a,const double *b,unsigned n);
+void vmuladdF(double *c,const double *a,const double *b,double k,unsigned n);
+int vsumI(int s,const int *a,unsigned n);
+
 // generates a test program
 Instr *genTestProgram();
 